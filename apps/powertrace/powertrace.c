@@ -74,11 +74,13 @@ powertrace_print(char *str)
 {
   static unsigned long last_cpu, last_lpm, last_transmit, last_listen;
   static unsigned long last_idle_transmit, last_idle_listen;
+  static unsigned long last_wur_rx, last_wur_tx;
 
   unsigned long cpu, lpm, transmit, listen;
   unsigned long all_cpu, all_lpm, all_transmit, all_listen;
   unsigned long idle_transmit, idle_listen;
   unsigned long all_idle_transmit, all_idle_listen;
+  unsigned long all_wur_rx, all_wur_tx;
 
   static unsigned long seqno;
 
@@ -92,6 +94,8 @@ powertrace_print(char *str)
   all_lpm = energest_type_time(ENERGEST_TYPE_LPM);
   all_transmit = energest_type_time(ENERGEST_TYPE_TRANSMIT);
   all_listen = energest_type_time(ENERGEST_TYPE_LISTEN);
+  all_wur_rx = energest_type_time(ENERGEST_TYPE_WUR_RX);
+  all_wur_tx = energest_type_time(ENERGEST_TYPE_WUR_TX);
   all_idle_transmit = compower_idle_activity.transmit;
   all_idle_listen = compower_idle_activity.listen;
 
@@ -133,6 +137,15 @@ powertrace_print(char *str)
          (int)((100L * listen) / time),
          (int)((10000L * listen) / time - (100L * listen / time) * 100));
 
+  /* Wake-up radio, only on nodes that have one */
+  if(all_wur_rx != 0 || all_wur_tx != 0) {
+    printf("%s %lu PW %d.%d %lu %lu %lu %lu %lu\n",
+           str, clock_time(), linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1], seqno,
+           all_wur_rx, all_wur_tx, all_wur_rx - last_wur_rx, all_wur_tx - last_wur_tx);
+  }
+  last_wur_rx = all_wur_rx;
+  last_wur_tx = all_wur_tx;
+
   for(s = list_head(stats_list); s != NULL; s = list_item_next(s)) {
 
 #if ! NETSTACK_CONF_WITH_IPV6
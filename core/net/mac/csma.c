@@ -43,6 +43,7 @@
 
 #include "sys/ctimer.h"
 #include "sys/clock.h"
+#include "sys/prof.h"
 
 #include "lib/random.h"
 
@@ -323,6 +324,7 @@ packet_sent(void *ptr, int status, int num_transmissions)
   if(n == NULL) {
     return;
   }
+  PROF_ENTER(csma_sent);
 
   /* Find out what packet this callback refers to */
   for(q = list_head(n->queued_packet_list);
@@ -336,9 +338,11 @@ packet_sent(void *ptr, int status, int num_transmissions)
   if(q == NULL) {
     PRINTF("csma: seqno %d not found\n",
            packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO));
+    PROF_EXIT(csma_sent);
     return;
   } else if(q->ptr == NULL) {
     PRINTF("csma: no metadata\n");
+    PROF_EXIT(csma_sent);
     return;
   }
 
@@ -358,6 +362,7 @@ packet_sent(void *ptr, int status, int num_transmissions)
     tx_done(status, q, n);
     break;
   }
+  PROF_EXIT(csma_sent);
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -369,6 +374,7 @@ send_packet(mac_callback_t sent, void *ptr)
   static uint16_t seqno;
   const linkaddr_t *addr = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
 
+  PROF_ENTER(csma_send);
   if(!initialized) {
     initialized = 1;
     /* Initialize the sequence number to a random value as per 802.15.4. */
@@ -435,6 +441,7 @@ send_packet(mac_callback_t sent, void *ptr)
             if(list_head(n->queued_packet_list) == q) {
               schedule_transmission(n);
             }
+            PROF_EXIT(csma_send);
             return;
           }
           memb_free(&metadata_memb, q->ptr);
@@ -455,6 +462,7 @@ send_packet(mac_callback_t sent, void *ptr)
   } else {
     PRINTF("csma: could not allocate neighbor, dropping packet\n");
   }
+  PROF_EXIT(csma_send);
   mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
 }
 /*---------------------------------------------------------------------------*/
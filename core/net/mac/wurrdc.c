@@ -15,16 +15,14 @@
 #include "net/rime/rimestats.h"
 #include "dev/leds.h"
 #include "sys/rtimer.h"
+#include "sys/prof.h"
+#include "lib/random.h"
 #include "clock.h" /* for clock_delay() */
 // #include "dev/sensors.h" /* SENSORS_ACTIVATE(), sensors_event */
 
 #include <string.h>
 #include <stdio.h>
 
-#if CONTIKI_TARGET_COOJA
-#include "lib/simEnvChange.h"
-#endif /* CONTIKI_TARGET_COOJA */
-
 /* ===== Friendly logging toggle (no behavior change) ===== */
 #ifndef LOG_WUR
 #define LOG_WUR 0 /* 1: enable friendly logs; 0: disable */
@@ -41,6 +39,16 @@ static inline void addr_print(const linkaddr_t *a)
   WUR_LOG("%02x:%02x", a->u8[0], a->u8[1]);
 }
 
+/* WuS address field, WURRDC_WUS_ADDR_LEN bytes */
+static inline void wus_addr_print(const uint8_t *buf)
+{
+#if WURRDC_WUS_ADDR_LEN == 1
+  WUR_LOG("%02x", buf[0]);
+#else
+  addr_print((const linkaddr_t *)buf);
+#endif
+}
+
 #define DEBUG 0
 #if DEBUG
 #include <stdio.h>
@@ -55,6 +63,14 @@ static inline void addr_print(const linkaddr_t *a)
 #define WURRDC_ADDRESS_FILTER 1
 #endif /* WURRDC_CONF_ADDRESS_FILTER */
 
+/* Reject unicast frames for other nodes from the raw header, before the
+ * framer and duplicate detection run (needs WURRDC_ADDRESS_FILTER) */
+#ifdef WURRDC_CONF_EARLY_DROP
+#define WURRDC_EARLY_DROP WURRDC_CONF_EARLY_DROP
+#else
+#define WURRDC_EARLY_DROP 1
+#endif /* WURRDC_CONF_EARLY_DROP */
+
 #ifndef WURRDC_802154_AUTOACK
 #ifdef WURRDC_CONF_802154_AUTOACK
 #define WURRDC_802154_AUTOACK WURRDC_CONF_802154_AUTOACK
@@ -72,8 +88,6 @@ static inline void addr_print(const linkaddr_t *a)
 #endif /* WURRDC_802154_AUTOACK_HW */
 
 #if WURRDC_802154_AUTOACK
-#include "dev/watchdog.h"
-
 #ifdef WURRDC_CONF_ACK_WAIT_TIME
 #define ACK_WAIT_TIME WURRDC_CONF_ACK_WAIT_TIME
 #else /* WURRDC_CONF_ACK_WAIT_TIME */
@@ -92,221 +106,856 @@ static inline void addr_print(const linkaddr_t *a)
 #define WURRDC_SEND_802154_ACK 0
 #endif /* WURRDC_CONF_SEND_802154_ACK */
 
-#if WURRDC_SEND_802154_ACK
+#if WURRDC_SEND_802154_ACK || WURRDC_EARLY_DROP
 #include "net/mac/frame802154.h"
-#endif /* WURRDC_SEND_802154_ACK */
+#endif /* WURRDC_SEND_802154_ACK || WURRDC_EARLY_DROP */
+
+/* Burst mode: send_list() wakes the receiver once per list. Every frame but
+ * the last has the 802.15.4 frame pending bit set, and the receiver keeps
+ * listening for WURRDC_BURST_WINDOW after each of them. */
+#ifdef WURRDC_CONF_BURST
+#define WURRDC_BURST WURRDC_CONF_BURST
+#else
+#define WURRDC_BURST 1
+#endif /* WURRDC_CONF_BURST */
+
+/* Receiver listen window after a WuS without length hint, in clock ticks */
+#ifdef WURRDC_CONF_RX_WINDOW
+#define WURRDC_RX_WINDOW WURRDC_CONF_RX_WINDOW
+#else
+#define WURRDC_RX_WINDOW 3
+#endif /* WURRDC_CONF_RX_WINDOW */
+
+/* Time between the end of the WuS and the start of the data frame at the
+ * sender (clock_delay(), radio start-up, CCA), in rtimer ticks */
+#ifdef WURRDC_CONF_RX_GUARD
+#define WURRDC_RX_GUARD WURRDC_CONF_RX_GUARD
+#else
+#define WURRDC_RX_GUARD (RTIMER_SECOND / 200)
+#endif /* WURRDC_CONF_RX_GUARD */
+
+/* Wake-up channel carrier sense: a WuS heard from a neighbor, for us or
+ * not, announces a data exchange (its hint); ours is deferred until that
+ * exchange is over plus a random backoff of 0..2^BE-1 units, BE growing
+ * from MIN_BE to MAX_BE. After MAX_BACKOFFS deferrals the frame goes back
+ * to the MAC as a collision. */
+#ifdef WURRDC_CONF_WUS_CCA
+#define WURRDC_WUS_CCA WURRDC_CONF_WUS_CCA
+#else
+#define WURRDC_WUS_CCA 1
+#endif /* WURRDC_CONF_WUS_CCA */
+#ifdef WURRDC_CONF_WUS_MIN_BE
+#define WURRDC_WUS_MIN_BE WURRDC_CONF_WUS_MIN_BE
+#else
+#define WURRDC_WUS_MIN_BE 1
+#endif /* WURRDC_CONF_WUS_MIN_BE */
+#ifdef WURRDC_CONF_WUS_MAX_BE
+#define WURRDC_WUS_MAX_BE WURRDC_CONF_WUS_MAX_BE
+#else
+#define WURRDC_WUS_MAX_BE 4
+#endif /* WURRDC_CONF_WUS_MAX_BE */
+#ifdef WURRDC_CONF_WUS_MAX_BACKOFFS
+#define WURRDC_WUS_MAX_BACKOFFS WURRDC_CONF_WUS_MAX_BACKOFFS
+#else
+#define WURRDC_WUS_MAX_BACKOFFS 4
+#endif /* WURRDC_CONF_WUS_MAX_BACKOFFS */
+/* Backoff unit: one group WuS on air, in rtimer ticks */
+#ifdef WURRDC_CONF_WUS_BACKOFF_UNIT
+#define WURRDC_WUS_BACKOFF_UNIT WURRDC_CONF_WUS_BACKOFF_UNIT
+#else
+#define WURRDC_WUS_BACKOFF_UNIT WUS_AIRTIME(WUS_GROUP_LEN)
+#endif /* WURRDC_CONF_WUS_BACKOFF_UNIT */
+
+/* Wake-up radio profile: bitrate (bit/s) and preamble (bits) of the WuR
+ * hardware. COOJA's WakeupRadio delivers a WuS at a fixed 100 kbit/s with
+ * no preamble, so keep the defaults for simulations. The WuS carries the first ADDR_LEN bytes of the link-layer address (1 on
+ * sky with node ids below 256; a shorter address can wake a node whose
+ * id shares it, the frame address filter then drops the frame). */
+#ifdef WURRDC_CONF_WUS_BITRATE
+#define WURRDC_WUS_BITRATE WURRDC_CONF_WUS_BITRATE
+#else
+#define WURRDC_WUS_BITRATE 100000
+#endif /* WURRDC_CONF_WUS_BITRATE */
+#ifdef WURRDC_CONF_WUS_PREAMBLE
+#define WURRDC_WUS_PREAMBLE WURRDC_CONF_WUS_PREAMBLE
+#else
+#define WURRDC_WUS_PREAMBLE 0
+#endif /* WURRDC_CONF_WUS_PREAMBLE */
+#ifdef WURRDC_CONF_WUS_ADDR_LEN
+#define WURRDC_WUS_ADDR_LEN WURRDC_CONF_WUS_ADDR_LEN
+#else
+#define WURRDC_WUS_ADDR_LEN LINKADDR_SIZE
+#endif /* WURRDC_CONF_WUS_ADDR_LEN */
+#if WURRDC_WUS_ADDR_LEN < 1 || WURRDC_WUS_ADDR_LEN > LINKADDR_SIZE
+#error "WURRDC_CONF_WUS_ADDR_LEN must be 1..LINKADDR_SIZE"
+#endif
+
+/* Dual mode: under load (unicast frames for us from all neighbors at
+ * ON_RATE frames/s or more, or at most ON_QUEUEBUF free queue buffers)
+ * the main radio stays on and neighbors told by an awake announcement
+ * send without WuS. Back to WuS mode below OFF_RATE, with free buffers,
+ * after at least MIN_AWAKE clock ticks. Load is evaluated every PERIOD. */
+#ifdef WURRDC_CONF_ADAPTIVE
+#define WURRDC_ADAPTIVE WURRDC_CONF_ADAPTIVE
+#else
+#define WURRDC_ADAPTIVE 0
+#endif /* WURRDC_CONF_ADAPTIVE */
+#ifdef WURRDC_CONF_ADAPTIVE_ON_RATE
+#define WURRDC_ADAPTIVE_ON_RATE WURRDC_CONF_ADAPTIVE_ON_RATE
+#else
+#define WURRDC_ADAPTIVE_ON_RATE 4
+#endif /* WURRDC_CONF_ADAPTIVE_ON_RATE */
+#ifdef WURRDC_CONF_ADAPTIVE_OFF_RATE
+#define WURRDC_ADAPTIVE_OFF_RATE WURRDC_CONF_ADAPTIVE_OFF_RATE
+#else
+#define WURRDC_ADAPTIVE_OFF_RATE 1
+#endif /* WURRDC_CONF_ADAPTIVE_OFF_RATE */
+#ifdef WURRDC_CONF_ADAPTIVE_ON_QUEUEBUF
+#define WURRDC_ADAPTIVE_ON_QUEUEBUF WURRDC_CONF_ADAPTIVE_ON_QUEUEBUF
+#else
+#define WURRDC_ADAPTIVE_ON_QUEUEBUF 2
+#endif /* WURRDC_CONF_ADAPTIVE_ON_QUEUEBUF */
+#ifdef WURRDC_CONF_ADAPTIVE_MIN_AWAKE
+#define WURRDC_ADAPTIVE_MIN_AWAKE WURRDC_CONF_ADAPTIVE_MIN_AWAKE
+#else
+#define WURRDC_ADAPTIVE_MIN_AWAKE (5 * CLOCK_SECOND)
+#endif /* WURRDC_CONF_ADAPTIVE_MIN_AWAKE */
+#ifdef WURRDC_CONF_ADAPTIVE_PERIOD
+#define WURRDC_ADAPTIVE_PERIOD WURRDC_CONF_ADAPTIVE_PERIOD
+#else
+#define WURRDC_ADAPTIVE_PERIOD CLOCK_SECOND
+#endif /* WURRDC_CONF_ADAPTIVE_PERIOD */
+/* Awake announcements are repeated at this interval while on, and a
+ * neighbor not heard again within 3 intervals is assumed asleep */
+#ifdef WURRDC_CONF_ADAPTIVE_ANNOUNCE
+#define WURRDC_ADAPTIVE_ANNOUNCE WURRDC_CONF_ADAPTIVE_ANNOUNCE
+#else
+#define WURRDC_ADAPTIVE_ANNOUNCE (10 * CLOCK_SECOND)
+#endif /* WURRDC_CONF_ADAPTIVE_ANNOUNCE */
+/* Neighbors tracked for the arrival rate and for their awake state */
+#ifdef WURRDC_CONF_ADAPTIVE_NEIGHBORS
+#define WURRDC_ADAPTIVE_NEIGHBORS WURRDC_CONF_ADAPTIVE_NEIGHBORS
+#else
+#define WURRDC_ADAPTIVE_NEIGHBORS 8
+#endif /* WURRDC_CONF_ADAPTIVE_NEIGHBORS */
 
 #define ACK_LEN 3
 
+/* CC2420 at 250 kbit/s: 32 us per byte, 6 bytes of preamble, SFD and length */
+#define PHY_OVERHEAD 6
+#define PHY_MAX_LEN 127
+#define AIRTIME(bytes) \
+  ((rtimer_clock_t)(((uint32_t)(bytes) * RTIMER_SECOND + 31249) / 31250))
+/* 12 symbol turnaround, then the ACK frame (with FCS) */
+#define ACK_TIME \
+  (AIRTIME(PHY_OVERHEAD + ACK_LEN + 2) + (rtimer_clock_t)(RTIMER_SECOND / 5208 + 1))
+#define RX_WINDOW_DEFAULT \
+  ((rtimer_clock_t)((uint32_t)WURRDC_RX_WINDOW * RTIMER_SECOND / CLOCK_SECOND))
+/* Next frame of a burst: length unknown, assume the largest one */
+#define WURRDC_BURST_WINDOW \
+  (WURRDC_RX_GUARD + AIRTIME(PHY_OVERHEAD + PHY_MAX_LEN) + ACK_TIME)
+
+/* WuS payload: receiver address, then a hint about the data frame that
+ * follows: its length on the radio (low 7 bits) and whether the receiver
+ * answers with an ACK. A WuS without hint gets RX_WINDOW_DEFAULT.
+ * A broadcast WuS for a group (wurrdc.h) appends the mode and its two
+ * arguments, little endian. */
+#define WUS_LEN (WURRDC_WUS_ADDR_LEN + 1)
+#define WUS_HINT_ACK 0x80
+#define WUS_HINT_LEN_MASK 0x7f
+#define WUS_GROUP_LEN (WUS_LEN + 5)
+/* Group WuS that wakes nobody: the sender's main radio is on (arg0 1) or
+ * off again (arg0 0), arg1 is its node id */
+#define WUS_AWAKE 0x7f
+/* Tagged: group part (mode may be WURRDC_WUS_ADDR), epoch, sender, and the
+ * low byte of the frame's MAC sequence number, which CSMA keeps on retries */
+#define WUS_TAGGED_SEQNO (WUS_GROUP_LEN + 2 + WURRDC_WUS_ADDR_LEN)
+#define WUS_TAGGED_LEN (WUS_TAGGED_SEQNO + 1)
+
 /* Exposed by the WuR driver */
 uint8_t WUR_RX_LENGTH;
-uint8_t WUR_RX_BUFFER[LINKADDR_SIZE]; /* RX buffer for the WUR address */
+uint8_t WUR_RX_BUFFER[WUS_TAGGED_LEN]; /* RX buffer for the WuS */
 
 uint8_t WUR_TX_LENGTH;
-uint8_t WUR_TX_BUFFER[LINKADDR_SIZE]; /* TX buffer for the WUR address */
+uint8_t WUR_TX_BUFFER[WUS_TAGGED_LEN]; /* TX buffer for the WuS */
+
+/* Matched by WURRDC_WUS_METRIC groups */
+static uint16_t wus_metric = 0xffff;
+
+/* Epoch suppression, see wurrdc_wus_epoch_open() */
+static const linkaddr_t *wus_epoch_keep;
+static void (*wus_epoch_skipped)(const linkaddr_t *sender, uint16_t epoch);
+static uint16_t wus_epoch;
+static uint8_t wus_epoch_valid;
+/* Last skipped frames (sender, MAC seqno): a WuS sent again for the same
+ * frame is reported to the skipped callback once */
+#define WUS_SKIP_HISTORY 4
+static struct {
+  uint8_t addr[WURRDC_WUS_ADDR_LEN];
+  uint8_t seqno;
+} wus_skip_seen[WUS_SKIP_HISTORY];
+static uint8_t wus_skip_next;
+
+#if WURRDC_WUS_CCA
+/* End of the exchange announced by the last WuS heard; stale after
+ * WUS_BUSY_MAX_AGE as rtimer_clock_t wraps */
+static rtimer_clock_t wus_busy_until;
+static clock_time_t wus_busy_set;
+#define WUS_BUSY_MAX_AGE (CLOCK_SECOND / 2)
+#endif
+
+/* WuS pulse and the guard before the data frame, in rtimer ticks (the
+ * former clock_delay(100) and clock_delay(1000) on sky). The pulse lasts
+ * at least the WuS airtime, preamble included, so the WuR TX energest
+ * class counts the whole transmission and the data frame never starts
+ * before the receiver got the WuS. */
+#define WUS_PULSE_TIME (RTIMER_SECOND / 3500)
+#define WUS_AIRTIME(bytes)                                              \
+  ((rtimer_clock_t)((((uint32_t)WURRDC_WUS_PREAMBLE + (uint32_t)(bytes) * 8) * \
+                     RTIMER_SECOND + WURRDC_WUS_BITRATE - 1) / WURRDC_WUS_BITRATE))
+#define WUS_GUARD_TIME (RTIMER_SECOND / 350)
+/* After ACK_WAIT_TIME: time to get the ACK into the RX FIFO */
+#define ACK_RX_TIME (RTIMER_SECOND / 3500)
+/* Never schedule the rtimer closer than this to now */
+#define RT_MIN_AHEAD 2
+
+/* One rtimer serves the RX listen window and the TX state machine (the
+ * rtimer library keeps a single pending timer). Its callback only polls
+ * the process that owns the deadline; radio and packetbuf stay in process
+ * context. */
+static struct rtimer rt;
+static volatile uint8_t rt_pending;
+static volatile rtimer_clock_t rt_at;
+/* rt_expired() runs in the rtimer interrupt and clears rt_pending */
+#ifdef __MSP430__
+#define RT_LOCK() spl_t rt_spl = splhigh()
+#define RT_UNLOCK() splx(rt_spl)
+#else
+#define RT_LOCK()
+#define RT_UNLOCK()
+#endif
+
+/* Listen window after a WuS, frames received in it may close it early */
+static volatile rtimer_clock_t rx_window_deadline;
+static volatile uint8_t rx_armed;
+/* 1 while the radio is kept on after a WuS */
+static uint8_t rx_window_open;
+
+#if WURRDC_ADAPTIVE
+/* 1 while the main radio is kept on (off() does nothing) */
+static uint8_t always_on;
+static uint8_t announce_pending;
+static clock_time_t mode_since;
+static clock_time_t announce_last;
+static clock_time_t stats_last;
+static struct ctimer adaptive_timer;
+static struct wurrdc_mode_stats mode_stats;
+
+/* Arrival rate per neighbor: EWMA of the inter-arrival time in 1/8 clock
+ * ticks, 0 for a free entry */
+struct rate_nbr {
+  linkaddr_t addr;
+  clock_time_t last;
+  uint16_t ival8;
+};
+static struct rate_nbr rate_nbrs[WURRDC_ADAPTIVE_NEIGHBORS];
+/* Neighbors that announced their main radio is on, by node id */
+struct awake_nbr {
+  uint16_t id;
+  clock_time_t set;
+};
+static struct awake_nbr awake_nbrs[WURRDC_ADAPTIVE_NEIGHBORS];
+/* Inter-arrival times above this are idle gaps, in clock ticks */
+#define ADAPTIVE_IDLE (8 * CLOCK_SECOND)
+#define ADAPTIVE_AWAKE_MAX_AGE (3 * WURRDC_ADAPTIVE_ANNOUNCE)
+#endif /* WURRDC_ADAPTIVE */
+
+/* Frame list being sent by wur_tx_process */
+static volatile rtimer_clock_t tx_deadline;
+static volatile uint8_t tx_armed;
+static uint8_t tx_busy;
+static uint8_t tx_awake; /* receiver still on from the previous frame, no WuS */
+#if WURRDC_ADAPTIVE
+static uint8_t tx_nbr_awake; /* no WuS either: the receiver announced it is on */
+#endif
+static mac_callback_t tx_sent;
+static void *tx_ptr;
+static struct rdc_buf_list *tx_list;
+static struct rdc_buf_list tx_single; /* send_packet(): packetbuf in a queuebuf */
+#if WURRDC_802154_AUTOACK
+static uint8_t tx_dsn;
+static uint8_t tx_ack_wait; /* packet_input() reports our ACK in tx_ack_seen */
+static uint8_t tx_ack_seen;
+#endif
+
+PROCESS(wur_process, "wur event handler process");
+PROCESS(wur_tx_process, "wur tx process");
 
 /*---------------------------------------------------------------------------*/
 static void on(void) { NETSTACK_RADIO.on(); }
 /*---------------------------------------------------------------------------*/
+#if WURRDC_ADAPTIVE
+static void off(void) { if(!always_on) NETSTACK_RADIO.off(); }
+#else
 static void off(void) { NETSTACK_RADIO.off(); }
+#endif
 /*---------------------------------------------------------------------------*/
+static void rt_expired(struct rtimer *t, void *ptr);
 
-static int
-send_one_packet(mac_callback_t sent, void *ptr)
+static void
+rt_schedule(void)
 {
-  int ret;
-  int last_sent_ok = 0;
-
-  /* Fill WuS TX buffer without aliasing tricks */
-  const linkaddr_t *dst = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
-  memcpy(WUR_TX_BUFFER, dst->u8, LINKADDR_SIZE);
-  WUR_TX_LENGTH = LINKADDR_SIZE;
+  rtimer_clock_t t;
+  rtimer_clock_t now;
+  RT_LOCK();
 
-  /* Friendly log for WuS target */
-  WUR_LOG("WuS TX: sending wake-up signal to ");
-  addr_print((const linkaddr_t *)&WUR_TX_BUFFER);
-  WUR_LOG("\n");
-
-  /* Send the wake-up trigger (GPIO pulse) */
-  wur_set_tx();
-  clock_delay(100);
-  wur_clear_tx();
-  clock_delay(1000);
+  if(!rx_armed && !tx_armed) {
+    RT_UNLOCK();
+    return;
+  }
+  if(rx_armed && (!tx_armed || RTIMER_CLOCK_LT(rx_window_deadline, tx_deadline))) {
+    t = rx_window_deadline;
+  } else {
+    t = tx_deadline;
+  }
+  now = RTIMER_NOW();
+  if(RTIMER_CLOCK_LT(t, now + RT_MIN_AHEAD)) {
+    t = now + RT_MIN_AHEAD;
+  }
 
-  WUR_LOG("Main radio: ON (preparing data TX)\n");
-  on(); /* turn on the radio to send the data packet */
+  /* A pending rtimer set again earlier is rescheduled by rtimer_set().
+   * Firing early is harmless: rt_expired() re-checks the deadlines. */
+  if(!rt_pending || RTIMER_CLOCK_LT(t, rt_at)) {
+    rt_pending = 1;
+    rt_at = t;
+    rtimer_set(&rt, t, 1, rt_expired, NULL);
+  }
+  RT_UNLOCK();
+}
+/*---------------------------------------------------------------------------*/
+static void
+rt_expired(struct rtimer *t, void *ptr)
+{
+  rtimer_clock_t now = RTIMER_NOW();
 
-  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+  rt_pending = 0;
+  if(rx_armed && !RTIMER_CLOCK_LT(now, rx_window_deadline)) {
+    rx_armed = 0;
+    process_poll(&wur_process);
+  }
+  if(tx_armed && !RTIMER_CLOCK_LT(now, tx_deadline)) {
+    tx_armed = 0;
+    process_poll(&wur_tx_process);
+  }
+  rt_schedule();
+}
+/*---------------------------------------------------------------------------*/
+static void
+rx_window_set(rtimer_clock_t len)
+{
+  rx_window_open = 1;
+  rx_window_deadline = RTIMER_NOW() + len;
+  rx_armed = 1;
+  rt_schedule();
+}
+/*---------------------------------------------------------------------------*/
+static rtimer_clock_t
+rx_window_length(void)
+{
+  uint8_t hint;
 
-#if WURRDC_802154_AUTOACK || WURRDC_802154_AUTOACK_HW
-  packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
-#endif
+  if(WUR_RX_LENGTH < WUS_LEN) {
+    return RX_WINDOW_DEFAULT;
+  }
+  hint = WUR_RX_BUFFER[WURRDC_WUS_ADDR_LEN];
+  return WURRDC_RX_GUARD + AIRTIME(PHY_OVERHEAD + (hint & WUS_HINT_LEN_MASK)) +
+         ((hint & WUS_HINT_ACK) ? ACK_TIME : 0);
+}
+/*---------------------------------------------------------------------------*/
+void
+wurrdc_set_wus_target(uint8_t mode, uint16_t arg0, uint16_t arg1)
+{
+  mode |= packetbuf_attr(PACKETBUF_ATTR_WUS_MODE) & WURRDC_WUS_TAGGED;
+  packetbuf_set_attr(PACKETBUF_ATTR_WUS_MODE, mode);
+  packetbuf_set_attr(PACKETBUF_ATTR_WUS_ARG0, arg0);
+  packetbuf_set_attr(PACKETBUF_ATTR_WUS_ARG1, arg1);
+}
+/*---------------------------------------------------------------------------*/
+void
+wurrdc_set_wus_metric(uint16_t metric)
+{
+  wus_metric = metric;
+}
+/*---------------------------------------------------------------------------*/
+void
+wurrdc_set_wus_epoch_tag(uint16_t epoch)
+{
+  packetbuf_set_attr(PACKETBUF_ATTR_WUS_MODE,
+                     packetbuf_attr(PACKETBUF_ATTR_WUS_MODE) | WURRDC_WUS_TAGGED);
+  packetbuf_set_attr(PACKETBUF_ATTR_WUS_EPOCH, epoch);
+}
+/*---------------------------------------------------------------------------*/
+void
+wurrdc_wus_epoch_open(const linkaddr_t *keep,
+                      void (*skipped)(const linkaddr_t *sender, uint16_t epoch))
+{
+  wus_epoch_keep = keep;
+  wus_epoch_skipped = skipped;
+}
+/*---------------------------------------------------------------------------*/
+void
+wurrdc_set_wus_epoch(uint16_t epoch)
+{
+  wus_epoch = epoch;
+  wus_epoch_valid = 1;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+addr_id(const linkaddr_t *a)
+{
+  return a->u8[0] | ((uint16_t)a->u8[1] << 8);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+wus_node_id(void)
+{
+  return addr_id(&linkaddr_node_addr);
+}
+/*---------------------------------------------------------------------------*/
+/* Is the WuS address field at buf the (truncated) address a? */
+static int
+wus_addr_is(const uint8_t *buf, const linkaddr_t *a)
+{
+  return memcmp(buf, a->u8, WURRDC_WUS_ADDR_LEN) == 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Does the received WuS address this node? */
+static int
+wus_match(void)
+{
+  uint16_t arg0, arg1, id;
 
-  if (NETSTACK_FRAMER.create() < 0)
+  if (WUR_RX_LENGTH < WURRDC_WUS_ADDR_LEN)
   {
-    /* Failed to allocate space for headers */
-    PRINTF("wurrdc: send failed, too large header\n");
-    ret = MAC_TX_ERR_FATAL;
+    return 0;
   }
-  else
+  if (wus_addr_is(WUR_RX_BUFFER, &linkaddr_node_addr))
   {
-#if WURRDC_802154_AUTOACK
-    int is_broadcast;
-    uint8_t dsn = ((uint8_t *)packetbuf_hdrptr())[2] & 0xff;
-
-    NETSTACK_RADIO.prepare(packetbuf_hdrptr(), packetbuf_totlen());
-    is_broadcast = packetbuf_holds_broadcast();
+    return 1; /* unicast WuS */
+  }
+  if (!wus_addr_is(WUR_RX_BUFFER, &linkaddr_null))
+  {
+    return 0;
+  }
+  if (WUR_RX_LENGTH < WUS_GROUP_LEN)
+  {
+    return 1; /* broadcast WuS */
+  }
 
-    if (NETSTACK_RADIO.receiving_packet() ||
-        (!is_broadcast && NETSTACK_RADIO.pending_packet()))
+  arg0 = WUR_RX_BUFFER[WUS_LEN + 1] | ((uint16_t)WUR_RX_BUFFER[WUS_LEN + 2] << 8);
+  arg1 = WUR_RX_BUFFER[WUS_LEN + 3] | ((uint16_t)WUR_RX_BUFFER[WUS_LEN + 4] << 8);
+  id = wus_node_id();
+  switch (WUR_RX_BUFFER[WUS_LEN] & ~WURRDC_WUS_TAGGED)
+  {
+  case WURRDC_WUS_PREFIX:
+    return (id & arg1) == (arg0 & arg1);
+  case WURRDC_WUS_METRIC:
+    return wus_metric >= arg0 && wus_metric <= arg1;
+  case WURRDC_WUS_BITMAP:
+    if (id < 1 || id > 32)
     {
-      /* Currently receiving a packet over air or a packet is pending. */
-      ret = MAC_TX_COLLISION;
-      off();
+      return 0;
     }
-    else
-    {
-      if (!is_broadcast)
-      {
-        RIMESTATS_ADD(reliabletx);
-      }
-
-      switch (NETSTACK_RADIO.transmit(packetbuf_totlen()))
-      {
-      case RADIO_TX_OK:
-        if (is_broadcast)
-        {
-          off();
-          ret = MAC_TX_OK;
-        }
-        else
-        {
-          rtimer_clock_t wt;
-
-          /* Wait a short while for ACK energy to appear */
-          wt = RTIMER_NOW();
-          watchdog_periodic();
-          while (RTIMER_CLOCK_LT(RTIMER_NOW(), wt + ACK_WAIT_TIME))
-          {
-#if CONTIKI_TARGET_COOJA
-            simProcessRunValue = 1;
-            cooja_mt_yield();
-#endif
-          }
+    id--;
+    return id < 16 ? (arg0 >> id) & 1 : (arg1 >> (id - 16)) & 1;
+  default:
+    return 1; /* no or unknown group: wake, the frame address filter decides */
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Was the frame of the received tagged WuS already skipped? Records it if not */
+static int
+wus_skip_seen_before(void)
+{
+  const uint8_t *addr = &WUR_RX_BUFFER[WUS_GROUP_LEN + 2];
+  uint8_t seqno = WUR_RX_BUFFER[WUS_TAGGED_SEQNO];
+  uint8_t i;
 
-          clock_delay(100); /* (~283us) seems sufficient to RX ACK */
-          off();
-          ret = MAC_TX_NOACK;
+  for(i = 0; i < WUS_SKIP_HISTORY; i++)
+  {
+    if (wus_skip_seen[i].seqno == seqno &&
+        memcmp(wus_skip_seen[i].addr, addr, WURRDC_WUS_ADDR_LEN) == 0)
+    {
+      return 1;
+    }
+  }
+  memcpy(wus_skip_seen[wus_skip_next].addr, addr, WURRDC_WUS_ADDR_LEN);
+  wus_skip_seen[wus_skip_next].seqno = seqno;
+  wus_skip_next = (wus_skip_next + 1) % WUS_SKIP_HISTORY;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Is the received WuS tagged with an epoch this node has processed? */
+static int
+wus_epoch_skip(void)
+{
+  uint16_t epoch;
+  static linkaddr_t sender;
 
-          if (!is_broadcast && (NETSTACK_RADIO.receiving_packet() ||
-                                NETSTACK_RADIO.pending_packet() ||
-                                NETSTACK_RADIO.channel_clear() == 0))
-          {
-            int len;
-            uint8_t ackbuf[ACK_LEN];
+  if (!wus_epoch_valid || WUR_RX_LENGTH < WUS_TAGGED_LEN ||
+      !(WUR_RX_BUFFER[WUS_LEN] & WURRDC_WUS_TAGGED))
+  {
+    return 0;
+  }
+  epoch = WUR_RX_BUFFER[WUS_GROUP_LEN] | ((uint16_t)WUR_RX_BUFFER[WUS_GROUP_LEN + 1] << 8);
+  if ((int16_t)(epoch - wus_epoch) > 0 ||
+      (wus_epoch_keep != NULL &&
+       wus_addr_is(&WUR_RX_BUFFER[WUS_GROUP_LEN + 2], wus_epoch_keep)))
+  {
+    return 0;
+  }
+  if (wus_epoch_skipped != NULL && !wus_skip_seen_before())
+  {
+    linkaddr_copy(&sender, &linkaddr_null);
+    memcpy(sender.u8, &WUR_RX_BUFFER[WUS_GROUP_LEN + 2], WURRDC_WUS_ADDR_LEN);
+    wus_epoch_skipped(&sender, epoch);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+#if WURRDC_WUS_CCA
+/* Rtimer ticks until the wake-up channel is free, 0 if it is */
+static rtimer_clock_t
+wus_channel_busy(void)
+{
+  rtimer_clock_t now = RTIMER_NOW();
 
-            if (AFTER_ACK_DETECTED_WAIT_TIME > 0)
-            {
-              wt = RTIMER_NOW();
-              watchdog_periodic();
-              while (RTIMER_CLOCK_LT(RTIMER_NOW(), wt + AFTER_ACK_DETECTED_WAIT_TIME))
-              {
-#if CONTIKI_TARGET_COOJA
-                simProcessRunValue = 1;
-                cooja_mt_yield();
-#endif
-              }
-            }
+  if ((clock_time_t)(clock_time() - wus_busy_set) > WUS_BUSY_MAX_AGE ||
+      !RTIMER_CLOCK_LT(now, wus_busy_until))
+  {
+    return 0;
+  }
+  return wus_busy_until - now;
+}
+#endif /* WURRDC_WUS_CCA */
+/*---------------------------------------------------------------------------*/
+#if WURRDC_ADAPTIVE
+/* A unicast frame for us from this neighbor */
+static void
+adaptive_arrival(const linkaddr_t *from)
+{
+  struct rate_nbr *n, *oldest = &rate_nbrs[0];
+  clock_time_t now = clock_time();
+  clock_time_t d;
 
-            if (NETSTACK_RADIO.pending_packet())
-            {
-              len = NETSTACK_RADIO.read(ackbuf, ACK_LEN);
-              if (len == ACK_LEN && ackbuf[2] == dsn)
-              {
-                /* Ack received */
-                RIMESTATS_ADD(ackrx);
-                ret = MAC_TX_OK;
-              }
-              else
-              {
-                /* Not an ack or not for us: collision */
-                ret = MAC_TX_COLLISION;
-              }
-            }
-          }
-          else
-          {
-            PRINTF("wurrdc tx noack\n");
-          }
-        }
-        break;
+  for(n = rate_nbrs; n < &rate_nbrs[WURRDC_ADAPTIVE_NEIGHBORS]; n++) {
+    if(n->ival8 != 0 && linkaddr_cmp(&n->addr, from)) {
+      d = now - n->last;
+      if(d > ADAPTIVE_IDLE) {
+        d = ADAPTIVE_IDLE;
+      }
+      /* Several frames within one tick count as half a tick apart */
+      n->ival8 += ((int16_t)(d != 0 ? d << 3 : 4) - (int16_t)n->ival8) / 4;
+      if(n->ival8 == 0) {
+        n->ival8 = 1;
+      }
+      n->last = now;
+      return;
+    }
+    if(n->ival8 == 0 || (oldest->ival8 != 0 &&
+                         (clock_time_t)(now - n->last) > (clock_time_t)(now - oldest->last))) {
+      oldest = n;
+    }
+  }
+  linkaddr_copy(&oldest->addr, from);
+  oldest->last = now;
+  oldest->ival8 = ADAPTIVE_IDLE << 3;
+}
+/*---------------------------------------------------------------------------*/
+/* Frames per second from all neighbors, times 8 */
+static uint16_t
+adaptive_rate8(void)
+{
+  struct rate_nbr *n;
+  clock_time_t now = clock_time();
+  clock_time_t age;
+  uint16_t ival8;
+  uint16_t rate8 = 0;
 
-      case RADIO_TX_COLLISION:
-        ret = MAC_TX_COLLISION;
-        off();
-        break;
+  for(n = rate_nbrs; n < &rate_nbrs[WURRDC_ADAPTIVE_NEIGHBORS]; n++) {
+    if(n->ival8 == 0) {
+      continue;
+    }
+    age = now - n->last;
+    if(age > ADAPTIVE_IDLE) {
+      n->ival8 = 0; /* quiet neighbor, free the entry */
+      continue;
+    }
+    /* A silent neighbor slows down as time passes */
+    ival8 = MAX(n->ival8, (uint16_t)(age << 3));
+    rate8 += (uint32_t)CLOCK_SECOND * 64 / ival8;
+  }
+  return rate8;
+}
+/*---------------------------------------------------------------------------*/
+/* Did the receiver of a unicast frame announce it keeps its radio on? */
+static int
+adaptive_nbr_awake(const linkaddr_t *a)
+{
+  struct awake_nbr *n;
+  uint16_t id = addr_id(a);
 
-      default:
-        ret = MAC_TX_ERR;
-        off();
-        break;
-      }
+  for(n = awake_nbrs; n < &awake_nbrs[WURRDC_ADAPTIVE_NEIGHBORS]; n++) {
+    if(n->id == id && id != 0 &&
+       (clock_time_t)(clock_time() - n->set) < ADAPTIVE_AWAKE_MAX_AGE) {
+      return 1;
     }
-#else /* ! WURRDC_802154_AUTOACK */
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+adaptive_nbr_set_awake(uint16_t id, uint8_t awake)
+{
+  struct awake_nbr *n, *slot = NULL;
+  clock_time_t now = clock_time();
 
-    switch (NETSTACK_RADIO.send(packetbuf_hdrptr(), packetbuf_totlen()))
-    {
-    case RADIO_TX_OK:
-      ret = MAC_TX_OK;
-      break;
-    case RADIO_TX_COLLISION:
-      ret = MAC_TX_COLLISION;
-      break;
-    case RADIO_TX_NOACK:
-      ret = MAC_TX_NOACK;
-      break;
-    default:
-      ret = MAC_TX_ERR;
+  for(n = awake_nbrs; n < &awake_nbrs[WURRDC_ADAPTIVE_NEIGHBORS]; n++) {
+    if(n->id == id) {
+      slot = n;
       break;
     }
+    if(slot == NULL && (n->id == 0 ||
+                        (clock_time_t)(now - n->set) >= ADAPTIVE_AWAKE_MAX_AGE)) {
+      slot = n;
+    }
+  }
+  if(!awake) {
+    if(slot != NULL && slot->id == id) {
+      slot->id = 0;
+    }
+    return;
+  }
+  if(slot != NULL) {
+    slot->id = id;
+    slot->set = now;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Awake announcement heard: note the sender's state, nobody wakes up */
+static int
+wus_awake_announce(void)
+{
+  uint16_t arg0, arg1;
 
-#endif /* ! WURRDC_802154_AUTOACK */
+  if (WUR_RX_LENGTH < WUS_GROUP_LEN ||
+      !wus_addr_is(WUR_RX_BUFFER, &linkaddr_null) ||
+      (WUR_RX_BUFFER[WUS_LEN] & ~WURRDC_WUS_TAGGED) != WUS_AWAKE)
+  {
+    return 0;
+  }
+  arg0 = WUR_RX_BUFFER[WUS_LEN + 1] | ((uint16_t)WUR_RX_BUFFER[WUS_LEN + 2] << 8);
+  arg1 = WUR_RX_BUFFER[WUS_LEN + 3] | ((uint16_t)WUR_RX_BUFFER[WUS_LEN + 4] << 8);
+  WUR_LOG("WuR event: neighbor %u is %s\n", arg1, arg0 ? "awake" : "asleep");
+  adaptive_nbr_set_awake(arg1, arg0 != 0);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+adaptive_switch(uint8_t awake)
+{
+  clock_time_t now = clock_time();
+
+  always_on = awake;
+  mode_since = now;
+  mode_stats.switches++;
+  if (always_on)
+  {
+    on();
+  }
+  else if (!rx_window_open && !tx_busy)
+  {
+    off();
   }
+  /* Tell the neighbors, wur_tx_process sends it when idle */
+  announce_pending = 1;
+  announce_last = now;
+  process_poll(&wur_tx_process);
+  printf("STAT,RDC_MODE,mode=%s,waco_ticks=%lu,awake_ticks=%lu,switches=%u\n",
+         always_on ? "awake" : "waco", mode_stats.waco_ticks,
+         mode_stats.awake_ticks, mode_stats.switches);
+}
+/*---------------------------------------------------------------------------*/
+static void
+adaptive_tick(void *ptr)
+{
+  clock_time_t now = clock_time();
+  uint16_t rate8 = adaptive_rate8();
+  int nfree = queuebuf_numfree();
 
-  if (ret == MAC_TX_OK)
+  if (always_on)
+  {
+    mode_stats.awake_ticks += (clock_time_t)(now - stats_last);
+  }
+  else
   {
-    last_sent_ok = 1;
+    mode_stats.waco_ticks += (clock_time_t)(now - stats_last);
   }
-  mac_call_sent_callback(sent, ptr, ret, 1);
+  stats_last = now;
 
-  return last_sent_ok;
+  if (!always_on &&
+      (rate8 >= WURRDC_ADAPTIVE_ON_RATE * 8 || nfree <= WURRDC_ADAPTIVE_ON_QUEUEBUF))
+  {
+    WUR_LOG("wurrdc: load %u/8 frames/s, %d free buffers: main radio stays on\n",
+            rate8, nfree);
+    adaptive_switch(1);
+  }
+  else if (always_on && rate8 < WURRDC_ADAPTIVE_OFF_RATE * 8 &&
+           nfree > WURRDC_ADAPTIVE_ON_QUEUEBUF &&
+           (clock_time_t)(now - mode_since) >= WURRDC_ADAPTIVE_MIN_AWAKE)
+  {
+    WUR_LOG("wurrdc: load %u/8 frames/s: back to WuS mode\n", rate8);
+    adaptive_switch(0);
+  }
+  else if (always_on &&
+           (clock_time_t)(now - announce_last) >= WURRDC_ADAPTIVE_ANNOUNCE)
+  {
+    announce_pending = 1;
+    announce_last = now;
+    process_poll(&wur_tx_process);
+  }
+  ctimer_set(&adaptive_timer, WURRDC_ADAPTIVE_PERIOD, adaptive_tick, NULL);
+}
+#endif /* WURRDC_ADAPTIVE */
+/*---------------------------------------------------------------------------*/
+void
+wurrdc_get_mode_stats(struct wurrdc_mode_stats *stats)
+{
+#if WURRDC_ADAPTIVE
+  *stats = mode_stats;
+#else
+  memset(stats, 0, sizeof(*stats));
+#endif
+}
+/*---------------------------------------------------------------------------*/
+/* Sleep in wur_tx_process until the rtimer fires, other processes run and
+ * the MCU may enter LPM meanwhile */
+#define TX_WAIT(len)                                              \
+  do {                                                            \
+    tx_deadline = RTIMER_NOW() + (len);                           \
+    tx_armed = 1;                                                 \
+    rt_schedule();                                                \
+    PROCESS_YIELD_UNTIL(ev == PROCESS_EVENT_POLL && !tx_armed);   \
+  } while(0)
+/*---------------------------------------------------------------------------*/
+static void
+tx_start(mac_callback_t sent, void *ptr, struct rdc_buf_list *list)
+{
+  tx_sent = sent;
+  tx_ptr = ptr;
+  tx_list = list;
+  tx_awake = 0;
+  tx_busy = 1;
+  process_poll(&wur_tx_process);
 }
 /*---------------------------------------------------------------------------*/
 static void
 send_packet(mac_callback_t sent, void *ptr)
 {
-  send_one_packet(sent, ptr);
+  if(tx_busy)
+  {
+    mac_call_sent_callback(sent, ptr, MAC_TX_COLLISION, 1);
+    return;
+  }
+  /* packetbuf is not ours across the TX steps */
+  tx_single.buf = queuebuf_new_from_packetbuf();
+  tx_single.next = NULL;
+  if(tx_single.buf == NULL)
+  {
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
+    return;
+  }
+  tx_start(sent, ptr, &tx_single);
 }
 /*---------------------------------------------------------------------------*/
 static void
 send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 {
-  while (buf_list != NULL)
+  if(tx_busy)
   {
-    /* Backup next pointer; may be cleared by mac_call_sent_callback() */
-    struct rdc_buf_list *next = buf_list->next;
-    int last_sent_ok;
-
+    if(ptr == tx_ptr && tx_list != &tx_single)
+    {
+      /* Same neighbor queue, its head is on the air already: the pending
+       * callback lets the MAC schedule what follows */
+      return;
+    }
+    /* Let the MAC back off; it matches the callback with packetbuf */
     queuebuf_to_packetbuf(buf_list->buf);
-    last_sent_ok = send_one_packet(sent, ptr);
+    mac_call_sent_callback(sent, ptr, MAC_TX_COLLISION, 1);
+    return;
+  }
+  tx_start(sent, ptr, buf_list);
+}
+/*---------------------------------------------------------------------------*/
+#if WURRDC_ADDRESS_FILTER && WURRDC_EARLY_DROP
+/* Is the received frame a unicast data frame for another node? Peeks at
+ * the 802.15.4 header as the radio driver left it in packetbuf: FCF,
+ * sequence number, destination PAN, then the destination address, sent
+ * in reverse byte order. Anything unusual is left to the framer. */
+static int
+frame_for_other(void)
+{
+  const uint8_t *hdr = packetbuf_dataptr();
+  uint8_t alen;
+  uint8_t i;
 
-    /* If TX failed, back off and let upper layers retry to preserve order */
-    if (!last_sent_ok)
+  if (packetbuf_datalen() < 3 ||
+      (hdr[0] & 7) != FRAME802154_DATAFRAME ||
+      ((hdr[1] >> 4) & 3) > FRAME802154_IEEE802154_2006)
+  {
+    return 0;
+  }
+  switch ((hdr[1] >> 2) & 3)
+  {
+  case FRAME802154_SHORTADDRMODE:
+    alen = 2;
+    break;
+  case FRAME802154_LONGADDRMODE:
+    alen = 8;
+    break;
+  default:
+    return 0;
+  }
+  if (alen != LINKADDR_SIZE || packetbuf_datalen() < 5 + alen)
+  {
+    return 0;
+  }
+  hdr += 5;
+  if (alen == 2 && hdr[0] == 0xff && hdr[1] == 0xff)
+  {
+    return 0; /* broadcast */
+  }
+  for (i = 0; i < alen; i++)
+  {
+    if (hdr[i] != linkaddr_node_addr.u8[alen - 1 - i])
     {
-      return;
+      return 1;
     }
-    buf_list = next;
   }
+  return 0;
+}
+#endif /* WURRDC_ADDRESS_FILTER && WURRDC_EARLY_DROP */
+/*---------------------------------------------------------------------------*/
+/* NETSTACK_FRAMER.parse(), timed by the wurrdc_parse probe (sys/prof.h) */
+static int
+framer_parse(void)
+{
+  int hdrlen;
+
+  PROF_ENTER(wurrdc_parse);
+  hdrlen = NETSTACK_FRAMER.parse();
+  PROF_EXIT(wurrdc_parse);
+  return hdrlen;
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -316,16 +965,32 @@ packet_input(void)
   int original_datalen = packetbuf_datalen();
   uint8_t *original_dataptr = packetbuf_dataptr();
 #endif
+  int more = 0;   /* frame of a burst, more frames follow */
+  int for_us = 0; /* unicast for this node or broadcast */
 
 #if WURRDC_802154_AUTOACK
   if (packetbuf_datalen() == ACK_LEN)
   {
-    /* Ignore ack packets */
+    /* Ignore ack packets, unless wur_tx_process waits for this one */
+    if (tx_ack_wait && ((uint8_t *)packetbuf_dataptr())[2] == tx_dsn)
+    {
+      tx_ack_seen = 1;
+    }
     PRINTF("wurrdc: ignored ack\n");
   }
   else
 #endif /* WURRDC_802154_AUTOACK */
-    if (NETSTACK_FRAMER.parse() < 0)
+#if WURRDC_ADDRESS_FILTER && WURRDC_EARLY_DROP
+  if (frame_for_other())
+  {
+    /* Overheard unicast: no parse, no duplicate check, radio off below
+     * unless the frame our WuS announced may still come */
+    RIMESTATS_ADD(earlydrop);
+    PRINTF("wurrdc: early drop, not for us\n");
+  }
+  else
+#endif /* WURRDC_ADDRESS_FILTER && WURRDC_EARLY_DROP */
+    if (framer_parse() < 0)
     {
       PRINTF("wurrdc: failed to parse %u\n", packetbuf_datalen());
 #if WURRDC_ADDRESS_FILTER
@@ -343,6 +1008,22 @@ packet_input(void)
       int payload_len = packetbuf_datalen();
       int deliver_frame = 1;
 
+      for_us = 1;
+#if WURRDC_ADAPTIVE
+      if (!packetbuf_holds_broadcast())
+      {
+        adaptive_arrival(packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      }
+#endif
+#if WURRDC_BURST
+      if(rx_window_open && packetbuf_attr(PACKETBUF_ATTR_PENDING))
+      {
+        /* Keep the radio on, the next frame follows without WuS */
+        more = 1;
+        rx_window_set(WURRDC_BURST_WINDOW);
+      }
+#endif
+
       if(payload_len <= 0)
       {
         PRINTF("wurrdc: drop frame, payload_len=%d\n", payload_len);
@@ -379,11 +1060,17 @@ packet_input(void)
       }
 #endif /* WURRDC_SEND_802154_ACK */
 
-      /* WUR optimisation: early OFF for unicast-to-this-node (with clear log) */
-      if (linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &linkaddr_node_addr))
+      /* WUR optimisation: the frame the WuS announced is in, close the
+       * window before the upper layers run */
+      if (!more)
       {
-        WUR_LOG("Main radio: OFF (unicast for this node — turning off early)\n");
+        WUR_LOG("Main radio: OFF (frame for this node — turning off early)\n");
         off();
+        if (rx_window_open)
+        {
+          rx_window_open = 0;
+          process_poll(&wur_process); /* back to waiting for a WuS */
+        }
       }
 
       if (!duplicate && deliver_frame)
@@ -393,13 +1080,21 @@ packet_input(void)
     }
 
   /* Post-RX radio off (friendly log) — idempotent if already OFF */
+  if (more)
+  {
+    WUR_LOG("Main radio: ON (burst, more frames pending)\n");
+    return;
+  }
+  if (!for_us && rx_window_open)
+  {
+    /* Someone else's frame: ours may still come, wur_process ends the window */
+    return;
+  }
   WUR_LOG("Main radio: OFF (after RX processing)\n");
   off();
 }
 /*---------------------------------------------------------------------------*/
 
-PROCESS(wur_process, "wur event handler process");
-
 static void
 init(void)
 {
@@ -407,7 +1102,12 @@ init(void)
   wur_init();
 
   process_start(&wur_process, NULL);
+  process_start(&wur_tx_process, NULL);
   on();
+#if WURRDC_ADAPTIVE
+  stats_last = clock_time();
+  ctimer_set(&adaptive_timer, WURRDC_ADAPTIVE_PERIOD, adaptive_tick, NULL);
+#endif
 }
 /*---------------------------------------------------------------------------*/
 static int turn_on(void) { return NETSTACK_RADIO.on(); }
@@ -441,21 +1141,392 @@ PROCESS_THREAD(wur_process, ev, data)
   {
     PROCESS_WAIT_EVENT_UNTIL(ev == sensors_event && data == &wur_sensor);
 
-    if ((WUR_RX_LENGTH == LINKADDR_SIZE) &&
-        (linkaddr_cmp((linkaddr_t *)&WUR_RX_BUFFER, &linkaddr_null) || /* broadcast WuS */
-         linkaddr_cmp((linkaddr_t *)&WUR_RX_BUFFER, &linkaddr_node_addr)))
-    { /* unicast WuS */
+#if WURRDC_WUS_CCA
+    /* Any WuS heard marks the channel busy for the exchange it announces */
+    wus_busy_until = RTIMER_NOW() + rx_window_length();
+    wus_busy_set = clock_time();
+#endif
+
+#if WURRDC_ADAPTIVE
+    if (wus_awake_announce())
+    {
+      continue;
+    }
+#endif
+
+    if (wus_match() && wus_epoch_skip())
+    {
+      WUR_LOG("WuR event: WuS for an epoch already processed, staying off\n");
+      RIMESTATS_ADD(wusskip);
+    }
+    else if (wus_match())
+    { /* unicast, broadcast or group WuS for this node */
+      RIMESTATS_ADD(wusrx);
       WUR_LOG("WuR event: received WuS for ");
-      addr_print((linkaddr_t *)&WUR_RX_BUFFER);
+      wus_addr_print(WUR_RX_BUFFER);
       WUR_LOG("\n");
 
       WUR_LOG("Main radio: ON (waiting for data after WuS)\n");
-      on();                  /* turn on the radio on the receiver side */
-      etimer_set(&timer, 3); /* timeout for the reception of data packet (keep original) */
-      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&timer));
-      WUR_LOG("Main radio: OFF (WuS data window elapsed)\n");
-      off(); /* turn off radio after reception */
+      on(); /* turn on the radio on the receiver side */
+      /* Sized from the hint: guard + frame airtime (+ ACK) */
+      rx_window_set(rx_window_length());
+      while (1)
+      {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+        if (!rx_window_open)
+        {
+          /* packet_input() already got the frame and turned the radio off */
+          break;
+        }
+        if (RTIMER_CLOCK_LT(RTIMER_NOW(), rx_window_deadline))
+        {
+          /* Extended by a burst frame meanwhile */
+          continue;
+        }
+        if (NETSTACK_RADIO.receiving_packet())
+        {
+          /* A frame started at the edge of the window: let it complete */
+          rx_window_set(AIRTIME(PHY_OVERHEAD + PHY_MAX_LEN));
+          continue;
+        }
+        break;
+      }
+      if (rx_window_open)
+      {
+        rx_window_open = 0;
+        WUR_LOG("Main radio: OFF (WuS data window elapsed)\n");
+        off(); /* turn off radio after reception */
+      }
+    }
+  }
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+/* Sends tx_list: WuS, guard, data frame, ACK wait. Every wait sleeps on the
+ * shared rtimer; the result of each frame goes to mac_call_sent_callback(). */
+PROCESS_THREAD(wur_tx_process, ev, data)
+{
+  static int ret;
+#if WURRDC_802154_AUTOACK
+  static int status;
+#endif
+  static uint8_t is_broadcast;
+  static uint16_t len;
+  static struct rdc_buf_list *next;
+  static uint8_t wus_deferred;
+#if WURRDC_WUS_CCA
+  static uint8_t be;
+  static uint8_t backoffs;
+#endif
+
+  PROCESS_BEGIN();
+
+  while (1)
+  {
+#if WURRDC_ADAPTIVE
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL && (tx_busy || announce_pending));
+
+    if (!tx_busy)
+    {
+      /* Awake announcement: a group WuS with no frame behind it */
+      tx_busy = 1;
+      announce_pending = 0;
+      memcpy(WUR_TX_BUFFER, linkaddr_null.u8, WURRDC_WUS_ADDR_LEN);
+      WUR_TX_BUFFER[WURRDC_WUS_ADDR_LEN] = 0;
+      WUR_TX_BUFFER[WUS_LEN] = WUS_AWAKE;
+      WUR_TX_BUFFER[WUS_LEN + 1] = always_on;
+      WUR_TX_BUFFER[WUS_LEN + 2] = 0;
+      WUR_TX_BUFFER[WUS_LEN + 3] = linkaddr_node_addr.u8[0];
+      WUR_TX_BUFFER[WUS_LEN + 4] = linkaddr_node_addr.u8[1];
+      WUR_TX_LENGTH = WUS_GROUP_LEN;
+      WUR_LOG("WuS TX: announcing main radio %s\n", always_on ? "on" : "off");
+      RIMESTATS_ADD(wustx);
+      wur_set_tx();
+      TX_WAIT(MAX(WUS_PULSE_TIME, WUS_AIRTIME(WUR_TX_LENGTH)));
+      wur_clear_tx();
+      tx_busy = 0;
+      continue;
     }
+#else
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL && tx_busy);
+#endif
+
+    do
+    {
+      wus_deferred = 0;
+      queuebuf_to_packetbuf(tx_list->buf);
+#if WURRDC_BURST
+      /* The list holds the frames queued for one receiver: only the first
+       * one is preceded by a WuS, the pending bit keeps the receiver on */
+      packetbuf_set_attr(PACKETBUF_ATTR_PENDING, tx_list->next != NULL);
+#endif
+      packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+#if WURRDC_802154_AUTOACK || WURRDC_802154_AUTOACK_HW
+      packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
+#endif
+
+      /* Frame is built before the WuS so that its length can be announced */
+      if (NETSTACK_FRAMER.create() < 0)
+      {
+        /* Failed to allocate space for headers */
+        PRINTF("wurrdc: send failed, too large header\n");
+        ret = MAC_TX_ERR_FATAL;
+      }
+      else
+      {
+        is_broadcast = packetbuf_holds_broadcast();
+        len = packetbuf_totlen();
+#if WURRDC_802154_AUTOACK
+        tx_dsn = ((uint8_t *)packetbuf_hdrptr())[2] & 0xff;
+#endif
+        /* Into the radio TX FIFO now, packetbuf is not ours across waits */
+        NETSTACK_RADIO.prepare(packetbuf_hdrptr(), len);
+
+#if WURRDC_ADAPTIVE
+        tx_nbr_awake = !tx_awake && !is_broadcast &&
+          adaptive_nbr_awake(packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+        if (tx_nbr_awake)
+        {
+          WUR_LOG("WuS TX: skipped (receiver announced its radio is on)\n");
+          RIMESTATS_ADD(wusawake);
+        }
+        else
+#endif
+        if (!tx_awake)
+        {
+          /* Fill WuS TX buffer without aliasing tricks */
+          const linkaddr_t *dst = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+          uint8_t hint = (len + 2) & WUS_HINT_LEN_MASK; /* + FCS */
+
+          if (!is_broadcast && packetbuf_attr(PACKETBUF_ATTR_MAC_ACK))
+          {
+            hint |= WUS_HINT_ACK;
+          }
+          memcpy(WUR_TX_BUFFER, dst->u8, WURRDC_WUS_ADDR_LEN);
+          WUR_TX_BUFFER[WURRDC_WUS_ADDR_LEN] = hint;
+          WUR_TX_LENGTH = WUS_LEN;
+          if (is_broadcast &&
+              packetbuf_attr(PACKETBUF_ATTR_WUS_MODE) != WURRDC_WUS_ADDR)
+          {
+            uint16_t arg0 = packetbuf_attr(PACKETBUF_ATTR_WUS_ARG0);
+            uint16_t arg1 = packetbuf_attr(PACKETBUF_ATTR_WUS_ARG1);
+
+            WUR_TX_BUFFER[WUS_LEN] = packetbuf_attr(PACKETBUF_ATTR_WUS_MODE);
+            WUR_TX_BUFFER[WUS_LEN + 1] = arg0 & 0xff;
+            WUR_TX_BUFFER[WUS_LEN + 2] = arg0 >> 8;
+            WUR_TX_BUFFER[WUS_LEN + 3] = arg1 & 0xff;
+            WUR_TX_BUFFER[WUS_LEN + 4] = arg1 >> 8;
+            WUR_TX_LENGTH = WUS_GROUP_LEN;
+            if (packetbuf_attr(PACKETBUF_ATTR_WUS_MODE) & WURRDC_WUS_TAGGED)
+            {
+              uint16_t epoch = packetbuf_attr(PACKETBUF_ATTR_WUS_EPOCH);
+
+              WUR_TX_BUFFER[WUS_GROUP_LEN] = epoch & 0xff;
+              WUR_TX_BUFFER[WUS_GROUP_LEN + 1] = epoch >> 8;
+              memcpy(&WUR_TX_BUFFER[WUS_GROUP_LEN + 2], linkaddr_node_addr.u8, WURRDC_WUS_ADDR_LEN);
+              WUR_TX_BUFFER[WUS_TAGGED_SEQNO] = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO) & 0xff;
+              WUR_TX_LENGTH = WUS_TAGGED_LEN;
+            }
+          }
+
+          /* Friendly log for WuS target */
+          WUR_LOG("WuS TX: sending wake-up signal to ");
+          wus_addr_print(WUR_TX_BUFFER);
+          WUR_LOG(" (hint 0x%02x)\n", hint);
+
+#if WURRDC_WUS_CCA
+          /* Defer while a neighbor's exchange is on, then back off */
+          for (be = WURRDC_WUS_MIN_BE, backoffs = 0;
+               wus_channel_busy() && backoffs < WURRDC_WUS_MAX_BACKOFFS;
+               backoffs++)
+          {
+            RIMESTATS_ADD(wusbusy);
+            TX_WAIT(wus_channel_busy() +
+                    (random_rand() % (1 << be)) * WURRDC_WUS_BACKOFF_UNIT);
+            if (be < WURRDC_WUS_MAX_BE)
+            {
+              be++;
+            }
+          }
+          wus_deferred = backoffs > 0 && wus_channel_busy();
+          if (wus_deferred)
+          {
+            WUR_LOG("WuS TX: channel busy, giving up\n");
+            RIMESTATS_ADD(wusdrop);
+          }
+          else
+#endif /* WURRDC_WUS_CCA */
+          {
+            /* Send the wake-up trigger (GPIO pulse) */
+            RIMESTATS_ADD(wustx);
+            wur_set_tx();
+            TX_WAIT(MAX(WUS_PULSE_TIME, WUS_AIRTIME(WUR_TX_LENGTH)));
+            wur_clear_tx();
+            TX_WAIT(WUS_GUARD_TIME);
+          }
+        }
+        else
+        {
+          WUR_LOG("WuS TX: skipped (burst, receiver awake)\n");
+        }
+
+        if (wus_deferred)
+        {
+          ret = MAC_TX_COLLISION;
+        }
+        else
+        {
+          WUR_LOG("Main radio: ON (preparing data TX)\n");
+          on(); /* turn on the radio to send the data packet */
+
+#if WURRDC_802154_AUTOACK
+          if (NETSTACK_RADIO.receiving_packet() ||
+              (!is_broadcast && NETSTACK_RADIO.pending_packet()))
+          {
+            /* Currently receiving a packet over air or a packet is pending. */
+            ret = MAC_TX_COLLISION;
+            off();
+          }
+          else
+          {
+            if (!is_broadcast)
+            {
+              RIMESTATS_ADD(reliabletx);
+              tx_ack_seen = 0;
+              tx_ack_wait = 1;
+            }
+
+            /* No switch around the waits: protothreads resume through one */
+            status = NETSTACK_RADIO.transmit(len);
+            if (status == RADIO_TX_OK && is_broadcast)
+            {
+              off();
+              ret = MAC_TX_OK;
+            }
+            else if (status == RADIO_TX_OK)
+            {
+              /* Wait a short while for ACK energy to appear and the ACK to
+               * reach the RX FIFO */
+              PROF_ENTER(wurrdc_ack_wait);
+              TX_WAIT(ACK_WAIT_TIME + ACK_RX_TIME);
+              off();
+              ret = MAC_TX_NOACK;
+
+              if (tx_ack_seen)
+              {
+                /* Already read by the radio driver and passed to packet_input() */
+                RIMESTATS_ADD(ackrx);
+                ret = MAC_TX_OK;
+              }
+              else if (NETSTACK_RADIO.receiving_packet() ||
+                       NETSTACK_RADIO.pending_packet() ||
+                       NETSTACK_RADIO.channel_clear() == 0)
+              {
+                uint8_t ackbuf[ACK_LEN];
+
+                if (AFTER_ACK_DETECTED_WAIT_TIME > 0)
+                {
+                  TX_WAIT(AFTER_ACK_DETECTED_WAIT_TIME);
+                }
+
+                if (tx_ack_seen)
+                {
+                  RIMESTATS_ADD(ackrx);
+                  ret = MAC_TX_OK;
+                }
+                else if (NETSTACK_RADIO.pending_packet())
+                {
+                  if (NETSTACK_RADIO.read(ackbuf, ACK_LEN) == ACK_LEN &&
+                      ackbuf[2] == tx_dsn)
+                  {
+                    /* Ack received */
+                    RIMESTATS_ADD(ackrx);
+                    ret = MAC_TX_OK;
+                  }
+                  else
+                  {
+                    /* Not an ack or not for us: collision */
+                    ret = MAC_TX_COLLISION;
+                  }
+                }
+              }
+              else
+              {
+                PRINTF("wurrdc tx noack\n");
+              }
+              PROF_EXIT(wurrdc_ack_wait);
+            }
+            else if (status == RADIO_TX_COLLISION)
+            {
+              ret = MAC_TX_COLLISION;
+              off();
+            }
+            else
+            {
+              ret = MAC_TX_ERR;
+              off();
+            }
+#if WURRDC_ADAPTIVE
+            if (ret == MAC_TX_NOACK && tx_nbr_awake)
+            {
+              /* Missed its back-to-WuS announcement: wake it next time */
+              adaptive_nbr_set_awake(addr_id(packetbuf_addr(PACKETBUF_ADDR_RECEIVER)), 0);
+            }
+            else
+#endif
+            if (ret == MAC_TX_NOACK && !tx_awake)
+            {
+              /* Receiver never woke up: most likely a WuS collision */
+              RIMESTATS_ADD(wusnoack);
+            }
+            tx_ack_wait = 0;
+          }
+#else /* ! WURRDC_802154_AUTOACK */
+
+          switch (NETSTACK_RADIO.transmit(len))
+          {
+          case RADIO_TX_OK:
+            ret = MAC_TX_OK;
+            break;
+          case RADIO_TX_COLLISION:
+            ret = MAC_TX_COLLISION;
+            break;
+          case RADIO_TX_NOACK:
+            ret = MAC_TX_NOACK;
+            break;
+          default:
+            ret = MAC_TX_ERR;
+            break;
+          }
+
+#endif /* ! WURRDC_802154_AUTOACK */
+        }
+      }
+
+      /* Backup next pointer; may be cleared by mac_call_sent_callback().
+       * The MAC matches the callback with the frame in packetbuf. */
+      next = tx_list->next;
+      queuebuf_to_packetbuf(tx_list->buf);
+      if (tx_list == &tx_single)
+      {
+        queuebuf_free(tx_single.buf);
+        tx_single.buf = NULL;
+      }
+      mac_call_sent_callback(tx_sent, tx_ptr, ret, 1);
+
+      /* If TX failed, back off and let upper layers retry to preserve order */
+      tx_list = next;
+      tx_awake = WURRDC_BURST;
+    } while (ret == MAC_TX_OK && tx_list != NULL);
+
+    tx_busy = 0;
+#if WURRDC_ADAPTIVE
+    if (announce_pending)
+    {
+      process_poll(&wur_tx_process);
+    }
+#endif
   }
+
   PROCESS_END();
 }
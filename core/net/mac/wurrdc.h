@@ -5,6 +5,39 @@
 #include "net/mac/rdc.h"
 #include "dev/radio.h"
 
+/* WuS addressing of a broadcast frame (PACKETBUF_ATTR_WUS_MODE). Unicast
+ * frames always wake their receiver only. Node id: linkaddr u8[0] | u8[1] << 8 */
+#define WURRDC_WUS_ADDR   0 /* broadcast wakes every node (default) */
+#define WURRDC_WUS_PREFIX 1 /* (id & arg1) == (arg0 & arg1) */
+#define WURRDC_WUS_METRIC 2 /* arg0 <= metric <= arg1, see wurrdc_set_wus_metric() */
+#define WURRDC_WUS_BITMAP 3 /* ids 1..32: bit (id - 1) of arg1 << 16 | arg0 */
+#define WURRDC_WUS_TAGGED 0x80 /* mode flag: epoch tag, sender and MAC seqno follow */
+
+/* Set the WuS addressing of the frame in packetbuf, after packetbuf_clear() */
+void wurrdc_set_wus_target(uint8_t mode, uint16_t arg0, uint16_t arg1);
+/* Routing metric this node matches WURRDC_WUS_METRIC against (0xffff: none) */
+void wurrdc_set_wus_metric(uint16_t metric);
+
+/* Epoch suppression of broadcast floods: the WuS of a tagged frame carries
+ * the epoch and its sender, and a receiver that already processed that
+ * epoch stays asleep, unless the sender is *keep (read at every WuS). The
+ * skipped callback still reports who sent what, once per frame: a WuS
+ * repeated for a retransmission of the same frame is not reported again. */
+void wurrdc_set_wus_epoch_tag(uint16_t epoch);
+void wurrdc_wus_epoch_open(const linkaddr_t *keep,
+                           void (*skipped)(const linkaddr_t *sender, uint16_t epoch));
+void wurrdc_set_wus_epoch(uint16_t epoch);
+
+/* Dual mode (WURRDC_CONF_ADAPTIVE): clock ticks spent waking on WuS and
+ * with the main radio kept on under load, and the number of switches.
+ * All zero when the dual mode is not compiled in. */
+struct wurrdc_mode_stats {
+  unsigned long waco_ticks;
+  unsigned long awake_ticks;
+  uint16_t switches;
+};
+void wurrdc_get_mode_stats(struct wurrdc_mode_stats *stats);
+
 extern const struct rdc_driver wurrdc_driver;
 
 #endif /* WURRDC_H_ */
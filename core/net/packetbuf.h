@@ -255,6 +255,10 @@ enum {
 #endif /* NETSTACK_CONF_WITH_RIME */
   PACKETBUF_ATTR_PENDING,
   PACKETBUF_ATTR_FRAME_TYPE,
+  PACKETBUF_ATTR_WUS_MODE,
+  PACKETBUF_ATTR_WUS_ARG0,
+  PACKETBUF_ATTR_WUS_ARG1,
+  PACKETBUF_ATTR_WUS_EPOCH,
 #if LLSEC802154_USES_AUX_HEADER
   PACKETBUF_ATTR_SECURITY_LEVEL,
 #endif /* LLSEC802154_USES_AUX_HEADER */
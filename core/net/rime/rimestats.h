@@ -53,6 +53,16 @@ struct rimestats {
     sendingdrop; /* Packet dropped when we were sending a packet */
 
   unsigned long lltx, llrx;
+
+  /* Wake-up channel (wurrdc): WuS sent, WuS that woke us, deferrals after
+     carrier sense, frames dropped after too many deferrals, unicast
+     frames without ACK after a WuS (WuS likely lost in a collision), and
+     WuS ignored for an epoch already processed, and frames sent without
+     WuS to a neighbor that announced its radio is on */
+  unsigned long wustx, wusrx, wusbusy, wusdrop, wusnoack, wusskip, wusawake;
+  /* Unicast frames for other nodes dropped from the raw header, before
+     the framer (wurrdc) */
+  unsigned long earlydrop;
 };
 
 #if RIMESTATS_CONF_ENABLED
@@ -64,6 +64,10 @@ enum energest_type {
 
   ENERGEST_TYPE_SERIAL,
 
+  /* Wake-up radio: always-on receiver, wake-up signal transmitter */
+  ENERGEST_TYPE_WUR_RX,
+  ENERGEST_TYPE_WUR_TX,
+
   ENERGEST_TYPE_MAX
 };
 
@@ -0,0 +1,100 @@
+/**
+ * \file
+ *         Hot-path profiler: per-probe min/avg/max tables, see prof.h
+ */
+
+#include "contiki.h"
+#include "sys/prof.h"
+
+#if PROF_CONF_ON
+
+#include "dev/serial-line.h"
+#include <stdio.h>
+#include <string.h>
+
+static struct prof_probe *probes;
+
+PROCESS(prof_process, "Profiler");
+/*---------------------------------------------------------------------------*/
+void
+prof_record(struct prof_probe *p, rtimer_clock_t ticks)
+{
+  if(p->count == 0) {
+    /* First hit since boot or the last reset */
+    p->next = probes;
+    probes = p;
+    p->min = ticks;
+    p->max = ticks;
+  } else if(ticks < p->min) {
+    p->min = ticks;
+  } else if(ticks > p->max) {
+    p->max = ticks;
+  }
+  p->count++;
+  p->total += ticks;
+}
+/*---------------------------------------------------------------------------*/
+void
+prof_dump(void)
+{
+  struct prof_probe *p;
+
+  for(p = probes; p != NULL; p = p->next) {
+    printf("STAT,PROF,name=%s,count=%lu,min=%u,avg=%lu,max=%u,total=%lu\n",
+           p->name, p->count, (unsigned)p->min, p->total / p->count,
+           (unsigned)p->max, p->total);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+prof_reset(void)
+{
+  struct prof_probe *p;
+
+  for(p = probes; p != NULL; p = p->next) {
+    p->count = 0;
+    p->total = 0;
+  }
+  probes = NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+prof_init(void)
+{
+  process_start(&prof_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(prof_process, ev, data)
+{
+#if PROF_CONF_DUMP_PERIOD
+  static struct etimer et;
+#endif
+
+  PROCESS_BEGIN();
+
+#if PROF_CONF_DUMP_PERIOD
+  etimer_set(&et, PROF_CONF_DUMP_PERIOD);
+#endif
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+#if PROF_CONF_DUMP_PERIOD
+    if(ev == PROCESS_EVENT_TIMER && data == &et) {
+      prof_dump();
+      etimer_reset(&et);
+    }
+#endif
+    if(ev == serial_line_event_message && data != NULL) {
+      if(strcmp(data, "prof") == 0) {
+        prof_dump();
+      } else if(strcmp(data, "prof reset") == 0) {
+        prof_dump();
+        prof_reset();
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+#endif /* PROF_CONF_ON */
@@ -0,0 +1,70 @@
+#ifndef PROF_H_
+#define PROF_H_
+
+#include "sys/rtimer.h"
+
+/* Hot-path profiler: a named probe around a code section records how long
+ * each pass took, in rtimer ticks (RTIMER_NOW(), 1/RTIMER_SECOND: ~30.5 us
+ * on sky, so only sections of a few ticks and up are resolved).
+ *
+ *   PROF_ENTER(find_route_graph);
+ *   len = find_route_graph(conn, dest);
+ *   PROF_EXIT(find_route_graph);
+ *
+ * PROF_ENTER declares the probe and its start time as statics, so a pair
+ * may span protothread yields; PROF_EXIT must be in the same block or a
+ * nested one, and every early return in between needs its own PROF_EXIT.
+ * Times are wall-clock: interrupts and nested probes are included.
+ *
+ * prof_dump() prints one line per probe that was hit, in rtimer ticks:
+ *   STAT,PROF,name=<probe>,count=..,min=..,avg=..,max=..,total=..
+ * After prof_init() the tables are also dumped every PROF_CONF_DUMP_PERIOD
+ * (clock ticks, 0: never) and on the serial line commands "prof" (dump)
+ * and "prof reset" (dump, then clear), e.g. from a COOJA test script.
+ *
+ * Off by default: without PROF_CONF_ON every macro and call compiles to
+ * nothing. */
+
+#ifndef PROF_CONF_ON
+#define PROF_CONF_ON 0
+#endif
+
+#ifndef PROF_CONF_DUMP_PERIOD
+#define PROF_CONF_DUMP_PERIOD 0
+#endif
+
+#if PROF_CONF_ON
+
+struct prof_probe {
+  struct prof_probe *next; /* list of probes hit so far */
+  const char *name;
+  rtimer_clock_t start;
+  rtimer_clock_t min;
+  rtimer_clock_t max;
+  unsigned long count;
+  unsigned long total;
+};
+
+#define PROF_ENTER(name)                                        \
+  static struct prof_probe prof_##name = { NULL, #name };       \
+  prof_##name.start = RTIMER_NOW()
+
+#define PROF_EXIT(name)                                         \
+  prof_record(&prof_##name, RTIMER_NOW() - prof_##name.start)
+
+void prof_record(struct prof_probe *p, rtimer_clock_t ticks);
+void prof_init(void);
+void prof_dump(void);
+void prof_reset(void);
+
+#else /* PROF_CONF_ON */
+
+#define PROF_ENTER(name)
+#define PROF_EXIT(name)
+#define prof_init()
+#define prof_dump()
+#define prof_reset()
+
+#endif /* PROF_CONF_ON */
+
+#endif /* PROF_H_ */
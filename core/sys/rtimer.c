@@ -74,6 +74,9 @@ rtimer_set(struct rtimer *rtimer, rtimer_clock_t time,
 
   if(next_rtimer == NULL) {
     first = 1;
+  } else if(next_rtimer == rtimer && RTIMER_CLOCK_LT(time, rtimer->time)) {
+    /* The pending task is pulled in: move the compare with it */
+    first = 1;
   }
 
   rtimer->func = func;
@@ -107,7 +107,8 @@ enum {
  *             (false) if the task could not be scheduled.
  *
  *             This function schedules a real-time task at a specified
- *             time in the future.
+ *             time in the future. Setting the task that is already
+ *             pending again, to an earlier time, reschedules it.
  *
  */
 int rtimer_set(struct rtimer *task, rtimer_clock_t time,
@@ -3,7 +3,7 @@ import re
 import os
 import math
 import argparse
-from typing import List, Dict, Any
+from typing import List, Dict, Any, Optional
 import pandas as pd
 
 re_avg_on = re.compile(r'^AVG\s+ON\s+(\d+)\s+us\s+([0-9]+\.[0-9]+)\s+%')
@@ -17,6 +17,11 @@ re_tx  = re.compile(r'^(\S+)\s+TX\s+(\d+)\s+us\s+([0-9]+\.[0-9]+)\s+%$')
 re_rx  = re.compile(r'^(\S+)\s+RX\s+(\d+)\s+us\s+([0-9]+\.[0-9]+)\s+%$')
 re_int = re.compile(r'^(\S+)\s+INT\s+(\d+)\s+us\s+([0-9]+\.[0-9]+)\s+%$')
 
+# powertrace wake-up radio record in the COOJA log:
+#   <tag> <clock> PW <id>.<id> <seq> <all_wur_rx> <all_wur_tx> <wur_rx> <wur_tx>  (rtimer ticks)
+re_pw = re.compile(r'\bPW\s+(\d+)\.(\d+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\d+)\s*$')
+re_mote_id = re.compile(r'(\d+)$')
+
 def parse_dc_file(path: str) -> Dict[str, Any]:
     avg = { 'on_us': 0, 'tx_us': 0, 'rx_us': 0, 'int_us': 0, 'on_pct': 0.0, 'tx_pct': 0.0, 'rx_pct': 0.0, 'int_pct': 0.0 }
     nodes: Dict[str, Dict[str, Any]] = {}
@@ -60,7 +65,31 @@ def parse_dc_file(path: str) -> Dict[str, Any]:
             d.setdefault(k, 0 if k.endswith('_us') else 0.0)
     return { 'avg': avg, 'nodes': nodes }
 
-def compute_energy(nodes: Dict[str, Dict[str, Any]], vcc: float, i_tx_mA: float, i_rx_mA: float, i_idle_mA: float) -> pd.DataFrame:
+def parse_powertrace_wur(path: str, rtimer_second: int) -> Dict[int, Dict[str, int]]:
+    """Last cumulative WuR RX/TX times per node id from powertrace PW records, in us."""
+    wur: Dict[int, Dict[str, int]] = {}
+    with open(path, 'r', errors='ignore') as f:
+        for line in f:
+            m = re_pw.search(line.strip())
+            if not m:
+                continue
+            node = int(m.group(1)) + 256 * int(m.group(2))
+            wur[node] = {
+                'wur_rx_us': int(m.group(4)) * 1000000 // rtimer_second,
+                'wur_tx_us': int(m.group(5)) * 1000000 // rtimer_second,
+            }
+    return wur
+
+def default_wur_log(dc_path: str) -> Optional[str]:
+    """run_scenario.py stores seed-N.txt next to seed-N_dc.txt."""
+    if not dc_path.endswith('_dc.txt'):
+        return None
+    log = dc_path[:-len('_dc.txt')] + '.txt'
+    return log if os.path.exists(log) else None
+
+def compute_energy(nodes: Dict[str, Dict[str, Any]], vcc: float, i_tx_mA: float, i_rx_mA: float, i_idle_mA: float,
+                   wur: Optional[Dict[int, Dict[str, int]]] = None,
+                   p_wur_rx_uW: float = 0.0, p_wur_tx_uW: float = 0.0) -> pd.DataFrame:
     rows = []
     for mote, d in nodes.items():
         on_us = d['on_us']; tx_us = d['tx_us']; rx_us = d['rx_us']; int_us = d['int_us']; mon_us = d['mon_us']
@@ -77,6 +106,21 @@ def compute_energy(nodes: Dict[str, Dict[str, Any]], vcc: float, i_tx_mA: float,
         e_rx = vcc * (i_rx_mA/1000.0) * ((rx_us + int_us)/1e6)
         e_idle = vcc * (i_idle_mA/1000.0) * (idle_us/1e6)
         e_tot = e_tx + e_rx + e_idle
+        wur_row: Dict[str, Any] = {}
+        if wur:
+            m = re_mote_id.search(mote)
+            w = wur.get(int(m.group(1)), {}) if m else {}
+            wur_rx_us = w.get('wur_rx_us', 0); wur_tx_us = w.get('wur_tx_us', 0)
+            # Joules = P(uW) * 1e-6 * t(s)
+            e_wur_rx = p_wur_rx_uW * 1e-6 * (wur_rx_us/1e6)
+            e_wur_tx = p_wur_tx_uW * 1e-6 * (wur_tx_us/1e6)
+            e_tot += e_wur_rx + e_wur_tx
+            wur_row = {
+                'wur_rx_us': wur_rx_us,
+                'wur_tx_us': wur_tx_us,
+                'E_wur_rx(J)': round(e_wur_rx, 6),
+                'E_wur_tx(J)': round(e_wur_tx, 6),
+            }
         dur_s = mon_us/1e6 if mon_us else 0.0
         p_avg_mW = (e_tot/dur_s*1000.0) if dur_s > 0 else float('nan')
         rows.append({
@@ -90,6 +134,7 @@ def compute_energy(nodes: Dict[str, Dict[str, Any]], vcc: float, i_tx_mA: float,
             'E_tx(J)': round(e_tx, 6),
             'E_rx(J)': round(e_rx, 6),
             'E_idle(J)': round(e_idle, 6),
+            **wur_row,
             'E_total(J)': round(e_tot, 6),
             'P_avg(mW)': round(p_avg_mW, 3) if not math.isnan(p_avg_mW) else float('nan'),
             'RDC(%)': round(rdc_pct, 2) if not math.isnan(rdc_pct) else float('nan'),
@@ -129,11 +174,24 @@ def main():
     ap.add_argument('--i-tx-mA', type=float, default=17.4, help='TX current (mA) CC2420 ~17.4')
     ap.add_argument('--i-rx-mA', type=float, default=18.8, help='RX current (mA) CC2420 ~18.8')
     ap.add_argument('--i-idle-mA', type=float, default=0.426, help='Radio idle current (mA) ~0.426')
+    ap.add_argument('--wur-log', help='COOJA log with powertrace PW records (default: X.txt next to X_dc.txt); '
+                                      'only with a single dc log')
+    ap.add_argument('--p-wur-rx-uW', type=float, default=7.2,
+                    help='Always-on wake-up receiver power (uW), default 7.2 (2.4 uA at 3 V)')
+    ap.add_argument('--p-wur-tx-uW', type=float, default=None,
+                    help='Wake-up signal transmitter power (uW), default vcc * i-tx-mA')
+    ap.add_argument('--rtimer-second', type=int, default=32768, help='RTIMER_SECOND of the motes (sky: 32768)')
     args = ap.parse_args()
+    if args.wur_log and len(args.dc_logs) > 1:
+        ap.error('--wur-log needs a single dc log')
+    p_wur_tx_uW = args.p_wur_tx_uW if args.p_wur_tx_uW is not None else args.vcc * args.i_tx_mA * 1000.0
 
     for path in args.dc_logs:
         parsed = parse_dc_file(path)
-        df_nodes = compute_energy(parsed['nodes'], args.vcc, args.i_tx_mA, args.i_rx_mA, args.i_idle_mA)
+        wur_log = args.wur_log or default_wur_log(path)
+        wur = parse_powertrace_wur(wur_log, args.rtimer_second) if wur_log else None
+        df_nodes = compute_energy(parsed['nodes'], args.vcc, args.i_tx_mA, args.i_rx_mA, args.i_idle_mA,
+                                  wur, args.p_wur_rx_uW, p_wur_tx_uW)
         df_net = summarize_network(df_nodes)
         if args.out_prefix:
             base = args.out_prefix
@@ -1,12 +1,16 @@
 #!/usr/bin/env python3
 import re
 import os
+import sys
 import math
 import argparse
 from collections import defaultdict
+from concurrent.futures import ProcessPoolExecutor
 from typing import List, Dict, Set, Optional
 import pandas as pd
 
+from telemetry_decode import MARK, decode_line
+
 # -------- Legacy PRR (nei=...) --------
 re_prr = re.compile(r'ID:(\d+)\s+PRR:\s+nei=([0-9]{2}:[0-9]{2})\s+prr=(\d+)\s+recv=(\d+)\s+exp=(\d+)\s+tx=(\d+)')
 
@@ -56,174 +60,277 @@ def safe_pct(num: int, den: int) -> float:
         return float('nan')
     return 100.0 * num / den
 
-def parse_files(paths: List[str]):
-    # Legacy nei-based PRR
-    nei_prr_vals: Dict[str, Dict[str, List[float]]] = defaultdict(lambda: defaultdict(list))
-
-    # Last values
-    prr_parent_last: Dict[str, float] = {}
-    prr_sender_last: Dict[str, float] = {}
-    last_parent_addr: Dict[str, str] = {}
-
-    # From CSV PRR lines, gom cho fallback all-nei-avg
-    prr_observed_per_node: Dict[str, List[float]] = defaultdict(list)
-
-    # UL/DL PDR theo seq
-    ul_sends: Dict[str, Set[int]] = defaultdict(set)
-    ul_recv:  Dict[str, Set[int]] = defaultdict(set)
-    dl_sends: Dict[str, Set[int]] = defaultdict(set)
-    dl_recv:  Dict[str, Set[int]] = defaultdict(set)
-    
-    # Unified DL attempt tracking (for fair comparison)
-    dl_attempts: Dict[str, int] = defaultdict(int)  # Total attempts per destination
-    dl_sent: Dict[str, int] = defaultdict(int)      # Total sent (route_ok=1) per destination
-    
-    # Unified UL attempt tracking (for consistent metrics with DL)
-    ul_attempts: Dict[str, int] = defaultdict(int)  # Total attempts per source
-    ul_sent: Dict[str, int] = defaultdict(int)      # Total sent (route_ok=1) per source
+class FloatSum:
+    """Running float sum, equal to the builtin sum() over the same values.
+
+    Python 3.12+ sums floats with Neumaier compensation, older versions add
+    them one by one; the mean of the samples must not depend on keeping them.
+    """
+    __slots__ = ('n', 's', 'c', 'last')
+    NEUMAIER = sys.version_info >= (3, 12)
+
+    def __init__(self):
+        self.n = 0
+        self.s = 0.0
+        self.c = 0.0
+        self.last = math.nan
+
+    def add(self, x: float) -> None:
+        self.n += 1
+        self.last = x
+        if not self.NEUMAIER:
+            self.s += x
+            return
+        t = self.s + x
+        if abs(self.s) >= abs(x):
+            self.c += (self.s - t) + x
+        else:
+            self.c += (x - t) + self.s
+        self.s = t
 
-    # Optional: last PDR_DL% từ CSV PDR
-    csv_pdrdl_last: Dict[str, float] = {}
+    def total(self) -> float:
+        if self.c and math.isfinite(self.c):
+            return self.s + self.c
+        return self.s
 
-    # End-to-end delay samples (ticks)
-    ul_delays: Dict[str, List[int]] = defaultdict(list)
-    dl_delays: Dict[str, List[int]] = defaultdict(list)
+    def mean(self) -> float:
+        return float('nan') if not self.n else self.total() / self.n
 
-    for path in paths:
-        if not os.path.exists(path):
-            print(f"Warning: file not found: {path}")
-            continue
-        with open(path, 'r', errors='ignore') as f:
-            for line in f:
-                # Legacy PRR per neighbor
-                m = re_prr.search(line)
-                if m:
-                    node = id_to_addr(int(m.group(1)))
-                    nei  = m.group(2)
-                    prr  = float(m.group(3))
-                    nei_prr_vals[node][nei].append(prr)
-                    continue
-
-                # STAB/COLLECT prr + parent
-                m = re_stab_prr.search(line)
-                if m:
-                    node = id_to_addr(int(m.group(1)))
-                    prr_parent_last[node] = float(m.group(2))
-                    prr_sender_last[node] = float(m.group(3))
 
-                m = re_stab_parent.search(line)
-                if m:
-                    node = id_to_addr(int(m.group(1)))
-                    last_parent_addr[node] = m.group(2)
+class IntMean:
+    """Count and exact sum of integer samples."""
+    __slots__ = ('n', 's')
 
-                m = re_stab_keep.search(line)
-                if m:
-                    node = id_to_addr(int(m.group(1)))
-                    last_parent_addr[node] = m.group(2)
-                    continue
+    def __init__(self):
+        self.n = 0
+        self.s = 0
 
-                m = re_collect_prr.search(line)
-                if m:
-                    node = id_to_addr(int(m.group(1)))
-                    prr_parent_last[node] = float(m.group(2))
-                    prr_sender_last[node] = float(m.group(3))
+    def add(self, x: int) -> None:
+        self.n += 1
+        self.s += x
+
+    def mean(self) -> float:
+        return float('nan') if not self.n else self.s / self.n
 
-                m = re_collect_parent.search(line)
-                if m:
-                    node = id_to_addr(int(m.group(1)))
-                    last_parent_addr[node] = m.group(2)
 
-                # UL/DL seq
+class SeqSet:
+    """Distinct sequence numbers seen: a bitmap of the 16-bit seq space the
+    motes use (8 KiB), a set only for anything beyond it."""
+    __slots__ = ('bits', 'count', 'big')
+    SPACE = 1 << 16
+
+    def __init__(self):
+        self.bits = bytearray(self.SPACE >> 3)
+        self.count = 0
+        self.big: Optional[Set[int]] = None
+
+    def add(self, seq: int) -> None:
+        if seq < self.SPACE:
+            mask = 1 << (seq & 7)
+            byte = self.bits[seq >> 3]
+            if not byte & mask:
+                self.bits[seq >> 3] = byte | mask
+                self.count += 1
+        else:
+            if self.big is None:
+                self.big = set()
+            if seq not in self.big:
+                self.big.add(seq)
+                self.count += 1
+
+    def __len__(self) -> int:
+        return self.count
+
+
+class LogState:
+    """Per-node counters of one parse, fed line by line.
+
+    Every line is first checked for the literal token each regex needs
+    (case folded like re.IGNORECASE); only lines carrying one run the
+    regex, in the same order and with the same fall-through as before.
+    Memory is bounded by the number of nodes and neighbors, not the log
+    length.
+    """
+
+    def __init__(self):
+        # Legacy nei-based PRR: node -> nei -> samples
+        self.nei_prr: Dict[str, Dict[str, FloatSum]] = defaultdict(dict)
+        # Last values
+        self.prr_parent_last: Dict[str, float] = {}
+        self.prr_sender_last: Dict[str, float] = {}
+        self.last_parent_addr: Dict[str, str] = {}
+        # From CSV PRR lines, gom cho fallback all-nei-avg
+        self.prr_observed: Dict[str, FloatSum] = defaultdict(FloatSum)
+        # UL/DL PDR theo seq
+        self.ul_sends: Dict[str, SeqSet] = defaultdict(SeqSet)
+        self.ul_recv: Dict[str, SeqSet] = defaultdict(SeqSet)
+        self.dl_sends: Dict[str, SeqSet] = defaultdict(SeqSet)
+        self.dl_recv: Dict[str, SeqSet] = defaultdict(SeqSet)
+        # Unified DL/UL attempt tracking (for fair comparison)
+        self.dl_attempts: Dict[str, int] = defaultdict(int)
+        self.dl_sent: Dict[str, int] = defaultdict(int)
+        self.ul_attempts: Dict[str, int] = defaultdict(int)
+        self.ul_sent: Dict[str, int] = defaultdict(int)
+        # Optional: last PDR_DL% từ CSV PDR
+        self.csv_pdrdl_last: Dict[str, float] = {}
+        # End-to-end delay samples (ticks)
+        self.ul_delays: Dict[str, IntMean] = defaultdict(IntMean)
+        self.dl_delays: Dict[str, IntMean] = defaultdict(IntMean)
+
+    def feed_file(self, path: str) -> None:
+        if not os.path.exists(path):
+            print(f"Warning: file not found: {path}")
+            return
+        with open(path, 'r', errors='ignore') as f:
+            feed = self.feed
+            # Binary telemetry (SRDCP_TELEMETRY) is decoded back to the text lines
+            for line in f:
+                if MARK in line:
+                    line = decode_line(line)
+                feed(line)
+
+    def feed(self, line: str) -> None:
+        u = line.upper()
+        csv = 'CSV,' in u
+        stat = 'STAT,' in u
+        app = 'APP-' in u
+
+        # Legacy PRR per neighbor
+        if 'PRR:' in line:
+            m = re_prr.search(line)
+            if m:
+                node = id_to_addr(int(m.group(1)))
+                nei = self.nei_prr[node]
+                acc = nei.get(m.group(2))
+                if acc is None:
+                    acc = nei[m.group(2)] = FloatSum()
+                acc.add(float(m.group(3)))
+                return
+
+        # STAB/COLLECT prr + parent
+        if 'STAB:' in u:
+            m = re_stab_prr.search(line)
+            if m:
+                node = id_to_addr(int(m.group(1)))
+                self.prr_parent_last[node] = float(m.group(2))
+                self.prr_sender_last[node] = float(m.group(3))
+            m = re_stab_parent.search(line)
+            if m:
+                self.last_parent_addr[id_to_addr(int(m.group(1)))] = m.group(2)
+            m = re_stab_keep.search(line)
+            if m:
+                self.last_parent_addr[id_to_addr(int(m.group(1)))] = m.group(2)
+                return
+
+        if 'COLLECT:' in u:
+            m = re_collect_prr.search(line)
+            if m:
+                node = id_to_addr(int(m.group(1)))
+                self.prr_parent_last[node] = float(m.group(2))
+                self.prr_sender_last[node] = float(m.group(3))
+            m = re_collect_parent.search(line)
+            if m:
+                self.last_parent_addr[id_to_addr(int(m.group(1)))] = m.group(2)
+
+        # UL/DL seq
+        if app:
+            if 'APP-UL[' in u:
                 m = re_ul_send.search(line)
                 if m:
-                    node = m.group(1); seq = int(m.group(2))
-                    ul_sends[node].add(seq); continue
+                    self.ul_sends[m.group(1)].add(int(m.group(2)))
+                    return
                 m = re_ul_recv.search(line)
                 if m:
-                    seq = int(m.group(1)); node = m.group(2)
-                    ul_recv[node].add(seq); continue
+                    self.ul_recv[m.group(2)].add(int(m.group(1)))
+                    return
+            if 'APP-DL[' in u:
                 m = re_dl_send.search(line)
                 if m:
-                    seq = int(m.group(1)); node = m.group(2)
-                    dl_sends[node].add(seq); continue
+                    self.dl_sends[m.group(2)].add(int(m.group(1)))
+                    return
                 m = re_dl_recv.search(line)
                 if m:
-                    node = m.group(1); seq = int(m.group(2))
-                    dl_recv[node].add(seq); continue
-                
-                # STAT,DL_ATTEMPT (unified format for both WaCo and RPL)
+                    self.dl_recv[m.group(1)].add(int(m.group(2)))
+                    return
+
+        if stat:
+            # STAT,DL_ATTEMPT / STAT,UL_ATTEMPT (unified format for both WaCo and RPL)
+            if 'STAT,DL_ATTEMPT,' in u:
                 m = re_dl_attempt.search(line)
                 if m:
-                    attempt_seq = int(m.group(1))
                     target = m.group(2)
-                    route_ok = int(m.group(3))
-                    
                     if target != '--:--':
-                        dl_attempts[target] += 1
-                        if route_ok == 1:
-                            dl_sent[target] += 1
-                    continue
-                
-                # STAT,UL_ATTEMPT (unified format for both WaCo and RPL, like DL)
+                        self.dl_attempts[target] += 1
+                        if int(m.group(3)) == 1:
+                            self.dl_sent[target] += 1
+                    return
+            if 'STAT,UL_ATTEMPT,' in u:
                 m = re_ul_attempt.search(line)
                 if m:
-                    source_node = m.group(1)  # source=XX:YY
-                    attempt_seq = int(m.group(2))
-                    route_ok = int(m.group(3))
-                    ul_attempts[source_node] += 1
-                    if route_ok == 1:
-                        ul_sent[source_node] += 1
-                    continue
-
-                # CSV PDR_DL% for reference
+                    source_node = m.group(1)
+                    self.ul_attempts[source_node] += 1
+                    if int(m.group(3)) == 1:
+                        self.ul_sent[source_node] += 1
+                    return
+
+        if csv:
+            # CSV PDR_DL% for reference
+            if 'CSV,PDR_DL,' in u:
                 m = re_csv_pdrdl.search(line)
                 if m:
-                    node = m.group(1)
                     try:
-                        csv_pdrdl_last[node] = float(m.group(2))
-                    except:
+                        self.csv_pdrdl_last[m.group(1)] = float(m.group(2))
+                    except ValueError:
                         pass
-
-                # CSV PRR UL
+            if 'CSV,PRR_' in u:
+                # CSV PRR UL: local is sink, peer is the source node
                 m = re_csv_prr_ul.search(line)
                 if m:
-                    # local is sink, peer is the source node
-                    sink_local = m.group(1)
-                    peer_node  = m.group(2)
-                    pct        = float(m.group(3))
-                    # map to sender quality for that peer
-                    prr_sender_last[peer_node] = pct
-                    prr_observed_per_node[peer_node].append(pct)
-                    continue
-
-                # CSV PRR DL
+                    peer_node = m.group(2)
+                    pct = float(m.group(3))
+                    self.prr_sender_last[peer_node] = pct
+                    self.prr_observed[peer_node].add(pct)
+                    return
+                # CSV PRR DL: local is the node, peer is sink (usually 01:00) or whoever sent
                 m = re_csv_prr_dl.search(line)
                 if m:
-                    # local is the node, peer is sink (usually 01:00) or whoever sent
                     node_local = m.group(1)
-                    peer       = m.group(2)
-                    pct        = float(m.group(3))
-                    prr_parent_last[node_local] = pct
-                    prr_observed_per_node[node_local].append(pct)
-                    continue
+                    pct = float(m.group(3))
+                    self.prr_parent_last[node_local] = pct
+                    self.prr_observed[node_local].add(pct)
+                    return
 
+        if stat:
+            if 'STAT,UL_DELAY,' in u:
                 m = re_stat_ul_delay.search(line)
                 if m:
-                    src_node = m.group(3)
-                    try:
-                        ul_delays[src_node].append(int(m.group(4)))
-                    except ValueError:
-                        pass
-                    continue
-
+                    self.ul_delays[m.group(3)].add(int(m.group(4)))
+                    return
+            if 'STAT,DL_DELAY,' in u:
                 m = re_stat_dl_delay.search(line)
                 if m:
-                    node_local = m.group(1)
-                    try:
-                        dl_delays[node_local].append(int(m.group(3)))
-                    except ValueError:
-                        pass
-                    continue
+                    self.dl_delays[m.group(1)].add(int(m.group(3)))
+                    return
+
+
+def parse_files(paths: List[str]):
+    state = LogState()
+    for path in paths:
+        state.feed_file(path)
+    return build_frames(state)
+
+
+def build_frames(st: LogState):
+    nei_prr_vals = st.nei_prr
+    prr_parent_last = st.prr_parent_last
+    prr_sender_last = st.prr_sender_last
+    last_parent_addr = st.last_parent_addr
+    prr_observed_per_node = st.prr_observed
+    ul_sends, ul_recv, dl_sends, dl_recv = st.ul_sends, st.ul_recv, st.dl_sends, st.dl_recv
+    dl_attempts, dl_sent = st.dl_attempts, st.dl_sent
+    ul_attempts, ul_sent = st.ul_attempts, st.ul_sent
+    csv_pdrdl_last = st.csv_pdrdl_last
+    ul_delays, dl_delays = st.ul_delays, st.dl_delays
 
     # Tập node đầy đủ
     nodes = set(nei_prr_vals.keys()) \
@@ -237,14 +344,14 @@ def parse_files(paths: List[str]):
     for node in sorted(nodes):
         # all-nei-avg ưu tiên legacy PRR: nei=..., nếu không có thì fallback sang trung bình các PRR quan sát được (UL+DL)
         nei_means = []
-        for nei, lst in nei_prr_vals.get(node, {}).items():
-            if lst:
-                nei_means.append(sum(lst)/len(lst))
+        for nei, acc in nei_prr_vals.get(node, {}).items():
+            if acc.n:
+                nei_means.append(acc.mean())
         if nei_means:
             prr_all_nei_avg = sum(nei_means)/len(nei_means)
         else:
-            obs = prr_observed_per_node.get(node, [])
-            prr_all_nei_avg = float('nan') if not obs else sum(obs)/len(obs)
+            obs = prr_observed_per_node.get(node)
+            prr_all_nei_avg = float('nan') if obs is None else obs.mean()
 
         # Nếu vẫn thiếu prr_parent/sender, thử suy luận bằng legacy nei + last_parent_addr
         prr_parent = prr_parent_last.get(node, math.nan)
@@ -252,19 +359,19 @@ def parse_files(paths: List[str]):
 
         parent_addr = last_parent_addr.get(node)
         if math.isnan(prr_parent) and parent_addr:
-            lst = nei_prr_vals.get(node, {}).get(parent_addr, [])
-            if lst:
-                prr_parent = lst[-1]
+            acc = nei_prr_vals.get(node, {}).get(parent_addr)
+            if acc is not None:
+                prr_parent = acc.last
         if math.isnan(prr_sender) and parent_addr:
-            lst = nei_prr_vals.get(parent_addr, {}).get(node, [])
-            if lst:
-                prr_sender = lst[-1]
+            acc = nei_prr_vals.get(parent_addr, {}).get(node)
+            if acc is not None:
+                prr_sender = acc.last
 
         # PDR theo seq
-        ul_s = ul_sends.get(node, set())
-        ul_r = ul_recv.get(node, set())
-        dl_s = dl_sends.get(node, set())
-        dl_r = dl_recv.get(node, set())
+        ul_s = ul_sends.get(node, ())
+        ul_r = ul_recv.get(node, ())
+        dl_s = dl_sends.get(node, ())
+        dl_r = dl_recv.get(node, ())
 
         # UL PDR: use unified attempts for fair comparison (like DL)
         ul_attempts_count = ul_attempts.get(node, len(ul_s))  # Fallback to old method if no attempts logged
@@ -293,14 +400,11 @@ def parse_files(paths: List[str]):
         pdr_dl_per_node = pdr_dl_attempts  # Use attempts-based PDR for fair comparison
         pdr_ul_per_node = pdr_ul_attempts  # Use attempts-based PDR for fair comparison
 
-        ul_delay_list = ul_delays.get(node, [])
-        dl_delay_list = dl_delays.get(node, [])
+        ul_delay = ul_delays.get(node, IntMean())
+        dl_delay = dl_delays.get(node, IntMean())
 
-        def mean_or_nan(values: List[int]) -> float:
-            return float('nan') if not values else sum(values) / len(values)
-
-        ul_delay_ticks_avg = mean_or_nan(ul_delay_list)
-        dl_delay_ticks_avg = mean_or_nan(dl_delay_list)
+        ul_delay_ticks_avg = ul_delay.mean()
+        dl_delay_ticks_avg = dl_delay.mean()
 
         ul_delay_ms_avg = (ul_delay_ticks_avg * 1000.0 / CLOCK_SECOND) if not math.isnan(ul_delay_ticks_avg) else math.nan
         dl_delay_ms_avg = (dl_delay_ticks_avg * 1000.0 / CLOCK_SECOND) if not math.isnan(dl_delay_ticks_avg) else math.nan
@@ -325,10 +429,10 @@ def parse_files(paths: List[str]):
             "PDR_DL_attempts(%)": round(pdr_dl_attempts, 2) if not math.isnan(pdr_dl_attempts) else math.nan,
             "PDR_DL_sent(%)": round(pdr_dl_sent, 2) if not math.isnan(pdr_dl_sent) else math.nan,
             "PDR_DL_CSV_last(%)": csv_pdrdl_last.get(node, math.nan),
-            "UL_delay_samples": len(ul_delay_list),
+            "UL_delay_samples": ul_delay.n,
             "UL_delay_ticks_avg": round(ul_delay_ticks_avg, 2) if not math.isnan(ul_delay_ticks_avg) else math.nan,
             "UL_delay_ms_avg": round(ul_delay_ms_avg, 2) if not math.isnan(ul_delay_ms_avg) else math.nan,
-            "DL_delay_samples": len(dl_delay_list),
+            "DL_delay_samples": dl_delay.n,
             "DL_delay_ticks_avg": round(dl_delay_ticks_avg, 2) if not math.isnan(dl_delay_ticks_avg) else math.nan,
             "DL_delay_ms_avg": round(dl_delay_ms_avg, 2) if not math.isnan(dl_delay_ms_avg) else math.nan,
             # Coverage indicators (1 if received at least 1 packet, 0 otherwise)
@@ -438,20 +542,47 @@ def parse_files(paths: List[str]):
 
     return df, df_net
 
+def write_outputs(df, df_net, out_prefix: str):
+    out_summary = f"{out_prefix}_summary.csv"
+    out_network = f"{out_prefix}_network_avg.csv"
+
+    df.to_csv(out_summary, index=False)
+    df_net.to_csv(out_network, index=False)
+    return out_summary, out_network
+
+def parse_one(path: str):
+    """--each worker: parse one seed log into <log without .txt>_*.csv."""
+    out_prefix = os.path.splitext(path)[0]
+    df, df_net = parse_files([path])
+    return write_outputs(df, df_net, out_prefix)
+
 def main():
     ap = argparse.ArgumentParser(description="Parse SRDCP/Contiki logs to PRR/PDR per-node and network averages.")
     ap.add_argument("logs", nargs="+", help="Paths to log files")
     ap.add_argument("--out-prefix", default="srdcp_metrics", help="Prefix for output CSV files")
     ap.add_argument("--out", dest="out_prefix", help="Alias of --out-prefix")
+    ap.add_argument("--each", action="store_true",
+                    help="Parse every log on its own (one seed each): seed-N.txt -> seed-N_summary.csv, "
+                         "seed-N_network_avg.csv; --out-prefix is ignored")
+    ap.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1,
+                    help="Parallel workers for --each (default: number of CPUs)")
     args = ap.parse_args()
 
-    df, df_net = parse_files(args.logs)
-
-    out_summary = f"{args.out_prefix}_summary.csv"
-    out_network = f"{args.out_prefix}_network_avg.csv"
+    if args.each:
+        # seed-*.txt also matches the powertrace traces, energy_parser.py reads those
+        logs = [p for p in args.logs if not p.endswith('_dc.txt')]
+        jobs = max(1, min(args.jobs, len(logs)))
+        if jobs == 1:
+            results = map(parse_one, logs)
+        else:
+            pool = ProcessPoolExecutor(max_workers=jobs)
+            results = pool.map(parse_one, logs)
+        for out_summary, out_network in results:
+            print(f"Saved {out_summary}, {out_network}")
+        return
 
-    df.to_csv(out_summary, index=False)
-    df_net.to_csv(out_network, index=False)
+    df, df_net = parse_files(args.logs)
+    out_summary, out_network = write_outputs(df, df_net, args.out_prefix)
 
     print(f"Saved per-node summary -> {out_summary}")
     print(f"Saved network averages -> {out_network}")
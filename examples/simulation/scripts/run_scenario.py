@@ -15,6 +15,16 @@ Examples:
     ./run_scenario.py                                  # Liệt kê các kịch bản
     ./run_scenario.py waco-rpl-grid-15-nodes           # Chạy 10 seeds
     ./run_scenario.py waco-srdcp-chain-30-nodes 20     # Chạy 20 seeds
+    ./run_scenario.py waco-srdcp-grid-30-nodes,contiki-rpl-grid-30-nodes 20 -j 16 --timeout 7200
+                                                       # 16 JVM song song, nhiều kịch bản
+
+Parallel mode (-j N > 1): N COOJA JVMs at once over all (scenario, seed) jobs.
+Each job logs into its own OUTDIR/.work/seed-N (WACO_LOG_DIR), so runs never
+pick up each other's files; the logs land as OUTDIR/seed-N.txt and
+seed-N_dc.txt, are parsed at once and the aggregates are refreshed after every
+seed. A seed whose seed-N.txt exists is done: rerunning the same command
+resumes the sweep (--rerun starts over). --timeout kills a JVM after that many
+seconds; its seed is reported as failed and retried on the next run.
 """
 
 import sys
@@ -23,8 +33,17 @@ import argparse
 import subprocess
 import shutil
 import re
+import shlex
+import threading
+import time
+import xml.etree.ElementTree as ET
+from concurrent.futures import ThreadPoolExecutor, as_completed
 from pathlib import Path
-from typing import List, Optional, Tuple
+from typing import List, NamedTuple, Optional, Tuple
+
+# Classpath and heap of the run_bigmem target in tools/cooja/build.xml
+COOJA_CLASSPATH = ["build", "lib/jdom.jar", "lib/log4j.jar", "lib/jsyntaxpane.jar", "lib/swingx-all-1.6.4.jar"]
+COOJA_MAXMEMORY = "1536m"
 
 def find_scenario_dirs(script_dir: Path) -> List[Path]:
     """Find all 'sim' directories."""
@@ -64,9 +83,9 @@ def find_scenario_path(script_dir: Path, scenario_name: str) -> Optional[Path]:
     
     return None
 
-def check_dependencies() -> bool:
+def check_dependencies(parallel: bool = False) -> bool:
     """Check if required commands are available."""
-    required = ['ant', 'python3', 'make']
+    required = ['ant', 'python3', 'make'] + (['java'] if parallel else [])
     missing = []
     
     for cmd in required:
@@ -79,7 +98,7 @@ def check_dependencies() -> bool:
     
     return True
 
-def build_cooja_jar(root_dir: Path, cooja_build_xml: Path) -> None:
+def build_cooja_jar(root_dir: Path, cooja_build_xml: Path, targets: Tuple[str, ...] = ("jar",)) -> None:
     """Build Cooja jar if needed."""
     if not cooja_build_xml.exists():
         print(f"[ERR] Không tìm thấy: {cooja_build_xml}", file=sys.stderr)
@@ -88,7 +107,7 @@ def build_cooja_jar(root_dir: Path, cooja_build_xml: Path) -> None:
     print("[COOJA] Build cooja jar (nếu cần)")
     try:
         subprocess.run(
-            ["ant", "-f", str(cooja_build_xml), "jar"],
+            ["ant", "-f", str(cooja_build_xml), *targets],
             check=True,
             capture_output=True
         )
@@ -239,7 +258,7 @@ def parse_logs(
             except subprocess.CalledProcessError as e:
                 print(f"{log_prefix}[WARN] Lỗi khi parse energy: {e}", file=sys.stderr)
 
-def aggregate_results(script_dir: Path, outdir: Path, log_prefix: str) -> None:
+def aggregate_results(script_dir: Path, outdir: Path, log_prefix: str, quiet: bool = False) -> None:
     """Aggregate all results."""
     aggregate_script = script_dir / "aggregate_results.py"
     
@@ -258,17 +277,173 @@ def aggregate_results(script_dir: Path, outdir: Path, log_prefix: str) -> None:
             return
     
     if aggregate_script.exists():
-        print(f"{log_prefix} Tổng hợp kết quả...")
+        if not quiet:
+            print(f"{log_prefix} Tổng hợp kết quả...")
         try:
             subprocess.run(
                 [sys.executable, str(aggregate_script), str(outdir)],
-                check=False
+                check=False,
+                capture_output=quiet
             )
         except Exception as e:
             print(f"{log_prefix}[WARN] Lỗi khi tổng hợp: {e}", file=sys.stderr)
     else:
         print(f"{log_prefix}[WARN] Không tìm thấy aggregate_results script", file=sys.stderr)
 
+# ------------------------------ Parallel mode ------------------------------
+
+class Scenario(NamedTuple):
+    name: str
+    path: Path          # .csc
+    outdir: Path
+    log_prefix: str
+
+class Job(NamedTuple):
+    scenario: Scenario
+    seed: int
+
+def build_firmware(root_dir: Path, scenario: Scenario) -> None:
+    """Run the mote type compile commands of the .csc once, before the JVMs.
+
+    Headless COOJA runs them again at every start; with the firmware up to
+    date those makes are no-ops, instead of N builds racing in one obj dir.
+    """
+    tree = ET.parse(scenario.path)
+    for mt in tree.getroot().iter("motetype"):
+        source = mt.findtext("source")
+        commands = mt.findtext("commands")
+        if not source or not commands:
+            continue
+        src_dir = Path(source.replace("[CONTIKI_DIR]", str(root_dir))).parent
+        for cmd in commands.splitlines():
+            if cmd.strip():
+                print(f"{scenario.log_prefix} Build firmware: {cmd.strip()} ({src_dir})")
+                subprocess.run(shlex.split(cmd), cwd=src_dir, check=True, capture_output=True)
+
+# Exit codes of a COOJA that ended through its test script: 0 TEST OK,
+# 1 TEST FAILED or script error, 2 TIMEOUT. The .csc scripts here only stop at
+# their TIMEOUT, so a normal run exits non-zero and the code cannot tell it
+# from a failed one. A run counts only if COOJA also logged that the script
+# finished ("Test script finished"), which a crashed or killed JVM never does.
+COOJA_SCRIPT_EXIT_CODES = (0, 1, 2)
+
+def cooja_command(cooja_dir: Path, *cooja_args: str) -> List[str]:
+    """The JVM run_bigmem starts, without going through ant."""
+    java = shutil.which("java") or "java"
+    classpath = os.pathsep.join(str(cooja_dir / p) for p in COOJA_CLASSPATH)
+    return [java, f"-Xmx{COOJA_MAXMEMORY}", "-cp", classpath, "org.contikios.cooja.Cooja",
+            *cooja_args]
+
+def start_cooja(cooja_dir: Path, cooja_args: List[str], workdir: Path,
+                timeout: Optional[float]) -> Optional[str]:
+    """Runs one JVM logging into workdir/cooja.log. Returns why it failed, None if it exited
+    with one of COOJA_SCRIPT_EXIT_CODES."""
+    env = dict(os.environ)
+    env["WACO_LOG_DIR"] = str(workdir.resolve())
+    env["LD_LIBRARY_PATH"] = "."
+    with open(workdir / "cooja.log", "w") as log:
+        try:
+            proc = subprocess.run(cooja_command(cooja_dir, *cooja_args),
+                                  cwd=cooja_dir / "build", env=env, stdout=log,
+                                  stderr=subprocess.STDOUT, timeout=timeout)
+        except subprocess.TimeoutExpired:
+            return f"timeout after {timeout:g}s (log: {workdir / 'cooja.log'})"
+    if proc.returncode not in COOJA_SCRIPT_EXIT_CODES:
+        return f"COOJA exited with code {proc.returncode} (log: {workdir / 'cooja.log'})"
+    return None
+
+def script_finished(cooja_log: Path) -> bool:
+    """True if COOJA logged that the test script of the run finished."""
+    return cooja_log.exists() and "Test script finished" in cooja_log.read_text(errors="ignore")
+
+def collect_seed(script_dir: Path, sc: Scenario, seed: int, logdir: Path, cooja_log: Path) -> str:
+    """Moves the logs of one run out of its own directory and parses them. Returns "ok" or why not."""
+    # The only run in this directory: its files, whatever the .csc names them
+    txts = sorted((p for p in logdir.glob("*.txt") if not p.name.endswith("_dc.txt")),
+                  key=lambda p: p.stat().st_mtime)
+    dcs = sorted(logdir.glob("*_dc.txt"), key=lambda p: p.stat().st_mtime)
+    if not txts:
+        return f"no log written (log: {cooja_log})"
+    if dcs:
+        os.replace(dcs[-1], sc.outdir / f"seed-{seed}_dc.txt")
+    # Last: seed-N.txt marks the seed as done
+    os.replace(txts[-1], sc.outdir / f"seed-{seed}.txt")
+
+    parse_logs(script_dir, sc.outdir, seed, sc.log_prefix)
+    return "ok"
+
+def seed_done(outdir: Path, seed: int) -> bool:
+    return (outdir / f"seed-{seed}.txt").exists()
+
+def run_job(job: Job, cooja_dir: Path, script_dir: Path, timeout: Optional[float]) -> str:
+    """Runs one seed in its own log directory. Returns "ok" or why it failed."""
+    sc, seed = job.scenario, job.seed
+    workdir = sc.outdir / ".work" / f"seed-{seed}"
+    shutil.rmtree(workdir, ignore_errors=True)
+    workdir.mkdir(parents=True)
+
+    status = start_cooja(cooja_dir, [f"-nogui={sc.path.resolve()}", f"-random-seed={seed}"],
+                         workdir, timeout)
+    if status is None and not script_finished(workdir / "cooja.log"):
+        status = f"not finished (log: {workdir / 'cooja.log'})"
+    if status is None:
+        status = collect_seed(script_dir, sc, seed, workdir, workdir / "cooja.log")
+    if status == "ok":
+        shutil.rmtree(workdir, ignore_errors=True)
+    return status
+
+def run_parallel(scenarios: List[Scenario], num_seeds: int, jobs: int, timeout: Optional[float],
+                 rerun: bool, root_dir: Path, cooja_dir: Path, script_dir: Path) -> int:
+    """Runs every (scenario, seed) job on a pool of `jobs` JVMs. Returns the failure count."""
+    todo: List[Job] = []
+    for sc in scenarios:
+        sc.outdir.mkdir(parents=True, exist_ok=True)
+        for seed in range(1, num_seeds + 1):
+            if rerun or not seed_done(sc.outdir, seed):
+                todo.append(Job(sc, seed))
+            else:
+                print(f"{sc.log_prefix} Seed {seed}: đã có seed-{seed}.txt, bỏ qua")
+    if not todo:
+        for sc in scenarios:
+            aggregate_results(script_dir, sc.outdir, sc.log_prefix)
+        return 0
+
+    for sc in {job.scenario for job in todo}:
+        build_firmware(root_dir, sc)
+
+    print(f"[POOL] {len(todo)} job(s), {jobs} JVM song song"
+          + (f", timeout {timeout:g}s/job" if timeout else ""))
+    agg_lock = threading.Lock()
+    failed: List[Tuple[Job, str]] = []
+    start = time.time()
+    with ThreadPoolExecutor(max_workers=jobs) as pool:
+        futures = {pool.submit(run_job, job, cooja_dir, script_dir, timeout): job for job in todo}
+        for n, fut in enumerate(as_completed(futures), 1):
+            job = futures[fut]
+            sc = job.scenario
+            try:
+                status = fut.result()
+            except Exception as e:
+                status = f"error: {e}"
+            elapsed = time.time() - start
+            print(f"[POOL] {n}/{len(todo)} {sc.name} seed {job.seed}: {status} ({elapsed:.0f}s)")
+            if status != "ok":
+                failed.append((job, status))
+                continue
+            # Partial aggregates as soon as a seed is in
+            with agg_lock:
+                aggregate_results(script_dir, sc.outdir, sc.log_prefix, quiet=True)
+
+    for sc in scenarios:
+        aggregate_results(script_dir, sc.outdir, sc.log_prefix)
+        try:
+            (sc.outdir / ".work").rmdir()  # left only when a seed failed
+        except OSError:
+            pass
+    for job, status in failed:
+        print(f"[POOL][ERR] {job.scenario.name} seed {job.seed}: {status}", file=sys.stderr)
+    return len(failed)
+
 def main():
     
     parser = argparse.ArgumentParser(
@@ -298,6 +473,22 @@ def main():
         action="store_true",
         help="Liệt kê các kịch bản có sẵn"
     )
+    parser.add_argument(
+        "-j", "--jobs",
+        type=int,
+        default=1,
+        help="Số JVM COOJA chạy song song (mặc định: 1, tuần tự như cũ qua ant)"
+    )
+    parser.add_argument(
+        "--timeout",
+        type=float,
+        help="Giới hạn thời gian mỗi seed, giây (chỉ với -j > 1)"
+    )
+    parser.add_argument(
+        "--rerun",
+        action="store_true",
+        help="Chạy lại cả các seed đã có seed-N.txt (chỉ với -j > 1)"
+    )
     
     args = parser.parse_args()
     
@@ -314,50 +505,63 @@ def main():
             find_and_list_scenarios(script_dir)
         sys.exit(0)
     
-    scenario_name = args.scenario_name
+    names = [n for n in args.scenario_name.split(",") if n]
     num_seeds = args.num_seeds
-    
-    # Find scenario path
-    scenario_path = find_scenario_path(script_dir, scenario_name)
-    if not scenario_path:
-        print(f"[ERR] Không tìm thấy kịch bản '{scenario_name}'. Vui lòng kiểm tra lại tên.", file=sys.stderr)
-        print(file=sys.stderr)
-        find_and_list_scenarios(script_dir)
-        sys.exit(1)
-    
-    # Determine output directory
-    logdir = scenario_path.parent
-    sim_group_dir = logdir.parent
-    default_outdir = sim_group_dir / "out" / f"{scenario_name}-mc"
-    outdir = Path(args.outdir) if args.outdir else default_outdir
-    
-    # Setup
     cooja_build_xml = root_dir / "tools" / "cooja" / "build.xml"
-    basename = scenario_name
-    log_prefix = f"[{scenario_name.upper()[:20].replace('-', '')}]"
-    
-    print(f"{log_prefix} Chuẩn bị thư mục output: {outdir}")
-    outdir.mkdir(parents=True, exist_ok=True)
-    
+
+    scenarios: List[Scenario] = []
+    for scenario_name in names:
+        # Find scenario path
+        scenario_path = find_scenario_path(script_dir, scenario_name)
+        if not scenario_path:
+            print(f"[ERR] Không tìm thấy kịch bản '{scenario_name}'. Vui lòng kiểm tra lại tên.", file=sys.stderr)
+            print(file=sys.stderr)
+            find_and_list_scenarios(script_dir)
+            sys.exit(1)
+
+        # Determine output directory (OUTDIR/<scenario>-mc when several scenarios share it)
+        sim_group_dir = scenario_path.parent.parent
+        outdir = sim_group_dir / "out" / f"{scenario_name}-mc"
+        if args.outdir:
+            outdir = Path(args.outdir) if len(names) == 1 else Path(args.outdir) / f"{scenario_name}-mc"
+        log_prefix = f"[{scenario_name.upper()[:20].replace('-', '')}]"
+        scenarios.append(Scenario(scenario_name, scenario_path, outdir, log_prefix))
+
+    for sc in scenarios:
+        print(f"{sc.log_prefix} Chuẩn bị thư mục output: {sc.outdir}")
+        sc.outdir.mkdir(parents=True, exist_ok=True)
+
     # Check dependencies
-    if not check_dependencies():
+    if not check_dependencies(parallel=args.jobs > 1):
         sys.exit(1)
-    
+
+    if args.jobs > 1:
+        # The JVMs are started directly: build everything run_bigmem depends on once
+        build_cooja_jar(root_dir, cooja_build_xml, ("jar", "copy configs"))
+        failed = run_parallel(scenarios, num_seeds, args.jobs, args.timeout, args.rerun,
+                              root_dir.resolve(), cooja_build_xml.parent.resolve(), script_dir)
+        for sc in scenarios:
+            print(f"{sc.log_prefix} Hoàn tất. Kết quả nằm ở: {sc.outdir}")
+        sys.exit(1 if failed else 0)
+
     # Build Cooja
     build_cooja_jar(root_dir, cooja_build_xml)
-    
-    # Run simulations
-    for seed in range(1, num_seeds + 1):
-        run_simulation(cooja_build_xml, scenario_path, seed, log_prefix)
-        move_log_files(logdir, outdir, basename, seed, log_prefix)
-        parse_logs(script_dir, outdir, seed, log_prefix)
-    
-    # Aggregate results
-    aggregate_results(script_dir, outdir, log_prefix)
-    
-    print(f"{log_prefix} Hoàn tất. Kết quả nằm ở: {outdir}")
-    print(f"{log_prefix} Gợi ý: xem network_avgs.csv, energy_network_avgs.csv, per_node_avg.csv, per_node_energy_avg.csv")
+
+    for sc in scenarios:
+        logdir = sc.path.parent
+        basename = sc.name
+
+        # Run simulations
+        for seed in range(1, num_seeds + 1):
+            run_simulation(cooja_build_xml, sc.path, seed, sc.log_prefix)
+            move_log_files(logdir, sc.outdir, basename, seed, sc.log_prefix)
+            parse_logs(script_dir, sc.outdir, seed, sc.log_prefix)
+
+        # Aggregate results
+        aggregate_results(script_dir, sc.outdir, sc.log_prefix)
+
+        print(f"{sc.log_prefix} Hoàn tất. Kết quả nằm ở: {sc.outdir}")
+        print(f"{sc.log_prefix} Gợi ý: xem network_avgs.csv, energy_network_avgs.csv, per_node_avg.csv, per_node_energy_avg.csv")
 
 if __name__ == "__main__":
     main()
-
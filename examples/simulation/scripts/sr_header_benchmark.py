@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+"""
+Benchmark of the SRDCP downlink source-route encodings on the chain scenarios.
+
+Two parts:
+  * analytic: header bytes and 802.15.4 air time of one downlink delivery for
+    every destination of a 5/15/30-node chain (no simulator needed);
+  * measured (--run): rebuilds the chain firmware once per encoding
+    (DEFINES=SRDCP_SR_ENCODING=<n>), runs the chain scenarios headless in
+    COOJA and reports the route header size logged by the sink
+    ("SRDCP: DL route ...") together with the radio duty cycle from powertrace.
+
+Usage:
+    ./sr_header_benchmark.py                         # analytic table only
+    ./sr_header_benchmark.py --run --seeds 3         # + COOJA runs
+    ./sr_header_benchmark.py --run --scenarios waco-srdcp-chain-30-nodes
+"""
+
+import sys
+import re
+import argparse
+import subprocess
+import statistics
+from pathlib import Path
+from typing import Dict, List, Optional
+
+import pandas as pd
+
+import run_scenario
+import energy_parser
+
+# Must match source_route.h
+ENCODINGS = {0: "addr", 1: "id8", 2: "packed"}
+CHAINS = {
+    "waco-srdcp-chain-5-nodes": 5,
+    "waco-srdcp-chain-15-nodes": 15,
+    "waco-srdcp-chain-30-nodes": 30,
+}
+
+US_PER_BYTE = 32          # 250 kbit/s O-QPSK
+PHY_BYTES = 6             # preamble + SFD + length
+MAC_BYTES = 11            # FCF, seq, PAN id, short dst/src addresses
+FCS_BYTES = 2
+RIME_BYTES = 2            # chameleon channel id
+PACKET_TYPE_BYTES = 2     # enum packet_type on msp430
+DL_HDR_BYTES = 2          # downward_data_packet_header
+DL_PAYLOAD_BYTES = 6      # test_msg_t
+
+re_dl_route = re.compile(r'SRDCP: DL route enc=(\d+) len=(\d+) width=(\d+) bytes=(\d+)')
+
+
+def route_bytes(enc: int, hops: List[int]) -> int:
+    """Size of the encoded route (see source_route_size())."""
+    if enc == 1:
+        return len(hops)
+    if enc == 2:
+        width = max(max(hops), 1).bit_length()
+        return 1 + (len(hops) * width + 7) // 8
+    return 2 * len(hops)
+
+
+def frame_airtime_us(route_len_bytes: int) -> int:
+    frame = (PHY_BYTES + MAC_BYTES + FCS_BYTES + RIME_BYTES + PACKET_TYPE_BYTES +
+             DL_HDR_BYTES + route_len_bytes + DL_PAYLOAD_BYTES)
+    return frame * US_PER_BYTE
+
+
+def analytic_rows() -> List[Dict]:
+    """One row per (chain, encoding): averages over every destination 2..N.
+
+    On a chain the route to node d is 2, 3, ..., d; every forwarder strips
+    its own hop before retransmitting."""
+    rows = []
+    for scenario, n in CHAINS.items():
+        for enc, name in ENCODINGS.items():
+            first_hdr, airtime = [], []
+            for dest in range(2, n + 1):
+                route = list(range(2, dest + 1))
+                first_hdr.append(route_bytes(enc, route))
+                airtime.append(sum(frame_airtime_us(route_bytes(enc, route[i:]))
+                                   for i in range(len(route))))
+            rows.append({
+                "scenario": scenario,
+                "encoding": name,
+                "route_bytes_at_sink_avg": round(statistics.mean(first_hdr), 2),
+                "route_bytes_at_sink_max": max(first_hdr),
+                "dl_airtime_us_avg": round(statistics.mean(airtime), 1),
+                "dl_airtime_us_max": max(airtime),
+            })
+    df = pd.DataFrame(rows)
+    base = df[df["encoding"] == "addr"].set_index("scenario")["dl_airtime_us_avg"]
+    df["airtime_vs_addr_pct"] = [round(100.0 * r.dl_airtime_us_avg / base[r.scenario], 1)
+                                 for r in df.itertuples()]
+    return df.to_dict("records")
+
+
+def firmware_of(csc: Path) -> Optional[Path]:
+    m = re.search(r'<firmware[^>]*>\[CONTIKI_DIR\]/(.+?)</firmware>', csc.read_text(errors="ignore"))
+    return (csc.parents[5] / m.group(1)) if m else None
+
+
+def build_firmware(firmware: Path, enc: int) -> None:
+    app_dir = firmware.parent
+    print(f"[SRBENCH] build {firmware.name} SRDCP_SR_ENCODING={enc}")
+    subprocess.run(["make", "TARGET=sky", "clean"], cwd=app_dir, check=True, capture_output=True)
+    subprocess.run(["make", "TARGET=sky", f"DEFINES=SRDCP_SR_ENCODING={enc}", firmware.name],
+                   cwd=app_dir, check=True, capture_output=True)
+
+
+def measured_row(scenario: str, enc: int, outdir: Path, seeds: int) -> Dict:
+    route_sizes, on_pct, tx_pct = [], [], []
+    for seed in range(1, seeds + 1):
+        log = outdir / f"seed-{seed}.txt"
+        if log.exists():
+            with open(log, errors="ignore") as f:
+                for line in f:
+                    m = re_dl_route.search(line)
+                    if m:
+                        route_sizes.append(int(m.group(4)))
+        dc = outdir / f"seed-{seed}_dc.txt"
+        if dc.exists():
+            avg = energy_parser.parse_dc_file(str(dc))["avg"]
+            on_pct.append(avg["on_pct"])
+            tx_pct.append(avg["tx_pct"])
+    mean = lambda v: round(statistics.mean(v), 3) if v else float("nan")
+    return {
+        "scenario": scenario,
+        "encoding": ENCODINGS[enc],
+        "seeds": seeds,
+        "dl_sent": len(route_sizes),
+        "route_bytes_at_sink_avg": mean(route_sizes),
+        "radio_on_pct": mean(on_pct),
+        "radio_tx_pct": mean(tx_pct),
+    }
+
+
+def run_measured(script_dir: Path, scenarios: List[str], seeds: int, outroot: Path) -> List[Dict]:
+    root_dir = script_dir.parent.parent.parent
+    cooja_build_xml = root_dir / "tools" / "cooja" / "build.xml"
+    if not run_scenario.check_dependencies():
+        sys.exit(1)
+    run_scenario.build_cooja_jar(root_dir, cooja_build_xml)
+
+    rows = []
+    for scenario in scenarios:
+        csc = run_scenario.find_scenario_path(script_dir, scenario)
+        if not csc:
+            print(f"[SRBENCH][WARN] scenario {scenario} not found", file=sys.stderr)
+            continue
+        firmware = firmware_of(csc)
+        for enc in ENCODINGS:
+            build_firmware(firmware, enc)
+            outdir = outroot / f"{scenario}-{ENCODINGS[enc]}"
+            outdir.mkdir(parents=True, exist_ok=True)
+            prefix = f"[SRBENCH {ENCODINGS[enc]}]"
+            for seed in range(1, seeds + 1):
+                run_scenario.run_simulation(cooja_build_xml, csc, seed, prefix)
+                run_scenario.move_log_files(csc.parent, outdir, scenario, seed, prefix)
+            rows.append(measured_row(scenario, enc, outdir, seeds))
+    return rows
+
+
+def main():
+    parser = argparse.ArgumentParser(description="SRDCP source-route header benchmark",
+                                     formatter_class=argparse.RawDescriptionHelpFormatter,
+                                     epilog=__doc__)
+    parser.add_argument("--run", action="store_true", help="also run the COOJA chain scenarios")
+    parser.add_argument("--seeds", type=int, default=3, help="seeds per scenario and encoding (default: 3)")
+    parser.add_argument("--scenarios", nargs="+", default=list(CHAINS), help="chain scenarios to run")
+    parser.add_argument("--outdir", default=None, help="output directory (default: waco-srdcp/sim/out/sr-header-bench)")
+    args = parser.parse_args()
+
+    script_dir = Path(__file__).resolve().parent
+    outroot = Path(args.outdir) if args.outdir else script_dir.parent / "waco-srdcp" / "sim" / "out" / "sr-header-bench"
+    outroot.mkdir(parents=True, exist_ok=True)
+
+    analytic = pd.DataFrame(analytic_rows())
+    analytic.to_csv(outroot / "sr_header_analytic.csv", index=False)
+    print(analytic.to_string(index=False))
+
+    if args.run:
+        measured = pd.DataFrame(run_measured(script_dir, args.scenarios, args.seeds, outroot))
+        measured.to_csv(outroot / "sr_header_measured.csv", index=False)
+        print()
+        print(measured.to_string(index=False))
+
+    print(f"[SRBENCH] results in {outroot}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""
+Decode the binary telemetry of waco-srdcp (SRDCP_TELEMETRY, telemetry.h).
+
+The motes print one record per line as "TM:<base64>". decode_line() turns
+such a line back into the CSV/STAT/APP text the app prints without
+SRDCP_TELEMETRY, keeping the COOJA prefix (time, mote id) in front of it;
+any other line is returned as is. log_parser.py calls it on every line, so
+logs of both kinds parse the same way.
+
+Usage: telemetry_decode.py seed-1.txt [-o seed-1.decoded.txt]
+"""
+import argparse
+import base64
+import struct
+import sys
+from typing import Callable, Dict, Optional, Tuple
+
+MARK = 'TM:'
+
+# Record header: type, local address u8[0] u8[1], time in seconds
+HDR = struct.Struct('<BBBH')
+
+# type -> (field layout after the header, formatter)
+_PDR = struct.Struct('<BBHHIIIBBH')
+_NEI = struct.Struct('<BBBBHhBBHHBBH')
+_UL_DELAY = struct.Struct('<BBBI')
+_DL_DELAY = struct.Struct('<IBB')
+_UL_SEND = struct.Struct('<HHBB')
+_UL_GOT = struct.Struct('<HBBBH')
+_DL_SEND = struct.Struct('<HBBB')
+_DL_GOT = struct.Struct('<HBHBB')
+_UL_ATTEMPT = struct.Struct('<HBH')
+_DL_ATTEMPT = struct.Struct('<HBBBH')
+
+
+def _a(lo: int, hi: int) -> str:
+    """linkaddr as the motes print it, %02u:%02u."""
+    return f"{lo:02d}:{hi:02d}"
+
+
+def _pdr(kind: str, local: str, t: int, f: Tuple) -> str:
+    p0, p1, first, last, recv, gaps, dups, par0, par1, metric = f
+    # Same arithmetic as the mote: 16-bit int on the MSP430, 32-bit unsigned long
+    expected = (last - first + 1) & 0xFFFF or 1
+    pdrx = ((recv * 10000) & 0xFFFFFFFF) // expected
+    return (f"CSV,{kind},local={local},{t},{_a(p0, p1)},{first},{last},{recv},{gaps},{dups},"
+            f"{expected},{pdrx // 100}.{pdrx % 100:02d},{_a(par0, par1)},{metric}")
+
+
+def _hdr_line(kind: str) -> Callable[[str, int, Tuple], str]:
+    return lambda local, t, f: (f"CSV,{kind},local={local},time,peer,first,last,recv,gaps,dups,"
+                                f"expected,PDR%,parent,my_metric")
+
+
+def _nei(local: str, t: int, f: Tuple) -> str:
+    who, rank, n0, n1, hop, rssi, lqi, prr, last_s, last_seq, par0, par1, metric = f
+    return (f"CSV,NEI,local={local},{'SINK' if who else 'NODE'},{t},{rank},{_a(n0, n1)},{hop},"
+            f"{rssi},{lqi},{prr},{last_s},{last_seq},{_a(par0, par1)},{metric}")
+
+
+def _ul_attempt(local: str, t: int, f: Tuple) -> str:
+    attempt, ok, sent = f
+    line = f"STAT,UL_ATTEMPT,time={t},source={local},attempt_seq={attempt},route_ok={ok}"
+    return line + (f",sent_seq={sent}" if ok else "")
+
+
+def _dl_attempt(local: str, t: int, f: Tuple) -> str:
+    attempt, d0, d1, ok, sent = f
+    line = f"STAT,DL_ATTEMPT,time={t},attempt_seq={attempt},target={_a(d0, d1)},route_ok={ok}"
+    return line + (f",sent_seq={sent}" if ok else "")
+
+
+RECORDS: Dict[int, Tuple[Optional[struct.Struct], Callable[[str, int, Tuple], str]]] = {
+    0x01: (None, _hdr_line('PDR_UL')),
+    0x02: (_PDR, lambda local, t, f: _pdr('PDR_UL', local, t, f)),
+    0x03: (None, _hdr_line('PDR_DL')),
+    0x04: (_PDR, lambda local, t, f: _pdr('PDR_DL', local, t, f)),
+    0x05: (None, lambda local, t, f: (f"CSV,NEI,local={local},who,time,rank,neigh,hop,rssi,lqi,prr,"
+                                      f"last_seen,neigh_last_seq,parent,my_metric")),
+    0x06: (_NEI, _nei),
+    0x07: (_UL_DELAY, lambda local, t, f: (f"STAT,UL_DELAY,local={local},time={t},src={_a(f[0], f[1])},"
+                                           f"hops={f[2]},delay_ticks={f[3]}")),
+    0x08: (_DL_DELAY, lambda local, t, f: (f"STAT,DL_DELAY,local={local},time={t},delay_ticks={f[0]},"
+                                           f"parent={_a(f[1], f[2])}")),
+    0x09: (_UL_SEND, lambda local, t, f: (f"APP-UL[NODE {local}]: send seq={f[0]} metric={f[1]} "
+                                          f"parent={_a(f[2], f[3])}")),
+    0x0a: (_UL_GOT, lambda local, t, f: (f"APP-UL[SINK]: got seq={f[0]} from {_a(f[1], f[2])} "
+                                         f"hops={f[3]} my_metric={f[4]}")),
+    0x0b: (_DL_SEND, lambda local, t, f: (f"APP-DL[SINK]: send SR seq={f[0]} -> {_a(f[1], f[2])}"
+                                          + (" (multi)" if f[3] else ""))),
+    0x0c: (_DL_GOT, lambda local, t, f: (f"APP-DL[NODE {local}]: got SR seq={f[0]} hops={f[1]} "
+                                         f"my_metric={f[2]} parent={_a(f[3], f[4])}")),
+    0x0d: (_UL_ATTEMPT, _ul_attempt),
+    0x0e: (_DL_ATTEMPT, _dl_attempt),
+}
+
+
+def decode_record(rec: bytes) -> Optional[str]:
+    """Text of one binary record, None if it is malformed or unknown."""
+    if len(rec) < HDR.size:
+        return None
+    rtype, l0, l1, t = HDR.unpack_from(rec)
+    entry = RECORDS.get(rtype)
+    if entry is None:
+        return None
+    layout, fmt = entry
+    fields: Tuple = ()
+    if layout is not None:
+        if len(rec) != HDR.size + layout.size:
+            return None
+        fields = layout.unpack_from(rec, HDR.size)
+    return fmt(_a(l0, l1), t, fields)
+
+
+def decode_line(line: str) -> str:
+    """The line with a TM record replaced by its text; other lines unchanged."""
+    i = line.find(MARK)
+    if i < 0:
+        return line
+    payload = line[i + len(MARK):].strip()
+    try:
+        rec = base64.b64decode(payload + '=' * (-len(payload) % 4), validate=True)
+    except ValueError:
+        return line
+    text = decode_record(rec)
+    if text is None:
+        return line
+    return line[:i] + text + '\n'
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Decode SRDCP binary telemetry (TM: lines) in COOJA logs')
+    ap.add_argument('logs', nargs='+', help='COOJA log files')
+    ap.add_argument('-o', '--out', help='Output file (default: stdout)')
+    args = ap.parse_args()
+
+    out = open(args.out, 'w') if args.out else sys.stdout
+    try:
+        for path in args.logs:
+            with open(path, 'r', errors='ignore') as f:
+                for line in f:
+                    out.write(decode_line(line))
+    finally:
+        if out is not sys.stdout:
+            out.close()
+
+
+if __name__ == '__main__':
+    main()
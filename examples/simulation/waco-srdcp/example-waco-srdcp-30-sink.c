@@ -0,0 +1,3 @@
+// Wrapper to build the sink image with APP_NODES=30
+#define SRDCP_SINK_IMAGE 1
+#include "example-waco-srdcp-30.c"
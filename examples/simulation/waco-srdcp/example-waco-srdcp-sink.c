@@ -0,0 +1,3 @@
+// Wrapper to build the sink image: links the sink routing store pools
+#define SRDCP_SINK_IMAGE 1
+#include "example-waco-srdcp.c"
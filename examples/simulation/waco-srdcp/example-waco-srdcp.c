@@ -23,6 +23,7 @@
 #include "net/netstack.h"
 #include "core/net/linkaddr.h"
 #include "powertrace.h"
+#include "sys/prof.h"
 #include "net/queuebuf.h"
 #include "sensors.h"
 #include "dev/battery-sensor.h"
@@ -30,6 +31,12 @@
 #include <stdio.h>
 #include <string.h>
 #include "my_collect.h"
+#include "telemetry.h"
+#if SRDCP_SINK_IMAGE
+#include "sink_store.h"
+/* Sink routing store pools: only in the sink image (example-waco-srdcp*-sink.c) */
+SINK_STORE_POOLS();
+#endif
 /* If Serial shell/Collect-View are unused, we keep stubs (no-op). */
 #define serial_shell_init() ((void)0)
 #define shell_blink_init() ((void)0)
@@ -43,6 +50,11 @@
 #else
 #define APP_LOG(...)
 #endif
+/* Binary telemetry records (telemetry.h) in place of the CSV/STAT/APP lines */
+#define APP_TM (LOG_APP && SRDCP_TELEMETRY)
+#if SRDCP_TELEMETRY
+static tm_rec tm;
+#endif
 /*==================== App configuration ====================*/
 #define APP_UPWARD_TRAFFIC 1   /* Nodes -> Sink */
 #define APP_DOWNWARD_TRAFFIC 1 /* Sink -> Nodes (source routing) */
@@ -60,6 +72,19 @@
 /* Fast-convergence app profile: slightly faster DL rotation */
 #define SR_MSG_PERIOD (45 * CLOCK_SECOND) /* downlink period at sink */
 #endif
+/* Downlink mode: 0 = one sr_send() per destination,
+ * 1 = bundle up to SR_MULTI_DESTS destinations per sr_send_multi() */
+#ifndef APP_DL_MULTI
+#define APP_DL_MULTI 0
+#endif
+#ifndef SR_MULTI_DESTS
+#define SR_MULTI_DESTS 4
+#endif
+#if (APP_NODES - 1) < SR_MULTI_DESTS
+#define APP_DL_BATCH (APP_NODES - 1)
+#else
+#define APP_DL_BATCH SR_MULTI_DESTS
+#endif
 #define COLLECT_CHANNEL 0xAA /* SRDCP uses C and C+1 */
 
 #define NEI_MAX 32
@@ -351,8 +376,13 @@ static void pdr_ul_print_csv(void)
   int i;
   if (!csv_ul_header_printed)
   {
+#if APP_TM
+    tm_begin(&tm, TM_PDR_UL_HDR);
+    tm_end(&tm);
+#else
     APP_LOG("CSV,PDR_UL,local=%02u:%02u,time,peer,first,last,recv,gaps,dups,expected,PDR%%,parent,my_metric\n",
             linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+#endif
     csv_ul_header_printed = 1;
   }
   for (i = 0; i < PDR_MAX_SRC; i++)
@@ -371,6 +401,20 @@ static void pdr_ul_print_csv(void)
         expected = 1;
       uint32_t recv = pdr_ul[i].received;
       uint32_t pdrx = (recv * 10000UL) / expected;
+#if APP_TM
+      /* expected and PDR are derived by the decoder */
+      (void)pdrx;
+      tm_begin(&tm, TM_PDR_UL);
+      tm_addr(&tm, &pdr_ul[i].id);
+      tm_u16(&tm, pdr_ul[i].first_seq);
+      tm_u16(&tm, pdr_ul[i].last_seq);
+      tm_u32(&tm, recv);
+      tm_u32(&tm, pdr_ul[i].gaps);
+      tm_u32(&tm, pdr_ul[i].dups);
+      tm_addr(&tm, &my_collect.parent);
+      tm_u16(&tm, my_collect.metric);
+      tm_end(&tm);
+#else
       APP_LOG("CSV,PDR_UL,local=%02u:%02u,%lu,%02u:%02u,%u,%u,%lu,%lu,%lu,%lu,%lu.%02lu,%02u:%02u,%u\n",
               linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
               (unsigned long)(clock_time() / CLOCK_SECOND),
@@ -381,6 +425,7 @@ static void pdr_ul_print_csv(void)
               (unsigned long)(pdrx / 100), (unsigned long)(pdrx % 100),
               my_collect.parent.u8[0], my_collect.parent.u8[1],
               my_collect.metric);
+#endif
     }
   }
 }
@@ -452,8 +497,13 @@ static void pdr_dl_print_csv(void)
 {
   if (!csv_dl_header_printed)
   {
+#if APP_TM
+    tm_begin(&tm, TM_PDR_DL_HDR);
+    tm_end(&tm);
+#else
     APP_LOG("CSV,PDR_DL,local=%02u:%02u,time,peer,first,last,recv,gaps,dups,expected,PDR%%,parent,my_metric\n",
             linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+#endif
     csv_dl_header_printed = 1;
   }
   /* Sanity: skip if not inited or invalid seq window */
@@ -463,6 +513,19 @@ static void pdr_dl_print_csv(void)
   if (expected == 0)
     expected = 1;
   uint32_t pdrx = (pdr_dl.received * 10000UL) / expected;
+#if APP_TM
+  (void)pdrx;
+  tm_begin(&tm, TM_PDR_DL);
+  tm_addr(&tm, &sink_addr);
+  tm_u16(&tm, pdr_dl.first_seq);
+  tm_u16(&tm, pdr_dl.last_seq);
+  tm_u32(&tm, pdr_dl.received);
+  tm_u32(&tm, pdr_dl.gaps);
+  tm_u32(&tm, pdr_dl.dups);
+  tm_addr(&tm, &my_collect.parent);
+  tm_u16(&tm, my_collect.metric);
+  tm_end(&tm);
+#else
   APP_LOG("CSV,PDR_DL,local=%02u:%02u,%lu,%02u:%02u,%u,%u,%lu,%lu,%lu,%lu,%lu.%02lu,%02u:%02u,%u\n",
           linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
           (unsigned long)(clock_time() / CLOCK_SECOND),
@@ -473,6 +536,7 @@ static void pdr_dl_print_csv(void)
           (unsigned long)(pdrx / 100), (unsigned long)(pdrx % 100),
           my_collect.parent.u8[0], my_collect.parent.u8[1],
           my_collect.metric);
+#endif
 }
 
 /*==================== CSV Neighbor dump ====================*/
@@ -489,8 +553,13 @@ static void nei_print_csv_all(const char *who)
 
   if (!csv_nei_header_printed)
   {
+#if APP_TM
+    tm_begin(&tm, TM_NEI_HDR);
+    tm_end(&tm);
+#else
     APP_LOG("CSV,NEI,local=%02u:%02u,who,time,rank,neigh,hop,rssi,lqi,prr,last_seen,neigh_last_seq,parent,my_metric\n",
             linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+#endif
     csv_nei_header_printed = 1;
   }
 
@@ -500,6 +569,21 @@ static void nei_print_csv_all(const char *who)
     unsigned long last_s = (unsigned long)(e->last_seen / CLOCK_SECOND);
     uint16_t hop = e->metric;
     uint8_t prr = my_collect_prr_percent(&e->addr);
+#if APP_TM
+    tm_begin(&tm, TM_NEI);
+    tm_u8(&tm, who[0] == 'S');
+    tm_u8(&tm, i + 1);
+    tm_addr(&tm, &e->addr);
+    tm_u16(&tm, hop);
+    tm_u16(&tm, (uint16_t)e->rssi);
+    tm_u8(&tm, e->lqi);
+    tm_u8(&tm, prr);
+    tm_u16(&tm, (uint16_t)last_s);
+    tm_u16(&tm, e->last_seq);
+    tm_addr(&tm, &my_collect.parent);
+    tm_u16(&tm, my_collect.metric);
+    tm_end(&tm);
+#else
     APP_LOG("CSV,NEI,local=%02u:%02u,%s,%lu,%d,%02u:%02u,%u,%d,%u,%u,%lu,%u,%02u:%02u,%u\n",
             linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
             who,
@@ -514,6 +598,7 @@ static void nei_print_csv_all(const char *who)
             e->last_seq,
             my_collect.parent.u8[0], my_collect.parent.u8[1],
             my_collect.metric);
+#endif
   }
 
   /* Optional: also show a short human table TOPK for quick console view */
@@ -587,19 +672,36 @@ static void recv_cb(const linkaddr_t *originator, uint8_t hops)
     clock_time_t now = clock_time();
     clock_time_t ts = (clock_time_t)msg.timestamp;
     clock_time_t ul_delay = (now >= ts) ? (now - ts) : 0;
+#if APP_TM
+    tm_begin(&tm, TM_UL_DELAY);
+    tm_addr(&tm, originator);
+    tm_u8(&tm, hops);
+    tm_u32(&tm, ul_delay);
+    tm_end(&tm);
+#else
     APP_LOG("STAT,UL_DELAY,local=%02u:%02u,time=%lu,src=%02u:%02u,hops=%u,delay_ticks=%lu\n",
             linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
             (unsigned long)(now / CLOCK_SECOND),
             originator->u8[0], originator->u8[1],
             hops,
             (unsigned long)ul_delay);
+#endif
   }
 
   /* update neighbor table (include metric=hops for originator as seen by sink) */
   nei_update_from_rx(originator, msg.seqn, (int)hops);
 
+#if APP_TM
+  tm_begin(&tm, TM_UL_GOT);
+  tm_u16(&tm, msg.seqn);
+  tm_addr(&tm, originator);
+  tm_u8(&tm, hops);
+  tm_u16(&tm, my_collect.metric);
+  tm_end(&tm);
+#else
   APP_LOG("APP-UL[SINK]: got seq=%u from %02u:%02u hops=%u my_metric=%u\n",
           msg.seqn, originator->u8[0], originator->u8[1], hops, my_collect.metric);
+#endif
 
   /* Track path length changes to trigger a quick NEI dump (optional) */
   if (!last_hops_inited)
@@ -663,16 +765,32 @@ static void sr_recv_cb(struct my_collect_conn *ptr, uint8_t hops)
     clock_time_t ts = (clock_time_t)sr_msg.timestamp;
     clock_time_t dl_delay = (now >= ts) ? (now - ts) : 0;
     last_dl_delay_ticks_value = dl_delay;
+#if APP_TM
+    tm_begin(&tm, TM_DL_DELAY);
+    tm_u32(&tm, dl_delay);
+    tm_addr(&tm, &ptr->parent);
+    tm_end(&tm);
+#else
     APP_LOG("STAT,DL_DELAY,local=%02u:%02u,time=%lu,delay_ticks=%lu,parent=%02u:%02u\n",
             linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
             (unsigned long)(now / CLOCK_SECOND),
             (unsigned long)dl_delay,
             ptr->parent.u8[0], ptr->parent.u8[1]);
+#endif
   }
 
+#if APP_TM
+  tm_begin(&tm, TM_DL_GOT);
+  tm_u16(&tm, sr_msg.seqn);
+  tm_u8(&tm, hops);
+  tm_u16(&tm, ptr->metric);
+  tm_addr(&tm, &ptr->parent);
+  tm_end(&tm);
+#else
   APP_LOG("APP-DL[NODE %02u:%02u]: got SR seq=%u hops=%u my_metric=%u parent=%02u:%02u\n",
           linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
           sr_msg.seqn, hops, ptr->metric, ptr->parent.u8[0], ptr->parent.u8[1]);
+#endif
 
   /* PDR DL at node */
   pdr_dl_update(sr_msg.seqn);
@@ -754,6 +872,75 @@ uint16_t srdcp_app_last_dl_delay_ticks(void)
   return (uint16_t)last_dl_delay_ticks_value;
 }
 
+/*==================== Attempt counters ====================*/
+/**
+ * @brief Logs a DL send attempt at the SINK (STAT,DL_ATTEMPT, unified with RPL).
+ * @param target   The destination node.
+ * @param attempt  The attempt counter.
+ * @param route_ok 1 if a source route existed and the packet was sent.
+ * @param sent     The sent counter, only logged when route_ok is 1.
+ */
+static void dl_attempt_log(const linkaddr_t *target, uint16_t attempt, uint8_t route_ok, uint16_t sent)
+{
+#if SRDCP_TELEMETRY
+  tm_begin(&tm, TM_DL_ATTEMPT);
+  tm_u16(&tm, attempt);
+  tm_addr(&tm, target);
+  tm_u8(&tm, route_ok);
+  tm_u16(&tm, sent);
+  tm_end(&tm);
+#else
+  if (!route_ok)
+  {
+    printf("STAT,DL_ATTEMPT,time=%lu,attempt_seq=%u,target=%02u:%02u,route_ok=0\n",
+           (unsigned long)(clock_time() / CLOCK_SECOND),
+           (unsigned)attempt,
+           (unsigned)target->u8[0], (unsigned)target->u8[1]);
+  }
+  else
+  {
+    printf("STAT,DL_ATTEMPT,time=%lu,attempt_seq=%u,target=%02u:%02u,route_ok=1,sent_seq=%u\n",
+           (unsigned long)(clock_time() / CLOCK_SECOND),
+           (unsigned)attempt,
+           (unsigned)target->u8[0], (unsigned)target->u8[1],
+           (unsigned)sent);
+  }
+#endif
+}
+
+/**
+ * @brief Logs a UL send attempt at a NODE (STAT,UL_ATTEMPT, unified with RPL).
+ * @param attempt  The attempt counter.
+ * @param route_ok 1 if the node had a parent and the packet was sent.
+ * @param sent     The sent counter, only logged when route_ok is 1.
+ */
+static void ul_attempt_log(uint16_t attempt, uint8_t route_ok, uint16_t sent)
+{
+#if SRDCP_TELEMETRY
+  tm_begin(&tm, TM_UL_ATTEMPT);
+  tm_u16(&tm, attempt);
+  tm_u8(&tm, route_ok);
+  tm_u16(&tm, sent);
+  tm_end(&tm);
+#else
+  if (!route_ok)
+  {
+    printf("STAT,UL_ATTEMPT,time=%lu,source=%02u:%02u,attempt_seq=%u,route_ok=0\n",
+           (unsigned long)(clock_time() / CLOCK_SECOND),
+           (unsigned)linkaddr_node_addr.u8[0], (unsigned)linkaddr_node_addr.u8[1],
+           (unsigned)attempt);
+  }
+  else
+  {
+    printf("STAT,UL_ATTEMPT,time=%lu,source=%02u:%02u,attempt_seq=%u,route_ok=1,sent_seq=%u\n",
+           (unsigned long)(clock_time() / CLOCK_SECOND),
+           (unsigned)linkaddr_node_addr.u8[0], (unsigned)linkaddr_node_addr.u8[1],
+           (unsigned)attempt,
+           (unsigned)sent);
+  }
+#endif
+}
+
 /*==================== PROCESS ====================*/
 PROCESS(example_runicast_srdcp_process, "SRDCP-integrated runicast example");
 AUTOSTART_PROCESSES(&example_runicast_srdcp_process);
@@ -765,6 +952,12 @@ PROCESS_THREAD(example_runicast_srdcp_process, ev, data)
   static test_msg_t msg;
   static linkaddr_t dest;
   static int ret;
+#if APP_DL_MULTI
+  static linkaddr_t multi_dest[APP_DL_BATCH];
+  static test_msg_t multi_msg[APP_DL_BATCH];
+  static uint8_t multi_ok[APP_DL_BATCH];
+  int k;
+#endif
 
   /* UL attempts tracking (like RPL, for consistent metrics) */
   static uint16_t ul_attempt_seq = 0;  /* Total UL attempts */
@@ -813,6 +1006,10 @@ PROCESS_THREAD(example_runicast_srdcp_process, ev, data)
     nei_tab[i].used = 0;
 
   powertrace_start(CLOCK_SECOND * 10);
+#if SRDCP_TELEMETRY
+  telemetry_init();
+#endif
+  prof_init(); /* STAT,PROF tables, no-op without PROF_CONF_ON */
   csv_print_headers_once();
 
   if (linkaddr_cmp(&linkaddr_node_addr, &sink_addr))
@@ -821,6 +1018,9 @@ PROCESS_THREAD(example_runicast_srdcp_process, ev, data)
     APP_LOG("APP-ROLE[SINK]: started (local=%02u:%02u)\n",
             linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
 
+#if SRDCP_SINK_IMAGE
+    SINK_STORE_USE_POOLS();
+#endif
     my_collect_open(&my_collect, COLLECT_CHANNEL, true, &sink_cb);
     APP_LOG("CSV,INFO,local=%02u:%02u,%lu,SINK,%02u:%02u,%u\n",
             linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
@@ -852,6 +1052,49 @@ PROCESS_THREAD(example_runicast_srdcp_process, ev, data)
         etimer_set(&rnd, (uint16_t)(random_rand() % (SR_MSG_PERIOD / 2)));
         PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&rnd));
 
+#if APP_DL_MULTI
+        /* next APP_DL_BATCH destinations of the 2..APP_NODES rotation */
+        for (k = 0; k < APP_DL_BATCH; k++)
+        {
+          linkaddr_copy(&multi_dest[k], &dest);
+          multi_msg[k].seqn = dl_seq_per_dest[dest.u8[0]] + 1;
+          multi_msg[k].timestamp = clock_time();
+          dest.u8[0] = (dest.u8[0] < APP_NODES) ? dest.u8[0] + 1 : 0x02;
+        }
+        memset(multi_ok, 0, sizeof(multi_ok));
+        ret = sr_send_multi(&my_collect, multi_dest, multi_msg, sizeof(test_msg_t), APP_DL_BATCH, multi_ok);
+        if (ret == 0)
+          ret = 1; /* never stall the rotation */
+        /* destinations that did not fit are retried first next period */
+        if (ret < APP_DL_BATCH)
+          linkaddr_copy(&dest, &multi_dest[ret]);
+
+        for (k = 0; k < ret; k++)
+        {
+          dl_seq_per_dest[multi_dest[k].u8[0]] = multi_msg[k].seqn;
+          dl_attempt_seq++;
+#if APP_TM
+          tm_begin(&tm, TM_DL_SEND);
+          tm_u16(&tm, multi_msg[k].seqn);
+          tm_addr(&tm, &multi_dest[k]);
+          tm_u8(&tm, 1);
+          tm_end(&tm);
+#else
+          APP_LOG("APP-DL[SINK]: send SR seq=%u -> %02u:%02u (multi)\n",
+                  multi_msg[k].seqn, multi_dest[k].u8[0], multi_dest[k].u8[1]);
+#endif
+          if (!multi_ok[k])
+          {
+            APP_LOG("ERR,SINK,sr_send,seq=%u,dst=%02u:%02u\n", multi_msg[k].seqn, multi_dest[k].u8[0], multi_dest[k].u8[1]);
+            dl_attempt_log(&multi_dest[k], dl_attempt_seq, 0, 0);
+          }
+          else
+          {
+            dl_sent_count++;
+            dl_attempt_log(&multi_dest[k], dl_attempt_seq, 1, dl_sent_count);
+          }
+        }
+#else
         packetbuf_clear();
         /* per-destination seq so each target sees contiguous seq */
         msg.seqn = ++dl_seq_per_dest[dest.u8[0]];
@@ -861,28 +1104,29 @@ PROCESS_THREAD(example_runicast_srdcp_process, ev, data)
         /* Track total attempts (like RPL dl_attempt_seq) */
         dl_attempt_seq++;
         
+#if APP_TM
+        tm_begin(&tm, TM_DL_SEND);
+        tm_u16(&tm, msg.seqn);
+        tm_addr(&tm, &dest);
+        tm_u8(&tm, 0);
+        tm_end(&tm);
+#else
         APP_LOG("APP-DL[SINK]: send SR seq=%u -> %02u:%02u\n",
                 msg.seqn, dest.u8[0], dest.u8[1]);
+#endif
 
         ret = sr_send(&my_collect, &dest);
         if (ret == 0)
         {
           /* No route - log attempt with route_ok=0 (like RPL) */
           APP_LOG("ERR,SINK,sr_send,seq=%u,dst=%02u:%02u\n", msg.seqn, dest.u8[0], dest.u8[1]);
-          printf("STAT,DL_ATTEMPT,time=%lu,attempt_seq=%u,target=%02u:%02u,route_ok=0\n",
-                 (unsigned long)(clock_time() / CLOCK_SECOND),
-                 (unsigned)dl_attempt_seq,
-                 (unsigned)dest.u8[0], (unsigned)dest.u8[1]);
+          dl_attempt_log(&dest, dl_attempt_seq, 0, 0);
         }
         else
         {
           /* Route exists - packet sent (like RPL route_ok=1) */
           dl_sent_count++;
-          printf("STAT,DL_ATTEMPT,time=%lu,attempt_seq=%u,target=%02u:%02u,route_ok=1,sent_seq=%u\n",
-                 (unsigned long)(clock_time() / CLOCK_SECOND),
-                 (unsigned)dl_attempt_seq,
-                 (unsigned)dest.u8[0], (unsigned)dest.u8[1],
-                 (unsigned)dl_sent_count);
+          dl_attempt_log(&dest, dl_attempt_seq, 1, dl_sent_count);
         }
 
         /* rotate 2..APP_NODES */
@@ -890,6 +1134,7 @@ PROCESS_THREAD(example_runicast_srdcp_process, ev, data)
           dest.u8[0]++;
         else
           dest.u8[0] = 0x02;
+#endif /* APP_DL_MULTI */
       }
 
       if (etimer_expired(&nei_tick))
@@ -977,25 +1222,26 @@ PROCESS_THREAD(example_runicast_srdcp_process, ev, data)
         {
           /* No parent - log attempt with route_ok=0 (like RPL) */
           APP_LOG("ERR,NODE,my_collect_send,seq=%u\n", ul_sent_count);
-          printf("STAT,UL_ATTEMPT,time=%lu,source=%02u:%02u,attempt_seq=%u,route_ok=0\n",
-                 (unsigned long)(clock_time() / CLOCK_SECOND),
-                 (unsigned)linkaddr_node_addr.u8[0], (unsigned)linkaddr_node_addr.u8[1],
-                 (unsigned)ul_attempt_seq);
+          ul_attempt_log(ul_attempt_seq, 0, 0);
         }
         else
         {
           /* Parent exists - packet sent (like RPL route_ok=1) */
           /* Log only when actually sent (consistent with RPL) */
+#if APP_TM
+          tm_begin(&tm, TM_UL_SEND);
+          tm_u16(&tm, msg.seqn);
+          tm_u16(&tm, my_collect.metric);
+          tm_addr(&tm, &my_collect.parent);
+          tm_end(&tm);
+#else
           APP_LOG("APP-UL[NODE %02u:%02u]: send seq=%u metric=%u parent=%02u:%02u\n",
                   linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
                   msg.seqn, my_collect.metric, my_collect.parent.u8[0], my_collect.parent.u8[1]);
+#endif
           
           ul_sent_count++;  /* Increment sent count (becomes new seq for next send) */
-          printf("STAT,UL_ATTEMPT,time=%lu,source=%02u:%02u,attempt_seq=%u,route_ok=1,sent_seq=%u\n",
-                 (unsigned long)(clock_time() / CLOCK_SECOND),
-                 (unsigned)linkaddr_node_addr.u8[0], (unsigned)linkaddr_node_addr.u8[1],
-                 (unsigned)ul_attempt_seq,
-                 (unsigned)ul_sent_count);
+          ul_attempt_log(ul_attempt_seq, 1, ul_sent_count);
         }
       }
 
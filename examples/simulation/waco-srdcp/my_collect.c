@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include "contiki.h"
 #include "lib/random.h"
+#include "sys/energest.h"
+#include "sys/prof.h"
 #include "net/rime/rime.h"
 #include "leds.h"
 #include "net/netstack.h"
@@ -12,6 +14,10 @@
 #include "my_collect.h"
 #include "routing_table.h"
 #include "topology_report.h"
+#include "sink_store.h"
+#include "source_route.h"
+#include "piggy_codec.h"
+#include "net/mac/wurrdc.h"
 
 /* ------------------------------------ LOG Tags / Helper ------------------------------------ */
 #define TAG_BEACON "BEACON"
@@ -61,7 +67,17 @@ const linkaddr_t sink_addr = {{0x01, 0x00}};
 #ifndef MIN_PARENT_DWELL
 #define MIN_PARENT_DWELL (30 * CLOCK_SECOND)
 #endif
-/* Parent timeout (no beacon from parent for too long -> stale) */
+/* Parent timeout (no beacon from parent for too long -> stale).
+ * With Trickle a node may only beacon once per epoch (the other
+ * transmissions can be suppressed), so the timeouts follow the epoch. */
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+#ifndef PARENT_TIMEOUT
+#define PARENT_TIMEOUT (2 * SRDCP_TRICKLE_EPOCH)
+#endif
+#ifndef SRDCP_NEIGHBOR_STALE_TICKS
+#define SRDCP_NEIGHBOR_STALE_TICKS (2 * SRDCP_TRICKLE_EPOCH)
+#endif
+#endif
 #ifndef PARENT_TIMEOUT
 #define PARENT_TIMEOUT (4 * BEACON_INTERVAL)
 #endif
@@ -85,10 +101,46 @@ typedef struct
 
 static prr_entry_t prr_tab[PRR_NEI_MAX];
 
+/* Node index over prr_tab (power of two, at least 2 * PRR_NEI_MAX).
+ * Footprint at NODE_INDEX_ENTRY_BYTES = 2: 128 B here with the default
+ * PRR_NEI_MAX = 24; the sink also keeps two SRDCP_NODE_INDEX_BUCKETS
+ * indexes (parent table and graph), 128 B each at MAX_NODES = 30. */
+#if PRR_NEI_MAX <= 16
+#define PRR_INDEX_BUCKETS 32
+#elif PRR_NEI_MAX <= 32
+#define PRR_INDEX_BUCKETS 64
+#elif PRR_NEI_MAX <= 64
+#define PRR_INDEX_BUCKETS 128
+#else
+#define PRR_INDEX_BUCKETS 256
+#endif
+static node_index_entry prr_index[PRR_INDEX_BUCKETS];
+
+/* The node index is keyed on the low address byte only: an address with a
+ * non-zero high byte (or a zero low byte) would share or miss a bucket, so
+ * such neighbors are not tracked */
+#define PRR_ADDR_INDEXABLE(addr) ((addr)->u8[0] != 0 && (addr)->u8[1] == 0)
+
+/**
+ * @brief Finds the PRR entry of a neighbor through the node index.
+ * @param addr The address of the neighbor.
+ * @return A pointer to the entry, or NULL if the neighbor is unknown.
+ */
+static prr_entry_t *prr_find(const linkaddr_t *addr)
+{
+        if (!PRR_ADDR_INDEXABLE(addr))
+                return NULL;
+        int i = node_index_find(prr_index, NODE_INDEX_COUNT(prr_index), addr);
+        if (i < 0 || i >= PRR_NEI_MAX || !prr_tab[i].used || !linkaddr_cmp(&prr_tab[i].addr, addr))
+                return NULL;
+        return &prr_tab[i];
+}
+
 /**
  * @brief Finds or adds an entry for a neighbor in the PRR statistics table.
  * @param addr The address of the neighbor.
- * @return A pointer to the neighbor's PRR entry.
+ * @return A pointer to the neighbor's PRR entry, or NULL if the address
+ *         cannot be indexed (see PRR_ADDR_INDEXABLE).
  * @details If the table is full, it replaces the entry with the lowest
  *          `expected` beacon count to keep the table populated with active
  *          neighbors.
@@ -96,29 +148,33 @@ static prr_entry_t prr_tab[PRR_NEI_MAX];
 static prr_entry_t *prr_lookup_or_add(const linkaddr_t *addr)
 {
         int i;
-        int free_i = -1;
+        if (!PRR_ADDR_INDEXABLE(addr))
+                return NULL;
+        prr_entry_t *e = prr_find(addr);
+        if (e)
+                return e;
+        int victim = -1;
         for (i = 0; i < PRR_NEI_MAX; i++)
         {
-                if (prr_tab[i].used && linkaddr_cmp(&prr_tab[i].addr, addr))
-                        return &prr_tab[i];
-                if (!prr_tab[i].used && free_i < 0)
-                        free_i = i;
+                if (!prr_tab[i].used)
+                {
+                        victim = i;
+                        break;
+                }
         }
-        if (free_i >= 0)
+        if (victim < 0)
         {
-                memset(&prr_tab[free_i], 0, sizeof(prr_tab[free_i]));
-                prr_tab[free_i].used = 1;
-                linkaddr_copy(&prr_tab[free_i].addr, addr);
-                return &prr_tab[free_i];
+                /* replace the one with smallest expected to keep table fresh */
+                victim = 0;
+                for (i = 1; i < PRR_NEI_MAX; i++)
+                        if (prr_tab[i].expected < prr_tab[victim].expected)
+                                victim = i;
+                node_index_remove(prr_index, NODE_INDEX_COUNT(prr_index), &prr_tab[victim].addr);
         }
-        /* replace the one with smallest expected to keep table fresh */
-        int victim = 0;
-        for (i = 1; i < PRR_NEI_MAX; i++)
-                if (prr_tab[i].expected < prr_tab[victim].expected)
-                        victim = i;
         memset(&prr_tab[victim], 0, sizeof(prr_tab[victim]));
         prr_tab[victim].used = 1;
         linkaddr_copy(&prr_tab[victim].addr, addr);
+        node_index_insert(prr_index, NODE_INDEX_COUNT(prr_index), addr, (uint8_t)victim);
         return &prr_tab[victim];
 }
 
@@ -134,6 +190,8 @@ static prr_entry_t *prr_update_on_beacon(const linkaddr_t *addr, uint16_t tx_seq
 {
         prr_entry_t *e = prr_lookup_or_add(addr);
         uint16_t delta = 0;
+        if (!e)
+                return NULL;
         if (e->expected == 0 && e->received == 0)
         {
                 /* first observation */
@@ -164,20 +222,13 @@ static prr_entry_t *prr_update_on_beacon(const linkaddr_t *addr, uint16_t tx_seq
  */
 static uint8_t prr_percent(const linkaddr_t *addr)
 {
-        int i;
-        for (i = 0; i < PRR_NEI_MAX; i++)
-        {
-                if (prr_tab[i].used && linkaddr_cmp(&prr_tab[i].addr, addr))
-                {
-                        if (prr_tab[i].expected == 0)
-                                return 0;
-                        uint32_t prr = (prr_tab[i].received * 100UL) / prr_tab[i].expected;
-                        if (prr > 100)
-                                prr = 100;
-                        return (uint8_t)prr;
-                }
-        }
-        return 0; /* unknown -> 0 */
+        prr_entry_t *e = prr_find(addr);
+        if (!e || e->expected == 0)
+                return 0; /* unknown -> 0 */
+        uint32_t prr = (e->received * 100UL) / e->expected;
+        if (prr > 100)
+                prr = 100;
+        return (uint8_t)prr;
 }
 
 /**
@@ -188,13 +239,8 @@ static uint8_t prr_percent(const linkaddr_t *addr)
  */
 static clock_time_t prr_last_seen_time(const linkaddr_t *addr)
 {
-        int i;
-        for (i = 0; i < PRR_NEI_MAX; i++)
-        {
-                if (prr_tab[i].used && linkaddr_cmp(&prr_tab[i].addr, addr))
-                        return prr_tab[i].last_seen;
-        }
-        return 0;
+        prr_entry_t *e = prr_find(addr);
+        return e ? e->last_seen : 0;
 }
 
 /**
@@ -210,6 +256,13 @@ uint8_t my_collect_prr_percent(const linkaddr_t *addr)
 /* Forward declarations (for clean initialization order) */
 void beacon_timer_cb(void *ptr);
 void send_beacon(struct my_collect_conn *conn);
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+static void beacon_trickle_cb(void *ptr, uint8_t tx_ok);
+#endif
+#if SRDCP_WUS_EPOCH_SUPPRESS
+static void beacon_wus_skipped(const linkaddr_t *sender, uint16_t epoch);
+static struct my_collect_conn *wus_epoch_conn;
+#endif
 void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender);
 void uc_recv(struct unicast_conn *uc_conn, const linkaddr_t *sender);
 
@@ -225,7 +278,108 @@ static void graph_update_status(struct my_collect_conn *conn, const srdcp_node_s
 
 bool check_address_in_piggyback_block(uint8_t piggy_len, linkaddr_t node);
 void forward_upward_data(struct my_collect_conn *conn, const linkaddr_t *sender);
+static void upward_data_input(struct my_collect_conn *conn, uint16_t held);
 void forward_downward_data(struct my_collect_conn *conn, const linkaddr_t *sender);
+static void forward_downward_tree(struct my_collect_conn *conn);
+#if SRDCP_UL_AGGREGATION
+static int ul_agg_enqueue(struct my_collect_conn *conn, const uint8_t *frame, uint16_t len, uint16_t held);
+static void forward_upward_aggregate(struct my_collect_conn *conn);
+#endif
+
+/*--------------------------------------------------------------------------------------*/
+/* Bytes of a unicast frame that are not SRDCP data: Rime header (chameleon),
+ * framer header and FCS, measured by uc_overhead_measure() at open */
+static uint8_t uc_overhead;
+
+/**
+ * @brief Measures the headers the stack puts around a unicast payload.
+ * @details Builds the Rime header of the unicast channel in an empty packetbuf
+ *          and asks the framer for its header length, as sicslowpan sizes its
+ *          fragments. Only called from my_collect_open(), with packetbuf free.
+ */
+static void uc_overhead_measure(struct my_collect_conn *conn)
+{
+        int framer_len;
+
+        packetbuf_clear();
+        packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+        packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &linkaddr_node_addr);
+        chameleon_create(&conn->uc.c.c.channel);
+        framer_len = NETSTACK_FRAMER.length();
+        uc_overhead = packetbuf_hdrlen() + (framer_len > 0 ? framer_len : 0) + 2 /* FCS */;
+        packetbuf_clear();
+}
+
+/**
+ * @brief Largest SRDCP unicast payload (SRDCP headers included) that the MAC
+ *        still sends as one frame.
+ */
+uint16_t my_collect_payload_max(void)
+{
+        return SRDCP_FRAME_MAX - uc_overhead;
+}
+
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+static void beacon_trickle_reset(struct my_collect_conn *conn);
+#endif
+
+/**
+ * @brief Sets the hop count of this node.
+ * @details Also handed to wurrdc, which matches it against the metric group
+ *          of a received WuS (SRDCP_WUS_BEACON_GROUP), unless the parent is
+ *          lost and wus_group_check_cb() opened the group to every beacon.
+ */
+static void set_metric(struct my_collect_conn *conn, uint16_t metric)
+{
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+        /* Our hop count changed: the neighborhood is inconsistent, advertise it */
+        if (metric != conn->metric && trickle_timer_is_running(&conn->beacon_tt))
+                beacon_trickle_reset(conn);
+#endif
+        conn->metric = metric;
+#if SRDCP_WUS_BEACON_GROUP
+        if (conn->wus_group_open)
+                return;
+#endif
+        wurrdc_set_wus_metric(metric);
+}
+
+#if SRDCP_WUS_BEACON_GROUP
+/**
+ * @brief Periodic parent check for the WuS metric group (nodes only).
+ * @param ptr Pointer to the my_collect_conn structure.
+ * @details While there is no parent, or it sent no beacon for PARENT_TIMEOUT,
+ *          wurrdc matches every metric group (0xffff): beacons from shallower
+ *          neighbors wake the node again and it can re-attach. This runs from a
+ *          timer rather than from bc_recv(), since a node sleeping through the
+ *          only beacons that could repair its route may receive none at all.
+ */
+static void wus_group_check_cb(void *ptr)
+{
+        struct my_collect_conn *conn = ptr;
+        bool lost = linkaddr_cmp(&conn->parent, &linkaddr_null);
+
+        if (!lost)
+        {
+                clock_time_t ls = prr_last_seen_time(&conn->parent);
+                lost = (ls == 0 || (clock_time_t)(clock_time() - ls) > PARENT_TIMEOUT);
+        }
+        if (lost && !conn->wus_group_open)
+        {
+                conn->wus_group_open = 1;
+                wurrdc_set_wus_metric(0xffff);
+                LOG(TAG_STAB, "parent lost: WuS metric group open");
+        }
+        else if (!lost && conn->wus_group_open)
+        {
+                conn->wus_group_open = 0;
+                wurrdc_set_wus_metric(conn->metric);
+                LOG(TAG_STAB, "parent %02u:%02u: WuS metric group=%u",
+                    conn->parent.u8[0], conn->parent.u8[1], (unsigned)conn->metric);
+        }
+        ctimer_set(&conn->wus_group_timer, SRDCP_WUS_GROUP_CHECK, wus_group_check_cb, conn);
+}
+#endif
 
 /*--------------------------------------------------------------------------------------*/
 /* Callback structures */
@@ -245,59 +399,212 @@ void my_collect_open(struct my_collect_conn *conn, uint16_t channels,
                      bool is_sink, const struct my_collect_callbacks *callbacks)
 {
         linkaddr_copy(&conn->parent, &linkaddr_null);
-        conn->metric = 65535; /* not connected yet */
+#if SRDCP_WUS_BEACON_GROUP
+        conn->wus_group_open = 0;
+#endif
+        set_metric(conn, 65535); /* not connected yet */
         conn->beacon_seqn = 0;
         conn->beacon_tx_seq = 0;
+        conn->beacon_tx_count = 0;
+        conn->beacon_suppressed = 0;
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+        conn->beacon_epoch_sent = 0;
+#endif
         conn->callbacks = callbacks;
         conn->treport_hold = 0;
         conn->is_sink = is_sink ? 1 : 0;
         conn->parent_lock_until = 0;
+        conn->sink = NULL;
+#if SRDCP_PIGGY_ADAPTIVE
+        memset(conn->piggy_stale, 0, sizeof(conn->piggy_stale));
+        conn->piggy_request = 0;
+#endif
 
         broadcast_open(&conn->bc, channels, &bc_cb);
+#if SRDCP_WUS_EPOCH_SUPPRESS
+        wus_epoch_conn = conn;
+        wurrdc_wus_epoch_open(&conn->parent, beacon_wus_skipped);
+#endif
         unicast_open(&conn->uc, channels + 1, &uc_cb);
+        uc_overhead_measure(conn);
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+        /* Nodes start their timer on the first beacon, the sink on its first epoch */
+        trickle_timer_config(&conn->beacon_tt, SRDCP_TRICKLE_IMIN, SRDCP_TRICKLE_IMAX, SRDCP_TRICKLE_K);
+#endif
 
         if (conn->is_sink)
         {
-                conn->metric = 0;
-                conn->routing_table.len = 0;
-                memset(&conn->graph, 0, sizeof(conn->graph));
+                set_metric(conn, 0);
+                sink_store_init();
+                conn->sink = sink_store_alloc();
+                if (conn->sink)
+                        (void)graph_lookup_or_create(&conn->sink->graph, &sink_addr);
                 ctimer_set(&conn->beacon_timer, CLOCK_SECOND, beacon_timer_cb, conn);
         }
+#if SRDCP_WUS_BEACON_GROUP
+        else
+        {
+                ctimer_set(&conn->wus_group_timer, SRDCP_WUS_GROUP_CHECK, wus_group_check_cb, conn);
+        }
+#endif
 }
 
 /* ------------------------------------ BEACON Management ------------------------------------ */
 
+#if SRDCP_BEACON_STATS
+/**
+ * @brief Prints the beacon counters of this node (STAT,BEACON), once per epoch.
+ */
+static void beacon_stats_print(const struct my_collect_conn *conn)
+{
+        printf("STAT,BEACON,node=%02u:%02u,time=%lu,mode=%s,epoch=%u,tx=%u,suppressed=%u,metric=%u,parent=%02u:%02u\n",
+               linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1], (unsigned long)clock_time(),
+               (SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE) ? "trickle" : "periodic",
+               (unsigned)conn->beacon_seqn, (unsigned)conn->beacon_tx_count, (unsigned)conn->beacon_suppressed,
+               (unsigned)conn->metric, conn->parent.u8[0], conn->parent.u8[1]);
+}
+#else
+#define beacon_stats_print(conn)
+#endif
+
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+/**
+ * @brief Trickle callback, at time t of the current interval.
+ * @param ptr   Pointer to the my_collect_conn structure.
+ * @param tx_ok TRICKLE_TIMER_TX_SUPPRESS if k consistent beacons were heard
+ *              in this interval.
+ * @note The first beacon of an epoch is never suppressed: children use it
+ *       to tell that their parent is alive (PARENT_TIMEOUT).
+ */
+static void beacon_trickle_cb(void *ptr, uint8_t tx_ok)
+{
+        struct my_collect_conn *conn = ptr;
+        if (tx_ok == TRICKLE_TIMER_TX_SUPPRESS && conn->beacon_epoch_sent)
+        {
+                conn->beacon_suppressed++;
+                LOG(TAG_BEACON, "suppressed (trickle)");
+                return;
+        }
+        send_beacon(conn);
+}
+
+/**
+ * @brief Starts the Trickle timer, or resets it to Imin if it is running.
+ * @details Called only on an inconsistency: the first beacon heard, a stale
+ *          parent, or a change of our hop count. A new epoch alone does not
+ *          reset the interval; beacon_epoch_sent makes the next firing send
+ *          anyway, so at Imax a parent is still heard well within PARENT_TIMEOUT.
+ */
+static void beacon_trickle_reset(struct my_collect_conn *conn)
+{
+        /* trickle_timer_set() starts with a random I in [Imin, Imax]: the
+         * first epoch (or the first beacon heard) should spread at Imin */
+        if (!trickle_timer_is_running(&conn->beacon_tt))
+                trickle_timer_set(&conn->beacon_tt, beacon_trickle_cb, conn);
+        trickle_timer_reset_event(&conn->beacon_tt);
+}
+#endif
+
 /**
  * @brief Beacon timer callback: sends a beacon and reschedules itself.
  * @param ptr Pointer to the my_collect_conn structure.
  * @note If it's the SINK, it reschedules the timer according to BEACON_INTERVAL
- *       and increments the sequence number.
+ *       and increments the sequence number. In Trickle mode the timer only
+ *       runs at the SINK: it starts a new epoch every SRDCP_TRICKLE_EPOCH and
+ *       the Trickle timer sends the beacons, without going back to Imin.
  */
 void beacon_timer_cb(void *ptr) // NOLINT(readability-non-const-parameter)
 {
         struct my_collect_conn *conn = ptr;
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+        conn->beacon_seqn = conn->beacon_seqn + 1;
+        conn->beacon_epoch_sent = 0;
+        beacon_stats_print(conn);
+        if (!trickle_timer_is_running(&conn->beacon_tt))
+                beacon_trickle_reset(conn);
+        ctimer_set(&conn->beacon_timer, SRDCP_TRICKLE_EPOCH, beacon_timer_cb, conn);
+#else
         send_beacon(conn);
         if (conn->is_sink == 1)
         {
                 ctimer_set(&conn->beacon_timer, BEACON_INTERVAL, beacon_timer_cb, conn);
                 conn->beacon_seqn = conn->beacon_seqn + 1;
+                beacon_stats_print(conn);
         }
+#endif
 }
 
+#if SRDCP_WUS_EPOCH_SUPPRESS
+/**
+ * @brief wurrdc kept the radio off for a beacon of an epoch already processed.
+ * @param sender Neighbor that sent the beacon.
+ * @param epoch  Its beacon_seqn.
+ * @details The beacon still counts as received for PRR(sender) (one WuS per
+ *          beacon, so tx_seq advances by one), and in Trickle mode as a
+ *          consistent transmission if it carries our epoch.
+ */
+static void beacon_wus_skipped(const linkaddr_t *sender, uint16_t epoch)
+{
+        struct my_collect_conn *conn = wus_epoch_conn;
+        prr_entry_t *e = prr_find(sender);
+
+        if (e != NULL && e->expected > 0)
+        {
+                e->last_tx_seq++;
+                e->expected++;
+                e->received++;
+                e->last_seen = clock_time();
+        }
+        LOG(TAG_BEACON, "skipped from=%02u:%02u seq=%u (epoch known)",
+            sender->u8[0], sender->u8[1], (unsigned)epoch);
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+        if (conn == NULL || !trickle_timer_is_running(&conn->beacon_tt))
+                return;
+        if (epoch == conn->beacon_seqn)
+                trickle_timer_consistency(&conn->beacon_tt);
+#else
+        (void)conn;
+#endif
+}
+#endif
+
 /**
  * @brief Sends an SRDCP beacon.
  * @param conn The collect connection structure.
  * @details Increments the tx_seq counter (per-sender) for neighbors to estimate PRR.
- *          The beacon payload consists of {seqn, tx_seq, metric}.
+ *          The beacon payload consists of {seqn, tx_seq, metric}, plus the stale
+ *          bitmap of the epoch with SRDCP_PIGGY_ADAPTIVE (built here by the SINK,
+ *          relayed unchanged by the nodes). With SRDCP_WUS_BEACON_GROUP the WuS
+ *          skips neighbors closer to the sink, which never choose a deeper parent.
  */
 void send_beacon(struct my_collect_conn *conn)
 {
         /* increase per-sender beacon counter for PRR estimation */
         conn->beacon_tx_seq++;
+        conn->beacon_tx_count++;
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+        conn->beacon_epoch_sent = 1;
+#endif
         struct beacon_msg beacon = {.seqn = conn->beacon_seqn, .tx_seq = conn->beacon_tx_seq, .metric = conn->metric};
+#if SRDCP_PIGGY_ADAPTIVE
+        if (conn->is_sink)
+        {
+                uint8_t flagged = graph_stale_bitmap(conn, conn->piggy_stale);
+                LOG(TAG_PIGGY, "stale request nodes=%u", (unsigned)flagged);
+        }
+        memcpy(beacon.stale, conn->piggy_stale, sizeof(beacon.stale));
+#endif
 
         packetbuf_clear();
         packetbuf_copyfrom(&beacon, sizeof(beacon));
+#if SRDCP_WUS_BEACON_GROUP
+        /* Only nodes at our hop count or deeper can use this beacon */
+        wurrdc_set_wus_target(WURRDC_WUS_METRIC, conn->metric, 0xffff);
+#endif
+#if SRDCP_WUS_EPOCH_SUPPRESS
+        wurrdc_set_wus_epoch_tag(conn->beacon_seqn);
+        wurrdc_set_wus_epoch(conn->beacon_seqn);
+#endif
         LOG(TAG_BEACON, "send seq=%u metric=%u", (unsigned)conn->beacon_seqn, (unsigned)conn->metric);
         broadcast_send(&conn->bc);
 }
@@ -321,9 +628,11 @@ void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender)
         struct my_collect_conn *conn =
             (struct my_collect_conn *)(((uint8_t *)bc_conn) - offsetof(struct my_collect_conn, bc));
 
+        PROF_ENTER(bc_recv);
         if (packetbuf_datalen() != sizeof(struct beacon_msg))
         {
                 LOG(TAG_BEACON, "drop (unexpected size=%u)", (unsigned)packetbuf_datalen());
+                PROF_EXIT(bc_recv);
                 return;
         }
         memcpy(&beacon, packetbuf_dataptr(), sizeof(struct beacon_msg));
@@ -340,6 +649,7 @@ void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender)
         if (rssi < RSSI_THRESHOLD)
         {
                 LOG(TAG_BEACON, "drop (rssi=%d < thr=%d)", (int)rssi, (int)RSSI_THRESHOLD);
+                PROF_EXIT(bc_recv);
                 return;
         }
 
@@ -377,12 +687,44 @@ void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender)
                             (unsigned long)(now - ls), (unsigned long)PARENT_TIMEOUT);
                 }
         }
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+        /* Same epoch: consistent. Only a stale parent (or the first beacon heard)
+         * sends us back to Imin here; a hop count change does so in set_metric().
+         * A new epoch is sent at the next firing of the current interval. */
+        if (conn->is_sink)
+        {
+                if (trickle_timer_is_running(&conn->beacon_tt) && beacon.seqn == conn->beacon_seqn)
+                        trickle_timer_consistency(&conn->beacon_tt);
+        }
+        else
+        {
+                if (beacon.seqn > conn->beacon_seqn)
+                        conn->beacon_epoch_sent = 0;
+                if (parent_stale || !trickle_timer_is_running(&conn->beacon_tt))
+                        beacon_trickle_reset(conn);
+                else if (beacon.seqn == conn->beacon_seqn)
+                        trickle_timer_consistency(&conn->beacon_tt);
+        }
+#endif
         if (conn->beacon_seqn < beacon.seqn)
         {
                 /* New tree epoch: update seq/metric; switch parent only if better hops or none */
                 uint16_t old_metric = conn->metric;
+                beacon_stats_print(conn);
                 conn->beacon_seqn = beacon.seqn;
-                conn->metric = new_metric;
+#if SRDCP_WUS_EPOCH_SUPPRESS
+                wurrdc_set_wus_epoch(conn->beacon_seqn);
+#endif
+                set_metric(conn, new_metric);
+#if SRDCP_PIGGY_ADAPTIVE
+                memcpy(conn->piggy_stale, beacon.stale, sizeof(conn->piggy_stale));
+                if (linkaddr_node_addr.u8[0] < SRDCP_PIGGY_STALE_BYTES * 8 &&
+                    (beacon.stale[linkaddr_node_addr.u8[0] / 8] & (1 << (linkaddr_node_addr.u8[0] % 8))))
+                {
+                        conn->piggy_request = 1;
+                        LOG(TAG_PIGGY, "sink requests a report (epoch %u)", (unsigned)beacon.seqn);
+                }
+#endif
 
                 if (linkaddr_cmp(&conn->parent, &linkaddr_null))
                 {
@@ -461,7 +803,7 @@ void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender)
                         }
                         else
                         {
-                                conn->metric = new_metric;
+                                set_metric(conn, new_metric);
                                 if (!linkaddr_cmp(&conn->parent, sender))
                                 {
                                         linkaddr_copy(&conn->parent, sender);
@@ -506,6 +848,7 @@ void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender)
                 else
                 {
                         LOG(TAG_COLLECT, "ignore beacon (worse hops: my=%u, neigh+1=%u)", (unsigned)conn->metric, (unsigned)new_metric);
+                        PROF_EXIT(bc_recv);
                         return;
                 }
 
@@ -518,18 +861,96 @@ void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender)
                 }
         }
 
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_PERIODIC
         /* forward beacon after a small random delay */
         ctimer_set(&conn->beacon_timer, BEACON_FORWARD_DELAY, beacon_timer_cb, conn);
         LOG(TAG_COLLECT, "schedule beacon forward after %u ticks", (unsigned)BEACON_FORWARD_DELAY);
+#endif
+        PROF_EXIT(bc_recv);
 }
 
 /* ------------------------------------ Send / Receive ------------------------------------ */
 
+#if SRDCP_PIGGY_VERSION >= 2
+/* Last status report sent, for the v2 delta encoding */
+static piggy_status_tx piggy_status_state;
+#endif
+
+#if SRDCP_PIGGY_ADAPTIVE
+/* Neighborhood sent in the last piggyback report */
+static struct
+{
+        srdcp_piggy_neighbor_item items[SRDCP_PIGGY_MAX_NEIGHBORS];
+        uint8_t count;
+        uint8_t metric;
+        uint8_t valid;
+        clock_time_t time;
+} piggy_last;
+
+/**
+ * @brief Compares the neighborhood with the last report.
+ * @return true if a neighbor appeared or left, if the hop count changed, or if
+ *         the PRR/RSSI of a neighbor moved by SRDCP_PIGGY_PRR_DELTA/_RSSI_DELTA.
+ */
+static bool piggy_neighbors_changed(const srdcp_piggy_neighbor_item *items, uint8_t count, uint8_t metric)
+{
+        uint8_t i, j;
+        if (count != piggy_last.count || metric != piggy_last.metric)
+                return true;
+        for (i = 0; i < count; i++)
+        {
+                for (j = 0; j < piggy_last.count; j++)
+                        /* Packed items: compare the bytes, not through linkaddr_t pointers */
+                        if (memcmp(&items[i].neighbor, &piggy_last.items[j].neighbor, LINKADDR_SIZE) == 0)
+                                break;
+                if (j == piggy_last.count)
+                        return true;
+                if (abs((int)items[i].prr - (int)piggy_last.items[j].prr) >= SRDCP_PIGGY_PRR_DELTA ||
+                    abs((int)items[i].rssi - (int)piggy_last.items[j].rssi) >= SRDCP_PIGGY_RSSI_DELTA)
+                        return true;
+        }
+        return false;
+}
+
+/**
+ * @brief Decides whether this UL carries the neighbor/status TLVs.
+ * @details Yes if the sink flagged this node in its last beacon, if the
+ *          neighborhood changed, or if no report was sent for
+ *          SRDCP_PIGGY_REFRESH_MAX. The snapshot is updated when it says yes.
+ */
+static bool piggy_should_attach(struct my_collect_conn *conn, const srdcp_piggy_neighbor_item *items,
+                                uint8_t count, uint8_t metric)
+{
+        clock_time_t now = clock_time();
+        if (!conn->piggy_request && piggy_last.valid &&
+            (clock_time_t)(now - piggy_last.time) < SRDCP_PIGGY_REFRESH_MAX &&
+            !piggy_neighbors_changed(items, count, metric))
+        {
+                LOG(TAG_PIGGY, "UL piggy skipped (sink data fresh)");
+                return false;
+        }
+        LOG(TAG_PIGGY, "UL piggy attached (request=%u)", (unsigned)conn->piggy_request);
+#if SRDCP_PIGGY_VERSION >= 2
+        /* Asked by the sink: its copy may be out of sync, send a keyframe */
+        if (conn->piggy_request)
+                piggy_status_state.valid = 0;
+#endif
+        memcpy(piggy_last.items, items, count * sizeof(srdcp_piggy_neighbor_item));
+        piggy_last.count = count;
+        piggy_last.metric = metric;
+        piggy_last.valid = 1;
+        piggy_last.time = now;
+        conn->piggy_request = 0;
+        return true;
+}
+#endif
+
 /**
  * @brief Sends UL (uplink) data from a NODE to its parent.
  * @param conn The collect connection structure.
  * @return Non-zero on success; 0 if there is no parent.
  * @note Can piggyback (node, parent) information for the SINK to learn the topology.
+ *       The neighbor/status TLVs are only attached when needed (SRDCP_PIGGY_ADAPTIVE).
  */
 int my_collect_send(struct my_collect_conn *conn)
 {
@@ -576,36 +997,83 @@ int my_collect_send(struct my_collect_conn *conn)
                     .dl_delay = srdcp_app_last_dl_delay_ticks(),
                     .flags = 0};
 
+#if SRDCP_PIGGY_ADAPTIVE
+                const bool attach = piggy_should_attach(conn, nei_items, neighbor_count, status.metric);
+#else
+                const bool attach = true;
+#endif
+
+#if SRDCP_PIGGY_VERSION >= 2
+                /* Status first: the sink applies its queue load to the neighbors */
+                uint8_t ctrl[PIGGY_STATUS_V2_MAX + PIGGY_NEIGHBORS_V2_MAX(SRDCP_PIGGY_MAX_NEIGHBORS)];
+                uint8_t ctrl_len = 0;
+                uint8_t tlv_count = 0;
+                if (attach)
+                {
+                        uint8_t n = piggy_status_encode(&piggy_status_state, &status, ctrl, sizeof(ctrl));
+                        ctrl_len = n;
+                        tlv_count += (n > 0);
+                        if (neighbor_count > 0)
+                        {
+                                n = piggy_neighbors_encode(nei_items, neighbor_count, ctrl + ctrl_len,
+                                                           (uint8_t)(sizeof(ctrl) - ctrl_len));
+                                ctrl_len += n;
+                                tlv_count += (n > 0);
+                        }
+                }
+                const size_t tlv_total = ctrl_len;
+#else
                 size_t neighbor_payload_len = 0;
-                if (neighbor_count > 0)
+                if (attach && neighbor_count > 0)
                 {
                         neighbor_payload_len = sizeof(linkaddr_t) + sizeof(uint8_t) + sizeof(uint8_t) +
                                                neighbor_count * sizeof(srdcp_piggy_neighbor_item);
                 }
-                const size_t status_payload_len = sizeof(srdcp_node_status);
+                const size_t status_payload_len = attach ? sizeof(srdcp_node_status) : 0;
 
                 size_t tlv_total = 0;
+                uint8_t tlv_count = 0;
                 if (neighbor_payload_len > 0)
+                {
                         tlv_total += sizeof(srdcp_piggy_tlv) + neighbor_payload_len;
-                tlv_total += sizeof(srdcp_piggy_tlv) + status_payload_len;
+                        tlv_count++;
+                }
+                if (status_payload_len > 0)
+                {
+                        tlv_total += sizeof(srdcp_piggy_tlv) + status_payload_len;
+                        tlv_count++;
+                }
+#endif
+                hdr.piggy_len |= UL_PIGGY_SET_TLVS(tlv_count);
 
                 const size_t header_total =
-                    sizeof(enum packet_type) + sizeof(upward_data_packet_header) + sizeof(tree_connection) + tlv_total;
+                    sizeof(enum packet_type) + sizeof(upward_data_packet_header) + tlv_total;
 
-                if (!packetbuf_hdralloc((int)header_total))
+                if (packetbuf_totlen() + header_total + sizeof(tree_connection) > my_collect_payload_max() ||
+                    !packetbuf_hdralloc((int)header_total))
                 {
                         LOG(TAG_PIGGY, "drop (hdralloc fail) header_total=%u", (unsigned)header_total);
                         return 0;
                 }
 
+                /* The (node, parent) list is a trailer: forwarders append their entry in place */
+                {
+                        uint16_t len = packetbuf_datalen();
+                        memcpy((uint8_t *)packetbuf_dataptr() + len, &tc, sizeof(tree_connection));
+                        packetbuf_set_datalen((uint16_t)(len + sizeof(tree_connection)));
+                }
+
                 uint8_t *ptr = packetbuf_hdrptr();
                 memcpy(ptr, &pt, sizeof(enum packet_type));
                 ptr += sizeof(enum packet_type);
                 memcpy(ptr, &hdr, sizeof(upward_data_packet_header));
                 ptr += sizeof(upward_data_packet_header);
-                memcpy(ptr, &tc, sizeof(tree_connection));
-                ptr += sizeof(tree_connection);
 
+#if SRDCP_PIGGY_VERSION >= 2
+                memcpy(ptr, ctrl, ctrl_len);
+                LOG(TAG_PIGGY, "UL piggy v2 neighbors=%u queue=%u bytes=%u",
+                    (unsigned)neighbor_count, (unsigned)queue_load, (unsigned)ctrl_len);
+#else
                 if (neighbor_payload_len > 0)
                 {
                         srdcp_piggy_tlv tlv = {.type = SRDCP_PIGGY_TLV_NEIGHBORS, .length = (uint8_t)neighbor_payload_len};
@@ -626,6 +1094,7 @@ int my_collect_send(struct my_collect_conn *conn)
                         }
                 }
 
+                if (status_payload_len > 0)
                 {
                         srdcp_piggy_tlv tlv = {.type = SRDCP_PIGGY_TLV_STATUS, .length = (uint8_t)status_payload_len};
                         memcpy(ptr, &tlv, sizeof(tlv));
@@ -636,6 +1105,7 @@ int my_collect_send(struct my_collect_conn *conn)
                             (unsigned)status.battery_mv, (unsigned)status.queue_load,
                             (unsigned)status.metric);
                 }
+#endif
         }
         else
         {
@@ -645,7 +1115,12 @@ int my_collect_send(struct my_collect_conn *conn)
                 memcpy(packetbuf_hdrptr() + sizeof(enum packet_type),
                        &hdr, sizeof(upward_data_packet_header));
         }
+#if SRDCP_UL_AGGREGATION
+        packetbuf_compact();
+        return ul_agg_enqueue(conn, packetbuf_hdrptr(), packetbuf_totlen(), 0);
+#else
         return unicast_send(&conn->uc, &conn->parent);
+#endif
 }
 
 /**
@@ -653,11 +1128,12 @@ int my_collect_send(struct my_collect_conn *conn)
  * @param conn The collect connection structure (at the SINK).
  * @param dest The destination address.
  * @return Non-zero on success; 0 if no route is found.
- * @details Finds a route using the parent dictionary at the SINK and packs the full path into the header.
+ * @details Finds a route using the parent dictionary at the SINK and packs the full path into the header
+ *          using the SRDCP_SR_ENCODING source-route encoding (see source_route.h).
  */
 int sr_send(struct my_collect_conn *conn, const linkaddr_t *dest)
 {
-        if (!conn->is_sink)
+        if (!conn->is_sink || !conn->sink)
                 return 0;
 
         int path_len = find_route(conn, dest);
@@ -668,26 +1144,227 @@ int sr_send(struct my_collect_conn *conn, const linkaddr_t *dest)
                 return 0;
         }
 
+        /* Route on the wire: next hop first, destination last */
+        linkaddr_t hops[MAX_PATH_LENGTH];
+        int i;
+        for (i = 0; i < path_len; i++)
+                linkaddr_copy(&hops[i], &conn->sink->routing_table.tree_path[path_len - 1 - i]);
+
+        uint8_t enc = source_route_pick(hops, (uint8_t)path_len);
+        uint8_t width = (enc == SRDCP_SR_ENC_PACKED) ? source_route_width(hops, (uint8_t)path_len) : 0;
+        uint8_t route_size = source_route_size(enc, width, (uint8_t)path_len);
         enum packet_type pt = downward_data_packet;
-        downward_data_packet_header hdr = {.hops = 0, .path_len = path_len};
+        downward_data_packet_header hdr = {.hops = 0, .path_len = SRDCP_SR_PATH_LEN(enc, path_len)};
 
-        packetbuf_hdralloc(sizeof(enum packet_type) +
-                           sizeof(downward_data_packet_header) +
-                           sizeof(linkaddr_t) * path_len);
+        size_t hdr_size = sizeof(enum packet_type) + sizeof(downward_data_packet_header) + route_size;
+        if (packetbuf_totlen() + hdr_size > my_collect_payload_max() ||
+            !packetbuf_hdralloc(hdr_size))
+        {
+                LOG(TAG_SRDCP, "route to %02u:%02u too long for header (len=%d, downlink dropped)",
+                    dest->u8[0], dest->u8[1], path_len);
+                return 0;
+        }
         memcpy(packetbuf_hdrptr(), &pt, sizeof(enum packet_type));
         memcpy(packetbuf_hdrptr() + sizeof(enum packet_type),
                &hdr, sizeof(downward_data_packet_header));
+        source_route_write(packetbuf_hdrptr() + sizeof(enum packet_type) + sizeof(downward_data_packet_header),
+                           enc, hops, (uint8_t)path_len);
+        LOG(TAG_SRDCP, "DL route enc=%u len=%d width=%u bytes=%u",
+            (unsigned)enc, path_len, (unsigned)width, (unsigned)route_size);
+        return unicast_send(&conn->uc, &hops[0]);
+}
 
-        int i;
-        for (i = path_len - 1; i >= 0; i--)
+/* Upper bound of the branching route (tree nodes fit in the 6-bit length) */
+#define SR_TREE_MAX_NODES SRDCP_SR_LEN_MASK
+#define SR_TREE_ROOT 0xFF /* parent index of the sink's children */
+
+static uint8_t sr_tree_id[SR_TREE_MAX_NODES];
+static uint8_t sr_tree_parent[SR_TREE_MAX_NODES];
+static uint8_t sr_frame[SRDCP_FRAME_MAX];
+
+/**
+ * @brief Serializes the subtree rooted at index 'root' in pre-order.
+ * @return The number of tree nodes written to 'out'.
+ */
+static uint8_t sr_tree_serialize(uint8_t n, uint8_t root, source_route_tree_node *out)
+{
+        uint8_t stack[SR_TREE_MAX_NODES];
+        uint8_t top = 0;
+        uint8_t written = 0;
+        uint8_t i;
+
+        stack[top++] = root;
+        while (top > 0)
         {
-                memcpy(packetbuf_hdrptr() + sizeof(enum packet_type) +
-                           sizeof(downward_data_packet_header) +
-                           sizeof(linkaddr_t) * (path_len - (i + 1)),
-                       &conn->routing_table.tree_path[i],
-                       sizeof(linkaddr_t));
+                uint8_t v = stack[--top];
+                out[written].id = sr_tree_id[v];
+                out[written].children = 0;
+                for (i = 0; i < n; i++)
+                {
+                        if (sr_tree_parent[i] == v)
+                        {
+                                out[written].children++;
+                                stack[top++] = i;
+                        }
+                }
+                written++;
         }
-        return unicast_send(&conn->uc, &conn->routing_table.tree_path[path_len - 1]);
+        return written;
+}
+
+/**
+ * @brief Checks whether a node id is part of a serialized subtree.
+ */
+static bool sr_tree_contains(const source_route_tree_node *tree, uint8_t len, uint8_t id)
+{
+        uint8_t i;
+        for (i = 0; i < len; i++)
+        {
+                if (tree[i].id == id)
+                        return true;
+        }
+        return false;
+}
+
+/**
+ * @brief Sends one payload per destination in a single source-routed frame per sink child.
+ * @param conn        The collect connection structure (at the SINK).
+ * @param dests       The destination addresses, in priority order.
+ * @param payloads    count * payload_len bytes, one payload per destination.
+ * @param payload_len The size of each payload.
+ * @param count       The number of destinations.
+ * @param route_ok    Set per consumed destination: 1 if its frame was handed to
+ *                    the MAC, 0 if it has no route or the send failed.
+ * @return The number of destinations consumed from the front of dests.
+ * @details Routes are merged into a tree rooted at the sink (graph route with
+ *          tree fallback, as for sr_send()). Destinations are added in order
+ *          until the frame would exceed the MAC payload, a route conflicts with
+ *          a branch already in the tree or SR_TREE_MAX_NODES destinations are
+ *          bundled; the remaining ones are left to the caller.
+ */
+int sr_send_multi(struct my_collect_conn *conn, const linkaddr_t *dests, const void *payloads,
+                  uint8_t payload_len, uint8_t count, uint8_t *route_ok)
+{
+        const size_t base_hdr = sizeof(enum packet_type) + sizeof(downward_data_packet_header);
+        uint8_t bundled[SR_TREE_MAX_NODES];
+        uint8_t n_bundled = 0;
+        uint8_t n = 0;
+        uint8_t consumed;
+
+        if (!conn->is_sink || !conn->sink)
+                return 0;
+
+        for (consumed = 0; consumed < count && n_bundled < SR_TREE_MAX_NODES; consumed++)
+        {
+                const linkaddr_t *dest = &dests[consumed];
+                route_ok[consumed] = 0;
+                if (linkaddr_cmp(dest, &sink_addr) || dest->u8[1] != 0)
+                        continue;
+                int path_len = find_route(conn, dest);
+                if (path_len == 0)
+                {
+                        LOG(TAG_SRDCP, "no route to %02u:%02u (downlink dropped)", dest->u8[0], dest->u8[1]);
+                        continue;
+                }
+
+                /* Merge the path (first hop ... dest) below the sink */
+                uint8_t saved_n = n;
+                uint8_t parent = SR_TREE_ROOT;
+                bool conflict = false;
+                int k;
+                for (k = path_len - 1; k >= 0 && !conflict; k--)
+                {
+                        uint8_t id = conn->sink->routing_table.tree_path[k].u8[0];
+                        uint8_t i;
+                        int found = -1;
+                        for (i = 0; i < n; i++)
+                        {
+                                if (sr_tree_id[i] != id)
+                                        continue;
+                                if (sr_tree_parent[i] == parent)
+                                        found = i;
+                                else
+                                        conflict = true; /* reached through another branch */
+                                break;
+                        }
+                        if (conflict)
+                                break;
+                        if (found < 0)
+                        {
+                                if (n == SR_TREE_MAX_NODES)
+                                {
+                                        conflict = true;
+                                        break;
+                                }
+                                sr_tree_id[n] = id;
+                                sr_tree_parent[n] = parent;
+                                found = n++;
+                        }
+                        parent = (uint8_t)found;
+                }
+
+                size_t frame = base_hdr + n * sizeof(source_route_tree_node) + sizeof(source_route_records) +
+                               (size_t)(n_bundled + 1) * (1 + payload_len);
+                if (conflict || frame > my_collect_payload_max())
+                {
+                        n = saved_n;
+                        break;
+                }
+                bundled[n_bundled++] = consumed;
+                route_ok[consumed] = 1;
+        }
+
+        /* One frame per child of the sink */
+        uint8_t root;
+        for (root = 0; root < n; root++)
+        {
+                if (sr_tree_parent[root] != SR_TREE_ROOT)
+                        continue;
+
+                uint8_t *ptr = sr_frame;
+                enum packet_type pt = downward_data_packet;
+                source_route_tree_node *tree = (source_route_tree_node *)(ptr + base_hdr);
+                uint8_t tree_len = sr_tree_serialize(n, root, tree);
+                downward_data_packet_header hdr = {.hops = 0, .path_len = SRDCP_SR_PATH_LEN(SRDCP_SR_ENC_TREE, tree_len)};
+                source_route_records recs = {.payload_len = payload_len, .count = 0};
+                uint8_t *rec_ptr = ptr + base_hdr + tree_len * sizeof(source_route_tree_node) + sizeof(recs);
+                uint8_t in_frame[SR_TREE_MAX_NODES];
+                uint8_t b;
+
+                memset(in_frame, 0, n_bundled);
+                memcpy(ptr, &pt, sizeof(pt));
+                memcpy(ptr + sizeof(pt), &hdr, sizeof(hdr));
+                for (b = 0; b < n_bundled; b++)
+                {
+                        const linkaddr_t *dest = &dests[bundled[b]];
+                        if (!sr_tree_contains(tree, tree_len, dest->u8[0]))
+                                continue;
+                        in_frame[b] = 1;
+                        *rec_ptr++ = dest->u8[0];
+                        memcpy(rec_ptr, (const uint8_t *)payloads + (size_t)bundled[b] * payload_len, payload_len);
+                        rec_ptr += payload_len;
+                        recs.count++;
+                }
+                memcpy(ptr + base_hdr + tree_len * sizeof(source_route_tree_node), &recs, sizeof(recs));
+
+                linkaddr_t next_hop = {{tree[0].id, 0}};
+                packetbuf_clear();
+                packetbuf_copyfrom(sr_frame, (uint16_t)(rec_ptr - sr_frame));
+                LOG(TAG_SRDCP, "DL multi via %02u:%02u nodes=%u dests=%u bytes=%u",
+                    next_hop.u8[0], next_hop.u8[1], (unsigned)tree_len, (unsigned)recs.count,
+                    (unsigned)packetbuf_datalen());
+                if (!unicast_send(&conn->uc, &next_hop))
+                {
+                        LOG(TAG_SRDCP, "DL multi via %02u:%02u not sent (%u dests dropped)",
+                            next_hop.u8[0], next_hop.u8[1], (unsigned)recs.count);
+                        for (b = 0; b < n_bundled; b++)
+                        {
+                                if (in_frame[b])
+                                        route_ok[bundled[b]] = 0;
+                        }
+                }
+        }
+        return consumed;
 }
 
 /**
@@ -715,6 +1392,13 @@ void uc_recv(struct unicast_conn *uc_conn, const linkaddr_t *sender)
                 forward_upward_data(conn, sender);
                 break;
 
+#if SRDCP_UL_AGGREGATION
+        case upward_aggregate_packet:
+                LOG(TAG_UC, "aggregate rx");
+                forward_upward_aggregate(conn);
+                break;
+#endif
+
         case topology_report:
                 if (TOPOLOGY_REPORT == 0)
                 {
@@ -811,23 +1495,37 @@ static uint8_t piggy_collect_neighbors(srdcp_piggy_neighbor_item *items, uint8_t
 
 static srdcp_graph_node *graph_lookup_or_create(srdcp_graph_state *graph, const linkaddr_t *node)
 {
-        int free_idx = -1;
+        srdcp_graph_node *found = graph_get_node(graph, node);
+        if (found)
+                return found;
+        srdcp_graph_node *entry = NULL;
         int i;
         for (i = 0; i < MAX_NODES; i++)
         {
-                if (graph->nodes[i].used && linkaddr_cmp(&graph->nodes[i].node, node))
-                        return &graph->nodes[i];
-                if (!graph->nodes[i].used && free_idx < 0)
-                        free_idx = i;
+                entry = graph_node_at(graph, (uint8_t)i);
+                if (!entry)
+                {
+                        /* First slot of a page that is not allocated yet */
+                        graph->pages[i / SRDCP_GRAPH_PAGE_NODES] = sink_store_page_alloc();
+                        entry = graph_node_at(graph, (uint8_t)i);
+                        if (!entry)
+                                return NULL;
+                }
+                if (!entry->used)
+                        break;
         }
-        if (free_idx < 0)
+        if (i == MAX_NODES)
+                return NULL;
+        if (node_index_insert(graph->index, NODE_INDEX_COUNT(graph->index), node, (uint8_t)i) < 0)
                 return NULL;
-        srdcp_graph_node *entry = &graph->nodes[free_idx];
         memset(entry, 0, sizeof(*entry));
         entry->used = 1;
+        entry->slot = (uint8_t)i;
         linkaddr_copy(&entry->node, node);
         entry->neighbor_count = 0;
         entry->status_last_update = 0;
+        entry->in_head = SRDCP_EDGE_NONE;
+        graph_spt_node_added(graph, entry->slot);
         return entry;
 }
 
@@ -835,22 +1533,26 @@ static void graph_update_neighbors(struct my_collect_conn *conn, const linkaddr_
                                    const srdcp_piggy_neighbor_item *items, uint8_t count,
                                    uint8_t queue_load)
 {
-        if (!conn->is_sink)
+        if (!conn->sink)
                 return;
-        srdcp_graph_node *node = graph_lookup_or_create(&conn->graph, owner);
+        srdcp_graph_node *node = graph_lookup_or_create(&conn->sink->graph, owner);
         if (!node)
                 return;
 
         uint8_t capped = count;
         if (capped > SRDCP_GRAPH_MAX_NEIGHBORS)
                 capped = SRDCP_GRAPH_MAX_NEIGHBORS;
+        srdcp_graph_edge old[SRDCP_GRAPH_MAX_NEIGHBORS];
+        memcpy(old, node->neighbors, sizeof(old));
+        graph_edges_unlink(&conn->sink->graph, node->slot);
         node->neighbor_count = capped;
         clock_time_t now = clock_time();
 
         uint8_t i;
         for (i = 0; i < capped; i++)
         {
-                (void)graph_lookup_or_create(&conn->graph, &items[i].neighbor);
+                srdcp_graph_node *peer = graph_lookup_or_create(&conn->sink->graph, &items[i].neighbor);
+                node->neighbors[i].slot = peer ? peer->slot : SRDCP_SLOT_NONE;
                 node->neighbors[i].neighbor = items[i].neighbor;
                 node->neighbors[i].rssi = items[i].rssi;
                 node->neighbors[i].prr = items[i].prr;
@@ -862,7 +1564,10 @@ static void graph_update_neighbors(struct my_collect_conn *conn, const linkaddr_
         {
                 memset(&node->neighbors[i], 0, sizeof(node->neighbors[i]));
                 node->neighbors[i].neighbor = linkaddr_null;
+                node->neighbors[i].slot = SRDCP_SLOT_NONE;
         }
+        graph_edges_link(&conn->sink->graph, node->slot);
+        graph_spt_edges_changed(&conn->sink->graph, node->slot, old);
 
         LOG(TAG_GRAPH, "nei update owner=%02u:%02u count=%u",
             owner->u8[0], owner->u8[1], (unsigned)capped);
@@ -870,9 +1575,9 @@ static void graph_update_neighbors(struct my_collect_conn *conn, const linkaddr_
 
 static void graph_update_status(struct my_collect_conn *conn, const srdcp_node_status *status)
 {
-        if (!conn->is_sink)
+        if (!conn->sink)
                 return;
-        srdcp_graph_node *node = graph_lookup_or_create(&conn->graph, &status->node);
+        srdcp_graph_node *node = graph_lookup_or_create(&conn->sink->graph, &status->node);
         if (!node)
                 return;
 
@@ -890,20 +1595,23 @@ static void graph_update_status(struct my_collect_conn *conn, const srdcp_node_s
  * @param piggy_len The number of piggyback entries currently in the packet.
  * @param node      The node address to check.
  * @return true if it already exists; false otherwise.
+ * @details The entries are the trailer of the UL packet in packetbuf; they are compared in place.
  */
 bool check_address_in_piggyback_block(uint8_t piggy_len, linkaddr_t node)
 {
-        printf("Checking piggy address: %02u:%02u\n", node.u8[0], node.u8[1]);
+        const size_t trailer = (size_t)piggy_len * sizeof(tree_connection);
+        const uint16_t len = packetbuf_datalen();
+        const uint8_t *entry;
         uint8_t i;
-        tree_connection tc;
-        for (i = 0; i < piggy_len; i++)
+
+        LOG(TAG_PIGGY, "Checking piggy address: %02u:%02u", node.u8[0], node.u8[1]);
+        if (trailer + sizeof(enum packet_type) + sizeof(upward_data_packet_header) > len)
+                return false;
+        entry = (const uint8_t *)packetbuf_dataptr() + len - trailer;
+        for (i = 0; i < piggy_len; i++, entry += sizeof(tree_connection))
         {
-                memcpy(&tc,                                                                                                              // NOLINT(bugprone-sizeof-expression)
-                       packetbuf_dataptr() + sizeof(enum packet_type) + sizeof(upward_data_packet_header) + sizeof(tree_connection) * i, /* correct offset by i */
-                       sizeof(tree_connection));
-                /* Sanitize high byte for stable comparison */
-                tc.node.u8[1] = 0x00;
-                if (linkaddr_cmp(&tc.node, &node))
+                /* tree_connection.node first; its high byte is not compared */
+                if (entry[0] == node.u8[0] && node.u8[1] == 0x00)
                 {
                         printf("ERROR: Checking piggy address found: %02u:%02u\n", node.u8[0], node.u8[1]);
                         return true;
@@ -912,6 +1620,41 @@ bool check_address_in_piggyback_block(uint8_t piggy_len, linkaddr_t node)
         return false;
 }
 
+#if SRDCP_UL_FWD_PROFILE
+/* CPU time spent rewriting forwarded UL packets, from energest */
+static unsigned long ul_fwd_cpu_ticks;
+static uint16_t ul_fwd_count;
+
+static unsigned long ul_fwd_cpu_now(void)
+{
+        energest_flush();
+        return energest_type_time(ENERGEST_TYPE_CPU);
+}
+
+static void ul_fwd_profile_account(unsigned long start)
+{
+        ul_fwd_cpu_ticks += ul_fwd_cpu_now() - start;
+        if (++ul_fwd_count < SRDCP_UL_FWD_PROFILE_PERIOD)
+                return;
+#ifdef F_CPU
+        printf("STAT,UL_FWD_CPU,node=%02u:%02u,fwd=%u,cpu_ticks=%lu,cycles_per_fwd=%lu\n",
+               linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1], (unsigned)ul_fwd_count, ul_fwd_cpu_ticks,
+               (unsigned long)((unsigned long long)ul_fwd_cpu_ticks * F_CPU / RTIMER_SECOND / ul_fwd_count));
+#else
+        printf("STAT,UL_FWD_CPU,node=%02u:%02u,fwd=%u,cpu_ticks=%lu\n",
+               linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1], (unsigned)ul_fwd_count, ul_fwd_cpu_ticks);
+#endif
+        ul_fwd_cpu_ticks = 0;
+        ul_fwd_count = 0;
+}
+
+#define UL_FWD_PROFILE_START() unsigned long ul_fwd_start = ul_fwd_cpu_now()
+#define UL_FWD_PROFILE_STOP() ul_fwd_profile_account(ul_fwd_start)
+#else
+#define UL_FWD_PROFILE_START()
+#define UL_FWD_PROFILE_STOP()
+#endif /* SRDCP_UL_FWD_PROFILE */
+
 /**
  * @brief Processes an incoming UL packet and forwards it to the parent.
  * @param conn   The collect connection structure.
@@ -922,18 +1665,38 @@ bool check_address_in_piggyback_block(uint8_t piggy_len, linkaddr_t node)
 void forward_upward_data(struct my_collect_conn *conn, const linkaddr_t *sender)
 {
         (void)sender;
-        upward_data_packet_header hdr;
-        memcpy(&hdr, packetbuf_dataptr() + sizeof(enum packet_type),
-               sizeof(upward_data_packet_header));
+        PROF_ENTER(forward_upward_data);
+        upward_data_input(conn, 0);
+        PROF_EXIT(forward_upward_data);
+}
 
+/**
+ * @brief Handles the UL packet in packetbuf, received alone or unpacked from an aggregate.
+ * @param conn The collect connection structure.
+ * @param held Aggregation delay the packet already accumulated upstream (clock ticks).
+ */
+static void upward_data_input(struct my_collect_conn *conn, uint16_t held)
+{
         if (conn->is_sink == 1)
         {
+                upward_data_packet_header hdr;
+                memcpy(&hdr, packetbuf_dataptr() + sizeof(enum packet_type),
+                       sizeof(upward_data_packet_header));
                 size_t base_hdr = sizeof(enum packet_type) + sizeof(upward_data_packet_header);
+                const uint8_t tlv_count = UL_PIGGY_TLVS(hdr.piggy_len);
+                hdr.piggy_len = UL_PIGGY_COUNT(hdr.piggy_len);
                 size_t tc_bytes = (size_t)hdr.piggy_len * sizeof(tree_connection);
                 uint8_t *data_ptr = (uint8_t *)packetbuf_dataptr();
                 size_t datalen = packetbuf_datalen();
                 LOG(TAG_PIGGY, "sink pre-strip datalen=%u base=%u tc=%u piggy_len=%u",
                     (unsigned)datalen, (unsigned)base_hdr, (unsigned)tc_bytes, (unsigned)hdr.piggy_len);
+                if (base_hdr + tc_bytes > datalen)
+                {
+                        LOG(TAG_PIGGY, "ignore piggy block (len=%u > datalen=%u)",
+                            (unsigned)tc_bytes, (unsigned)datalen);
+                        hdr.piggy_len = 0;
+                        tc_bytes = 0;
+                }
 
                 if (PIGGYBACKING == 1 && datalen >= base_hdr)
                 {
@@ -947,30 +1710,28 @@ void forward_upward_data(struct my_collect_conn *conn, const linkaddr_t *sender)
                                 LOG(TAG_PIGGY, "apply %u entries at sink", (unsigned)hdr.piggy_len);
                         }
                         uint8_t i;
-                        uint8_t *tc_ptr = data_ptr + base_hdr;
+                        uint8_t *tc_ptr = data_ptr + datalen - tc_bytes; /* trailer */
                         for (i = 0; i < hdr.piggy_len; i++)
                         {
-                                if ((size_t)(base_hdr + (i + 1) * sizeof(tree_connection)) > datalen)
-                                        break;
                                 memcpy(&tc, tc_ptr + sizeof(tree_connection) * i, sizeof(tree_connection));
                                 tc.node.u8[1] = 0x00;
                                 tc.parent.u8[1] = 0x00;
-                                if (tc.node.u8[0] != 0 && tc.parent.u8[0] != 0)
+                                if (tc.node.u8[0] != 0 && tc.parent.u8[0] != 0 && conn->sink)
                                 {
-                                        dict_add(&conn->routing_table, tc.node, tc.parent);
+                                        dict_add(&conn->sink->routing_table, tc.node, tc.parent);
                                 }
                         }
                 }
 
-                size_t consumed = base_hdr + tc_bytes;
-                size_t remaining = (datalen > consumed) ? (datalen - consumed) : 0;
+                size_t consumed = base_hdr;
+                size_t remaining = (datalen > consumed + tc_bytes) ? (datalen - consumed - tc_bytes) : 0;
 
                 size_t ctrl_bytes = 0;
-                if (remaining >= sizeof(srdcp_piggy_tlv))
+                if (tlv_count > 0 && remaining >= sizeof(srdcp_piggy_tlv))
                 {
                         uint8_t *tlv_ptr = data_ptr + consumed;
                         uint8_t parsed = 0;
-                        while (remaining >= sizeof(srdcp_piggy_tlv) && parsed < 2)
+                        while (remaining >= sizeof(srdcp_piggy_tlv) && parsed < tlv_count)
                         {
                                 srdcp_piggy_tlv tlv;
                                 memcpy(&tlv, tlv_ptr, sizeof(tlv));
@@ -1026,57 +1787,316 @@ void forward_upward_data(struct my_collect_conn *conn, const linkaddr_t *sender)
                                         parsed++;
                                         continue;
                                 }
+                                if (tlv.type == SRDCP_PIGGY_TLV_STATUS_V2 && conn->sink)
+                                {
+                                        linkaddr_t src = hdr.source;
+                                        src.u8[1] = 0x00;
+                                        srdcp_graph_node *gn = graph_lookup_or_create(&conn->sink->graph, &src);
+                                        if (gn)
+                                        {
+                                                srdcp_node_status status = gn->status;
+                                                int flags = piggy_status_decode(tlv_ptr + sizeof(tlv), tlv.length,
+                                                                                &status, &gn->status_sync);
+                                                if (flags >= 0)
+                                                {
+                                                        status.node = src;
+                                                        graph_update_status(conn, &status);
+                                                }
+                                                if (!(gn->status_sync & PIGGY_SYNC_VALID))
+                                                        LOG(TAG_PIGGY, "status of %02u:%02u unsynced until next keyframe",
+                                                            src.u8[0], src.u8[1]);
+                                        }
+                                        tlv_ptr += total_len;
+                                        remaining -= total_len;
+                                        ctrl_bytes += total_len;
+                                        parsed++;
+                                        continue;
+                                }
+                                if (tlv.type == SRDCP_PIGGY_TLV_NEIGHBORS_V2 && conn->sink)
+                                {
+                                        linkaddr_t src = hdr.source;
+                                        src.u8[1] = 0x00;
+                                        srdcp_graph_node *gn = graph_get_node(&conn->sink->graph, &src);
+                                        srdcp_piggy_neighbor_item buf[SRDCP_PIGGY_MAX_NEIGHBORS];
+                                        int count = piggy_neighbors_decode(tlv_ptr + sizeof(tlv), tlv.length,
+                                                                           gn ? gn->status.queue_load : 0,
+                                                                           buf, SRDCP_PIGGY_MAX_NEIGHBORS);
+                                        if (count > 0)
+                                                graph_update_neighbors(conn, &src, buf, (uint8_t)count,
+                                                                       gn ? gn->status.queue_load : 0);
+                                        tlv_ptr += total_len;
+                                        remaining -= total_len;
+                                        ctrl_bytes += total_len;
+                                        parsed++;
+                                        continue;
+                                }
                                 /* Unknown TLV -> stop parsing and leave payload intact */
                                 break;
                         }
                 }
 
-                packetbuf_hdrreduce((int)base_hdr);
-                if (tc_bytes > 0)
-                        packetbuf_hdrreduce((int)tc_bytes);
-                if (ctrl_bytes > 0)
-                        packetbuf_hdrreduce((int)ctrl_bytes);
+                packetbuf_set_datalen((uint16_t)(datalen - tc_bytes));
+                packetbuf_hdrreduce((int)(base_hdr + ctrl_bytes));
                 LOG(TAG_PIGGY, "sink post-strip datalen=%u ctrl_bytes=%u",
                     (unsigned)packetbuf_datalen(), (unsigned)ctrl_bytes);
+                if (held > 0)
+                        LOG(TAG_UL, "aggregated src=%02u:%02u held=%u",
+                            hdr.source.u8[0], hdr.source.u8[1], (unsigned)held);
 
                 conn->callbacks->recv(&hdr.source, hdr.hops + 1);
         }
         else
         {
-                hdr.hops++;
+                /* Rewritten in place: hops and piggy_len are single bytes of the
+                 * header, and this hop's tree_connection goes at the end of the data */
+                UL_FWD_PROFILE_START();
+                uint8_t *data = packetbuf_dataptr();
+                upward_data_packet_header *hdr = (upward_data_packet_header *)(data + sizeof(enum packet_type));
+                hdr->hops++;
 
                 if (PIGGYBACKING == 1 && !linkaddr_cmp(&conn->parent, &linkaddr_null) &&
-                    !check_address_in_piggyback_block(hdr.piggy_len, linkaddr_node_addr))
+                    !check_address_in_piggyback_block(UL_PIGGY_COUNT(hdr->piggy_len), linkaddr_node_addr))
                 {
-                        size_t old_len = packetbuf_datalen();
-                        size_t insert_offset = sizeof(enum packet_type) +
-                                               sizeof(upward_data_packet_header) +
-                                               (size_t)hdr.piggy_len * sizeof(tree_connection);
-                        if (insert_offset <= old_len &&
-                            (old_len + sizeof(tree_connection)) <= PACKETBUF_SIZE)
+                        uint16_t len = packetbuf_datalen();
+                        if (packetbuf_totlen() + sizeof(tree_connection) <= my_collect_payload_max() &&
+                            UL_PIGGY_COUNT(hdr->piggy_len) < MAX_PATH_LENGTH)
                         {
-                                packetbuf_set_datalen(old_len + sizeof(tree_connection));
-                                uint8_t *data = packetbuf_dataptr();
-                                memmove(data + insert_offset + sizeof(tree_connection),
-                                        data + insert_offset,
-                                        old_len - insert_offset);
                                 tree_connection tc = {.node = linkaddr_node_addr, .parent = conn->parent};
                                 tc.node.u8[1] = 0x00;
                                 tc.parent.u8[1] = 0x00;
-                                memcpy(data + insert_offset, &tc, sizeof(tree_connection));
-                                hdr.piggy_len = (uint8_t)(hdr.piggy_len + 1);
+                                memcpy(data + len, &tc, sizeof(tree_connection));
+                                packetbuf_set_datalen((uint16_t)(len + sizeof(tree_connection)));
+                                hdr->piggy_len++; /* count is in the low bits */
                         }
                         else
                         {
-                                LOG(TAG_PIGGY, "cannot add tree_connection (offset=%u len=%u)",
-                                    (unsigned)insert_offset, (unsigned)old_len);
+                                LOG(TAG_PIGGY, "cannot add tree_connection (len=%u total=%u)",
+                                    (unsigned)len, (unsigned)packetbuf_totlen());
                         }
                 }
-                memcpy(packetbuf_dataptr() + sizeof(enum packet_type), &hdr, sizeof(upward_data_packet_header));
+                UL_FWD_PROFILE_STOP();
 
+#if SRDCP_UL_AGGREGATION
+                ul_agg_enqueue(conn, packetbuf_dataptr(), packetbuf_datalen(), held);
+#else
                 unicast_send(&conn->uc, &conn->parent);
+#endif
+        }
+}
+
+#if SRDCP_UL_AGGREGATION
+/* ----------------------------- Uplink aggregation ----------------------------- */
+
+#define UL_AGG_BASE (sizeof(enum packet_type) + sizeof(upward_aggregate_header))
+/* Smallest record worth waiting for: an upward header and a 1-byte payload */
+#define UL_AGG_MIN_RECORD (sizeof(upward_aggregate_record) + sizeof(upward_data_packet_header) + 1)
+
+/* Pending aggregate towards the parent: packet type, header, then records */
+static uint8_t ul_agg_buf[SRDCP_FRAME_MAX];
+static uint8_t ul_agg_len;
+static uint8_t ul_agg_count;
+static uint8_t ul_agg_off[SRDCP_UL_AGG_MAX_RECORDS];        /* record offsets in ul_agg_buf */
+static clock_time_t ul_agg_since[SRDCP_UL_AGG_MAX_RECORDS]; /* time each record was queued */
+static clock_time_t ul_agg_deadline;
+static struct ctimer ul_agg_timer;
+/* Copy of a received aggregate while its records are unpacked */
+static uint8_t ul_agg_rx[PACKETBUF_SIZE];
+/* Frame to queue, saved while the pending aggregate is flushed to make room */
+static uint8_t ul_agg_next[SRDCP_FRAME_MAX];
+
+/**
+ * @brief Sends the pending aggregate to the parent.
+ * @param conn The collect connection structure.
+ * @details A single record that has not been held anywhere goes out as a plain
+ *          upward data packet; any other keeps the aggregate format so that the
+ *          next hop counts its delay from what it already accumulated.
+ *          Clobbers packetbuf.
+ */
+static void ul_agg_flush(struct my_collect_conn *conn)
+{
+        const clock_time_t now = clock_time();
+        uint32_t held_max = 0;
+        uint8_t i;
+
+        ctimer_stop(&ul_agg_timer);
+        if (ul_agg_count == 0)
+                return;
+
+        for (i = 0; i < ul_agg_count; i++)
+        {
+                upward_aggregate_record rec;
+                uint32_t held;
+                memcpy(&rec, ul_agg_buf + ul_agg_off[i], sizeof(rec));
+                held = (uint32_t)rec.held + (clock_time_t)(now - ul_agg_since[i]);
+                rec.held = (held > 0xFFFF) ? 0xFFFF : (uint16_t)held;
+                memcpy(ul_agg_buf + ul_agg_off[i], &rec, sizeof(rec));
+                if (held > held_max)
+                        held_max = held;
+        }
+
+        packetbuf_clear();
+        if (ul_agg_count == 1 && held_max == 0)
+        {
+                enum packet_type pt = upward_data_packet;
+                const uint8_t *up = ul_agg_buf + ul_agg_off[0] + sizeof(upward_aggregate_record);
+                uint8_t up_len = (uint8_t)(ul_agg_len - ul_agg_off[0] - sizeof(upward_aggregate_record));
+                uint8_t *ptr = packetbuf_dataptr();
+                memcpy(ptr, &pt, sizeof(pt));
+                memcpy(ptr + sizeof(pt), up, up_len);
+                packetbuf_set_datalen((uint16_t)(sizeof(pt) + up_len));
+        }
+        else
+        {
+                enum packet_type pt = upward_aggregate_packet;
+                upward_aggregate_header agg = {.count = ul_agg_count};
+                memcpy(ul_agg_buf, &pt, sizeof(pt));
+                memcpy(ul_agg_buf + sizeof(pt), &agg, sizeof(agg));
+                packetbuf_copyfrom(ul_agg_buf, ul_agg_len);
+        }
+        LOG(TAG_UL, "aggregate flush records=%u bytes=%u parent=%02u:%02u",
+            (unsigned)ul_agg_count, (unsigned)packetbuf_datalen(),
+            conn->parent.u8[0], conn->parent.u8[1]);
+        ul_agg_count = 0;
+        ul_agg_len = 0;
+
+        if (linkaddr_cmp(&conn->parent, &linkaddr_null))
+        {
+                LOG(TAG_UL, "drop aggregate (no parent)");
+                return;
+        }
+        unicast_send(&conn->uc, &conn->parent);
+}
+
+static void ul_agg_timer_cb(void *ptr)
+{
+        ul_agg_flush((struct my_collect_conn *)ptr);
+}
+
+/**
+ * @brief Queues an upward data frame for aggregation towards the parent.
+ * @param conn  The collect connection structure.
+ * @param frame The upward data frame, starting with its packet type; must be packetbuf's content.
+ * @param len   Frame length in bytes.
+ * @param held  Aggregation delay the frame already accumulated upstream (clock ticks).
+ * @return Non-zero if the frame was queued or sent; 0 if there is no parent.
+ * @details The aggregate is sent SRDCP_UL_AGG_WINDOW after its first record, earlier if a
+ *          record would exceed SRDCP_UL_AGG_MAX_DELAY or the frame is full. Frames are sized
+ *          by my_collect_payload_max(). A frame that does not fit next to the pending records
+ *          flushes them and starts the next aggregate; only one too large to be a record is
+ *          sent on its own. May clobber packetbuf.
+ */
+static int ul_agg_enqueue(struct my_collect_conn *conn, const uint8_t *frame, uint16_t len, uint16_t held)
+{
+        const uint16_t up_len = (uint16_t)(len - sizeof(enum packet_type));
+        const size_t rec_size = sizeof(upward_aggregate_record) + up_len;
+        const clock_time_t now = clock_time();
+        clock_time_t budget;
+        upward_aggregate_record rec;
+
+        if (linkaddr_cmp(&conn->parent, &linkaddr_null))
+        {
+                LOG(TAG_UL, "drop (no parent)");
+                return 0;
+        }
+        if (len <= sizeof(enum packet_type) || UL_AGG_BASE + rec_size > my_collect_payload_max())
+        {
+                LOG(TAG_UL, "too large to aggregate, send alone bytes=%u held=%u",
+                    (unsigned)len, (unsigned)held);
+                return unicast_send(&conn->uc, &conn->parent);
+        }
+        if (ul_agg_count > 0 && ul_agg_len + rec_size > my_collect_payload_max())
+        {
+                /* Flushing clobbers packetbuf, where the frame is */
+                memcpy(ul_agg_next, frame, len);
+                frame = ul_agg_next;
+                LOG(TAG_UL, "aggregate full, flush before bytes=%u", (unsigned)len);
+                ul_agg_flush(conn);
+        }
+
+        budget = (held >= SRDCP_UL_AGG_MAX_DELAY) ? 0 : (clock_time_t)(SRDCP_UL_AGG_MAX_DELAY - held);
+        if (ul_agg_count == 0)
+        {
+                ul_agg_len = UL_AGG_BASE;
+                ul_agg_deadline = now + ((budget < SRDCP_UL_AGG_WINDOW) ? budget : SRDCP_UL_AGG_WINDOW);
+        }
+        else if (budget < (clock_time_t)(ul_agg_deadline - now))
+        {
+                ul_agg_deadline = now + budget;
+        }
+
+        rec.len = (uint8_t)up_len;
+        rec.held = held;
+        ul_agg_off[ul_agg_count] = ul_agg_len;
+        ul_agg_since[ul_agg_count] = now;
+        memcpy(ul_agg_buf + ul_agg_len, &rec, sizeof(rec));
+        memcpy(ul_agg_buf + ul_agg_len + sizeof(rec), frame + sizeof(enum packet_type), up_len);
+        ul_agg_len = (uint8_t)(ul_agg_len + rec_size);
+        ul_agg_count++;
+        LOG(TAG_UL, "aggregate queue records=%u bytes=%u held=%u",
+            (unsigned)ul_agg_count, (unsigned)ul_agg_len, (unsigned)held);
+
+        if (budget == 0 || ul_agg_count == SRDCP_UL_AGG_MAX_RECORDS ||
+            ul_agg_len + UL_AGG_MIN_RECORD > my_collect_payload_max())
+        {
+                ul_agg_flush(conn);
+        }
+        else
+        {
+                ctimer_set(&ul_agg_timer, (clock_time_t)(ul_agg_deadline - now), ul_agg_timer_cb, conn);
+        }
+        return 1;
+}
+
+/**
+ * @brief Unpacks a received aggregate and handles every record as a UL packet.
+ * @param conn The collect connection structure.
+ * @details SINK: each record is delivered to the app. NODE: each record is re-queued
+ *          towards the parent, keeping the delay it accumulated so far.
+ */
+static void forward_upward_aggregate(struct my_collect_conn *conn)
+{
+        const uint16_t total = packetbuf_datalen();
+        upward_aggregate_header agg;
+        linkaddr_t sender;
+        size_t off = UL_AGG_BASE;
+        uint8_t i;
+
+        if (total < UL_AGG_BASE || total > sizeof(ul_agg_rx))
+        {
+                LOG(TAG_UL, "drop (bad aggregate size=%u)", (unsigned)total);
+                return;
+        }
+        memcpy(ul_agg_rx, packetbuf_dataptr(), total);
+        linkaddr_copy(&sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+        memcpy(&agg, ul_agg_rx + sizeof(enum packet_type), sizeof(agg));
+
+        for (i = 0; i < agg.count; i++)
+        {
+                enum packet_type pt = upward_data_packet;
+                upward_aggregate_record rec;
+                uint8_t *ptr;
+
+                if (off + sizeof(rec) > total)
+                        break;
+                memcpy(&rec, ul_agg_rx + off, sizeof(rec));
+                off += sizeof(rec);
+                if (rec.len < sizeof(upward_data_packet_header) || off + rec.len > total)
+                {
+                        LOG(TAG_UL, "drop (truncated aggregate record %u/%u)", (unsigned)i, (unsigned)agg.count);
+                        break;
+                }
+
+                packetbuf_clear();
+                ptr = packetbuf_dataptr();
+                memcpy(ptr, &pt, sizeof(pt));
+                memcpy(ptr + sizeof(pt), ul_agg_rx + off, rec.len);
+                packetbuf_set_datalen((uint16_t)(sizeof(pt) + rec.len));
+                packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &sender);
+                upward_data_input(conn, rec.held);
+                off += rec.len;
         }
 }
+#endif /* SRDCP_UL_AGGREGATION */
 
 /**
  * @brief Processes a downward SRDCP (source-routed) packet.
@@ -1090,33 +2110,47 @@ void forward_downward_data(struct my_collect_conn *conn, const linkaddr_t *sende
         (void)sender;
         linkaddr_t addr;
         downward_data_packet_header hdr;
+        const size_t base_hdr = sizeof(enum packet_type) + sizeof(downward_data_packet_header);
 
+        if (packetbuf_datalen() < base_hdr)
+                return;
         memcpy(&hdr, packetbuf_dataptr() + sizeof(enum packet_type),
                sizeof(downward_data_packet_header));
-        memcpy(&addr, packetbuf_dataptr() + sizeof(enum packet_type) + sizeof(downward_data_packet_header),
-               sizeof(linkaddr_t));
+        uint8_t enc = SRDCP_SR_ENC(hdr.path_len);
+        uint8_t len = SRDCP_SR_LEN(hdr.path_len);
+        if (enc == SRDCP_SR_ENC_TREE)
+        {
+                forward_downward_tree(conn);
+                return;
+        }
+        uint8_t *route = (uint8_t *)packetbuf_dataptr() + base_hdr;
+        size_t avail = packetbuf_datalen() - base_hdr;
+        int route_size = source_route_read(route, (avail > 0xFF) ? 0xFF : (uint8_t)avail, enc, len, &addr);
+        if (route_size < 0)
+        {
+                LOG(TAG_SRDCP, "drop (bad route enc=%u len=%u)", (unsigned)enc, (unsigned)len);
+                return;
+        }
 
         if (linkaddr_cmp(&addr, &linkaddr_node_addr))
         {
-                if (hdr.path_len == 1)
+                if (len == 1)
                 {
                         LOG(TAG_SRDCP, "path complete at %02u:%02u; deliver",
                             linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
-                        packetbuf_hdrreduce(sizeof(enum packet_type) +
-                                            sizeof(downward_data_packet_header) +
-                                            sizeof(linkaddr_t));
+                        packetbuf_hdrreduce(base_hdr + route_size);
                         conn->callbacks->sr_recv(conn, hdr.hops + 1);
                 }
                 else
                 {
-                        packetbuf_hdrreduce(sizeof(linkaddr_t));
-                        hdr.path_len = hdr.path_len - 1;
+                        /* Drop our hop; the rest of the route stays in place */
+                        packetbuf_hdrreduce(source_route_pop(route, enc, len));
+                        hdr.path_len = SRDCP_SR_PATH_LEN(enc, len - 1);
                         enum packet_type pt = downward_data_packet;
                         memcpy(packetbuf_dataptr(), &pt, sizeof(enum packet_type));
                         memcpy(packetbuf_dataptr() + sizeof(enum packet_type),
                                &hdr, sizeof(downward_data_packet_header));
-                        memcpy(&addr, packetbuf_dataptr() + sizeof(enum packet_type) + sizeof(downward_data_packet_header),
-                               sizeof(linkaddr_t));
+                        source_route_read((uint8_t *)packetbuf_dataptr() + base_hdr, 0xFF, enc, len - 1, &addr);
                         unicast_send(&conn->uc, &addr);
                 }
         }
@@ -1161,3 +2195,104 @@ __attribute__((weak)) uint16_t srdcp_app_last_dl_delay_ticks(void)
 {
         return 0;
 }
+
+/**
+ * @brief Splits a multi-destination DL packet at this node.
+ * @param conn The collect connection structure.
+ * @details Each child subtree of this node gets its own frame with the
+ *          records of the destinations it contains; the local record, if
+ *          any, is delivered to the app last.
+ */
+static void forward_downward_tree(struct my_collect_conn *conn)
+{
+        const size_t base_hdr = sizeof(enum packet_type) + sizeof(downward_data_packet_header);
+        downward_data_packet_header hdr;
+        source_route_records recs;
+        linkaddr_t sender;
+        uint16_t total = packetbuf_datalen();
+
+        if (total > sizeof(sr_frame))
+                return;
+        packetbuf_copyto(sr_frame);
+        linkaddr_copy(&sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+        memcpy(&hdr, sr_frame + sizeof(enum packet_type), sizeof(hdr));
+
+        uint8_t len = SRDCP_SR_LEN(hdr.path_len);
+        const source_route_tree_node *tree = (const source_route_tree_node *)(sr_frame + base_hdr);
+        size_t recs_off = base_hdr + len * sizeof(source_route_tree_node);
+        if (len == 0 || recs_off + sizeof(recs) > total ||
+            source_route_subtree_end(tree, len, 0) != len)
+        {
+                LOG(TAG_SRDCP, "drop (bad branching route len=%u)", (unsigned)len);
+                return;
+        }
+        memcpy(&recs, sr_frame + recs_off, sizeof(recs));
+        const uint8_t *records = sr_frame + recs_off + sizeof(recs);
+        size_t rec_size = 1 + recs.payload_len;
+        if (recs_off + sizeof(recs) + recs.count * rec_size > total)
+        {
+                LOG(TAG_SRDCP, "drop (truncated records count=%u)", (unsigned)recs.count);
+                return;
+        }
+        if (tree[0].id != linkaddr_node_addr.u8[0])
+        {
+                LOG(TAG_SRDCP, "drop (for=%02u:00; I'm=%02u:%02u)",
+                    tree[0].id, linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+                return;
+        }
+
+        uint8_t start = 1;
+        uint8_t c;
+        for (c = 0; c < tree[0].children; c++)
+        {
+                int end = source_route_subtree_end(tree, len, start);
+                uint8_t sub_len = (uint8_t)(end - start);
+                downward_data_packet_header fwd = {.hops = (uint8_t)(hdr.hops + 1),
+                                                   .path_len = SRDCP_SR_PATH_LEN(SRDCP_SR_ENC_TREE, sub_len)};
+                source_route_records sub = {.payload_len = recs.payload_len, .count = 0};
+                enum packet_type pt = downward_data_packet;
+                uint8_t *ptr;
+                uint8_t r;
+
+                packetbuf_clear();
+                ptr = packetbuf_dataptr();
+                memcpy(ptr, &pt, sizeof(pt));
+                memcpy(ptr + sizeof(pt), &fwd, sizeof(fwd));
+                memcpy(ptr + base_hdr, &tree[start], sub_len * sizeof(source_route_tree_node));
+                ptr += base_hdr + sub_len * sizeof(source_route_tree_node) + sizeof(sub);
+                for (r = 0; r < recs.count; r++)
+                {
+                        const uint8_t *rec = records + r * rec_size;
+                        if (!sr_tree_contains(&tree[start], sub_len, rec[0]))
+                                continue;
+                        memcpy(ptr, rec, rec_size);
+                        ptr += rec_size;
+                        sub.count++;
+                }
+                memcpy((uint8_t *)packetbuf_dataptr() + base_hdr + sub_len * sizeof(source_route_tree_node),
+                       &sub, sizeof(sub));
+                packetbuf_set_datalen((uint16_t)(ptr - (uint8_t *)packetbuf_dataptr()));
+
+                linkaddr_t next_hop = {{tree[start].id, 0}};
+                LOG(TAG_SRDCP, "DL multi split at %02u:%02u -> %02u:%02u nodes=%u dests=%u",
+                    linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
+                    next_hop.u8[0], next_hop.u8[1], (unsigned)sub_len, (unsigned)sub.count);
+                unicast_send(&conn->uc, &next_hop);
+                start = (uint8_t)end;
+        }
+
+        uint8_t r;
+        for (r = 0; r < recs.count; r++)
+        {
+                const uint8_t *rec = records + r * rec_size;
+                if (rec[0] != linkaddr_node_addr.u8[0])
+                        continue;
+                LOG(TAG_SRDCP, "multi path complete at %02u:%02u; deliver",
+                    linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+                packetbuf_clear();
+                packetbuf_copyfrom(rec + 1, recs.payload_len);
+                packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &sender);
+                conn->callbacks->sr_recv(conn, hdr.hops + 1);
+                break;
+        }
+}
@@ -8,6 +8,8 @@
 #include "net/rime/rime.h"
 #include "net/netstack.h"
 #include "core/net/linkaddr.h"
+#include "lib/trickle-timer.h"
+#include "node_index.h"
 
 // Allow or not to send topology reports.
 #ifndef TOPOLOGY_REPORT
@@ -17,9 +19,43 @@
 #define PIGGYBACKING 1
 #endif
 
+#ifndef MAX_NODES
 #define MAX_NODES 30
+#endif
+/* Graph slots are uint8_t with 0xFF reserved, and node ids are 8-bit */
+#if MAX_NODES > 254
+#error "MAX_NODES must be <= 254"
+#endif
+
+/* Buckets of the node index shared by TreeDict and srdcp_graph_state
+ * (power of two, >= 2 * MAX_NODES) */
+#if MAX_NODES <= 16
+#define SRDCP_NODE_INDEX_BUCKETS 32
+#elif MAX_NODES <= 32
+#define SRDCP_NODE_INDEX_BUCKETS 64
+#elif MAX_NODES <= 64
+#define SRDCP_NODE_INDEX_BUCKETS 128
+#elif MAX_NODES <= 128
+#define SRDCP_NODE_INDEX_BUCKETS 256
+#else
+#define SRDCP_NODE_INDEX_BUCKETS 512
+#endif
 /* Fast-convergence profile: allow long paths for 30-node chains */
+#ifndef MAX_PATH_LENGTH
 #define MAX_PATH_LENGTH 32
+#endif
+
+/* Largest 802.15.4 frame, FCS included; my_collect_payload_max() takes the
+ * Rime and framer headers off it */
+#ifndef SRDCP_FRAME_MAX
+#define SRDCP_FRAME_MAX 127
+#endif
+
+/* Sink graph nodes are stored in pages allocated on demand (sink_store.c) */
+#ifndef SRDCP_GRAPH_PAGE_NODES
+#define SRDCP_GRAPH_PAGE_NODES 10
+#endif
+#define SRDCP_GRAPH_MAX_PAGES ((MAX_NODES + SRDCP_GRAPH_PAGE_NODES - 1) / SRDCP_GRAPH_PAGE_NODES)
 
 /* Piggyback TLV identifiers */
 #define SRDCP_PIGGY_TLV_NEIGHBORS 1
@@ -45,6 +81,51 @@
 #define SRDCP_PIGGY_CTRL_MAX 96
 #endif
 
+/* Beacon dissemination: the sink starts an epoch every BEACON_INTERVAL and
+ * every node forwards it after BEACON_FORWARD_DELAY (PERIODIC), or epochs
+ * are spread by a Trickle timer per node that suppresses redundant beacons
+ * and backs off while the tree is stable (TRICKLE) */
+#define SRDCP_BEACON_PERIODIC 0
+#define SRDCP_BEACON_TRICKLE 1
+#ifndef SRDCP_BEACON_MODE
+#define SRDCP_BEACON_MODE SRDCP_BEACON_PERIODIC
+#endif
+/* Trickle: Imin (ticks), Imax (doublings of Imin) and redundancy constant k */
+#ifndef SRDCP_TRICKLE_IMIN
+#define SRDCP_TRICKLE_IMIN CLOCK_SECOND
+#endif
+#ifndef SRDCP_TRICKLE_IMAX
+#define SRDCP_TRICKLE_IMAX 5
+#endif
+#ifndef SRDCP_TRICKLE_K
+#define SRDCP_TRICKLE_K 1
+#endif
+/* Trickle: the sink starts a new epoch (beacon_seqn) this often */
+#ifndef SRDCP_TRICKLE_EPOCH
+#define SRDCP_TRICKLE_EPOCH (4 * BEACON_INTERVAL)
+#endif
+/* Print STAT,BEACON (beacons sent/suppressed, parent) once per epoch */
+#ifndef SRDCP_BEACON_STATS
+#define SRDCP_BEACON_STATS 0
+#endif
+/* Beacons wake (WuS metric group, wurrdc) only the neighbors at our hop count
+ * or deeper, and unconnected ones; 0 (default) wakes every neighbor. A node
+ * whose parent is lost matches every group again (checked every
+ * SRDCP_WUS_GROUP_CHECK) until it has a live parent */
+#ifndef SRDCP_WUS_BEACON_GROUP
+#define SRDCP_WUS_BEACON_GROUP 0
+#endif
+#ifndef SRDCP_WUS_GROUP_CHECK
+#define SRDCP_WUS_GROUP_CHECK BEACON_INTERVAL
+#endif
+/* Beacons carry their epoch in the WuS (wurrdc): a node that already has the
+ * epoch stays asleep, except for its parent's beacon; the skipped beacon
+ * still counts for PRR and Trickle. One wake-up per node and epoch instead
+ * of one per neighbor beacon, at the cost of fewer in-epoch parent changes */
+#ifndef SRDCP_WUS_EPOCH_SUPPRESS
+#define SRDCP_WUS_EPOCH_SUPPRESS 0
+#endif
+
 #ifndef BEACON_INTERVAL
 /* Fast-convergence: more frequent beacons */
 #define BEACON_INTERVAL (8 * CLOCK_SECOND)
@@ -73,13 +154,75 @@
 #define SRDCP_INFO_MAX_AGE (5 * BEACON_INTERVAL)
 #endif
 
+/* Adaptive piggybacking: the sink flags in its beacons the nodes whose graph
+ * data is stale, and nodes only attach the neighbor/status TLVs when flagged
+ * or when their neighborhood changed (the tree trailer is always sent) */
+#ifndef SRDCP_PIGGY_ADAPTIVE
+#define SRDCP_PIGGY_ADAPTIVE 1
+#endif
+/* Sink: a node is flagged once its last report is older than this (well
+ * before its edges age out of find_route_graph) */
+#ifndef SRDCP_PIGGY_STALE_AGE
+#define SRDCP_PIGGY_STALE_AGE (SRDCP_INFO_MAX_AGE / 2)
+#endif
+/* Node: longest time without a report, whatever the beacons say */
+#ifndef SRDCP_PIGGY_REFRESH_MAX
+#define SRDCP_PIGGY_REFRESH_MAX SRDCP_INFO_MAX_AGE
+#endif
+/* Node: neighbor changes (vs. the last report) that trigger a report */
+#ifndef SRDCP_PIGGY_PRR_DELTA
+#define SRDCP_PIGGY_PRR_DELTA 20
+#endif
+#ifndef SRDCP_PIGGY_RSSI_DELTA
+#define SRDCP_PIGGY_RSSI_DELTA 6
+#endif
+/* Stale bitmap carried in beacons: bit i is node id i (ids 1..MAX_NODES);
+ * nodes with larger ids only report on their own triggers */
+#define SRDCP_PIGGY_STALE_BYTES ((MAX_NODES + 8) / 8)
+
+/* Uplink aggregation: forwarders hold UL packets (their own and their
+ * children's) and send them to the parent as one frame */
+#ifndef SRDCP_UL_AGGREGATION
+#define SRDCP_UL_AGGREGATION 0
+#endif
+/* Longest a forwarder waits for more records after the first one */
+#ifndef SRDCP_UL_AGG_WINDOW
+#define SRDCP_UL_AGG_WINDOW (2 * CLOCK_SECOND)
+#endif
+/* Bound on the total time a packet is held by aggregation, over all hops */
+#ifndef SRDCP_UL_AGG_MAX_DELAY
+#define SRDCP_UL_AGG_MAX_DELAY (5 * CLOCK_SECOND)
+#endif
+#ifndef SRDCP_UL_AGG_MAX_RECORDS
+#define SRDCP_UL_AGG_MAX_RECORDS 8
+#endif
+
+/* Print the energest CPU time of the UL forwarding rewrite (STAT,UL_FWD_CPU)
+ * every SRDCP_UL_FWD_PROFILE_PERIOD forwarded packets */
+#ifndef SRDCP_UL_FWD_PROFILE
+#define SRDCP_UL_FWD_PROFILE 0
+#endif
+#ifndef SRDCP_UL_FWD_PROFILE_PERIOD
+#define SRDCP_UL_FWD_PROFILE_PERIOD 32
+#endif
+
+/* Sink: print the shortest-path cache counters (STAT,SPT) every
+ * SRDCP_SPT_STATS_PERIOD graph routes */
+#ifndef SRDCP_SPT_STATS
+#define SRDCP_SPT_STATS 0
+#endif
+#ifndef SRDCP_SPT_STATS_PERIOD
+#define SRDCP_SPT_STATS_PERIOD 32
+#endif
+
 // static const linkaddr_t sink_addr = {{0x01, 0x00 } }; // node 1 will be our sink
 extern const linkaddr_t sink_addr;
 enum packet_type
 {
         upward_data_packet = 0,
         downward_data_packet = 1,
-        topology_report = 2
+        topology_report = 2,
+        upward_aggregate_packet = 3
 };
 
 // --------------------------------------------------------------------
@@ -96,6 +239,7 @@ typedef struct TreeDict
 {
         int len;
         DictEntry entries[MAX_NODES];
+        node_index_entry index[SRDCP_NODE_INDEX_BUCKETS]; /* key -> entries[] */
         linkaddr_t tree_path[MAX_PATH_LENGTH];
 } TreeDict;
 
@@ -139,6 +283,19 @@ struct srdcp_node_status
 } __attribute__((packed));
 typedef struct srdcp_node_status srdcp_node_status;
 
+/* Graph slot index used by the sink's shortest-path cache */
+#define SRDCP_SLOT_NONE 0xFF
+
+/* Edge id (owner slot, index in its neighbor list) used by the reverse
+ * adjacency lists of the sink graph */
+#define SRDCP_EDGE_NONE 0xFFFF
+#define SRDCP_EDGE_ID(owner, e) ((uint16_t)((owner) * SRDCP_GRAPH_MAX_NEIGHBORS + (e)))
+#define SRDCP_EDGE_OWNER(id) ((uint8_t)((id) / SRDCP_GRAPH_MAX_NEIGHBORS))
+#define SRDCP_EDGE_INDEX(id) ((uint8_t)((id) % SRDCP_GRAPH_MAX_NEIGHBORS))
+#if MAX_NODES * SRDCP_GRAPH_MAX_NEIGHBORS >= SRDCP_EDGE_NONE
+#error "MAX_NODES * SRDCP_GRAPH_MAX_NEIGHBORS does not fit in a 16-bit edge id"
+#endif
+
 typedef struct
 {
         linkaddr_t neighbor;
@@ -146,24 +303,69 @@ typedef struct
         uint8_t prr;
         uint8_t metric;
         uint8_t load;
+        uint8_t slot; /* graph slot of 'neighbor' (SRDCP_SLOT_NONE if unresolved) */
+        uint16_t in_next; /* next edge into 'slot' (SRDCP_EDGE_NONE ends the list) */
         clock_time_t last_update;
 } srdcp_graph_edge;
 
 typedef struct
 {
         uint8_t used;
+        uint8_t slot; /* own graph slot */
         linkaddr_t node;
         srdcp_node_status status;
         clock_time_t status_last_update;
         srdcp_graph_edge neighbors[SRDCP_GRAPH_MAX_NEIGHBORS];
         uint8_t neighbor_count;
+        uint8_t status_sync; /* v2 status reports: PIGGY_SYNC_VALID | seq (piggy_codec.h) */
+        uint16_t in_head;    /* first edge reported by another node into this slot */
 } srdcp_graph_node;
 
+/* Path cost in the shortest-path cache: an edge costs up to about two hop
+ * weights, so 16 bits only cover paths of MAX_PATH_LENGTH <= 32 */
+#if MAX_PATH_LENGTH > 32
+typedef uint32_t srdcp_spt_dist_t;
+#define SRDCP_SPT_DIST_INF 0xFFFFFFFFUL
+#else
+typedef uint16_t srdcp_spt_dist_t;
+#define SRDCP_SPT_DIST_INF 0xFFFF
+#endif
+
+/* Cached shortest-path tree rooted at the sink (one entry per graph slot).
+ * Kept up to date incrementally by routing_table.c; a full Dijkstra run is
+ * only needed when an edge used by the tree gets worse or ages out. */
+typedef struct
+{
+        srdcp_spt_dist_t dist[MAX_NODES];
+        uint8_t prev[MAX_NODES];      /* parent slot towards the sink */
+        uint8_t via_owner[MAX_NODES]; /* slot owning the edge (prev, v) */
+        uint8_t via_edge[MAX_NODES];  /* index in via_owner's neighbor list */
+        uint8_t source;               /* sink slot */
+        uint8_t dirty;                /* 1: full recompute needed */
+        uint16_t hits;                /* lookups served from the cache */
+        uint16_t recomputes;          /* full Dijkstra runs */
+        uint16_t updates;             /* incremental edge updates applied */
+} srdcp_spt_cache;
+
+typedef struct
+{
+        srdcp_graph_node nodes[SRDCP_GRAPH_PAGE_NODES];
+} srdcp_graph_page;
+
 typedef struct
 {
-        srdcp_graph_node nodes[MAX_NODES];
+        srdcp_graph_page *pages[SRDCP_GRAPH_MAX_PAGES];   /* NULL until first used */
+        node_index_entry index[SRDCP_NODE_INDEX_BUCKETS]; /* node -> slot */
+        srdcp_spt_cache spt;
 } srdcp_graph_state;
 
+/* Routing state kept only by the sink (allocated by sink_store.c) */
+typedef struct
+{
+        TreeDict routing_table;
+        srdcp_graph_state graph;
+} srdcp_sink_store;
+
 // --------------------------------------------------------------------
 
 /* Connection object */
@@ -177,18 +379,31 @@ struct my_collect_conn
         // address of parent node
         linkaddr_t parent;
         struct ctimer beacon_timer;
+#if SRDCP_BEACON_MODE == SRDCP_BEACON_TRICKLE
+        // beacon transmissions (the sink also keeps beacon_timer for its epochs)
+        struct trickle_timer beacon_tt;
+        // 1: this node already sent a beacon in the current epoch
+        uint8_t beacon_epoch_sent;
+#endif
+        // beacons sent / suppressed by Trickle (SRDCP_BEACON_STATS)
+        uint16_t beacon_tx_count;
+        uint16_t beacon_suppressed;
         // metric: hop count (0 if sink)
         uint16_t metric;
         // sequence number of the tree protocol
         uint16_t beacon_seqn;
         // per-sender beacon sequence (for PRR estimation at neighbors)
         uint16_t beacon_tx_seq;
+#if SRDCP_PIGGY_ADAPTIVE
+        // stale bitmap of the current epoch (built by the sink, relayed by nodes)
+        uint8_t piggy_stale[SRDCP_PIGGY_STALE_BYTES];
+        // 1: the sink asked this node for a piggyback report
+        uint8_t piggy_request;
+#endif
         // true if this node is the sink
         uint8_t is_sink; // 1: is_sink, 0: not_sink
-        // tree table (used only in the sink)
-        TreeDict routing_table;
-        // graph/telemetry state (sink only)
-        srdcp_graph_state graph;
+        // tree table and graph/telemetry state (sink only, NULL on regular nodes)
+        srdcp_sink_store *sink;
 
         // 1: Wait to send topology report (may be able to append to incoming t-report)
         // 0: Send topology report right away
@@ -197,6 +412,11 @@ struct my_collect_conn
 
         /* Stabilization: do not switch parent during dwell window */
         clock_time_t parent_lock_until;
+#if SRDCP_WUS_BEACON_GROUP
+        // 1: parent lost, wurrdc matches every WuS metric group
+        uint8_t wus_group_open;
+        struct ctimer wus_group_timer;
+#endif
 };
 typedef struct my_collect_conn my_collect_conn;
 
@@ -232,6 +452,27 @@ void forward_downward_data(my_collect_conn *, const linkaddr_t *);
  */
 int sr_send(struct my_collect_conn *, const linkaddr_t *);
 
+/*
+   Multi-destination source routing: bundles one payload per destination
+   in a single frame carrying a branching route; forwarders split it where
+   the routes fork.
+   Params:
+    c: pointer to the collection connection structure
+    dests: destination addresses, in priority order
+    payloads: count * payload_len bytes, one payload per destination
+    payload_len: size of each payload
+    count: number of destinations
+    route_ok: per destination, set to 1 if its frame was sent, 0 if it has
+              no route or the MAC refused the frame
+   Returns the number of destinations consumed from the front of 'dests'
+   (bundled or without a route); the others did not fit in the frame.
+ */
+int sr_send_multi(struct my_collect_conn *, const linkaddr_t *, const void *, uint8_t, uint8_t, uint8_t *);
+
+/* Largest SRDCP unicast payload (SRDCP headers included) that fits one
+   802.15.4 frame once Rime and the framer added theirs */
+uint16_t my_collect_payload_max(void);
+
 void beacon_timer_cb(void *ptr);
 
 /* ---- Telemetry helpers (for apps) ---- */
@@ -254,6 +495,10 @@ struct beacon_msg
         /* Per-sender beacon counter to estimate PRR on neighbors */
         uint16_t tx_seq;
         uint16_t metric;
+#if SRDCP_PIGGY_ADAPTIVE
+        /* Nodes the sink wants a piggyback report from (SRDCP_PIGGY_STALE_BYTES) */
+        uint8_t stale[SRDCP_PIGGY_STALE_BYTES];
+#endif
 } __attribute__((packed));
 typedef struct beacon_msg beacon_msg;
 
@@ -261,14 +506,40 @@ struct upward_data_packet_header
 { // Header structure for data packets
         linkaddr_t source;
         uint8_t hops;
-        uint8_t piggy_len; // 0 in case there is no piggybacking
+        uint8_t piggy_len; // tree_connection entries at the end of the packet (0: no piggybacking), see UL_PIGGY_COUNT
 } __attribute__((packed));
 typedef struct upward_data_packet_header upward_data_packet_header;
 
+/* piggy_len: tree_connection count in the low 6 bits, number of piggyback
+ * TLVs after the header in the top 2 bits (the sink parses exactly these) */
+#define UL_PIGGY_COUNT(p) ((uint8_t)((p) & 0x3F))
+#define UL_PIGGY_TLVS(p) ((uint8_t)((p) >> 6))
+#define UL_PIGGY_SET_TLVS(n) ((uint8_t)((n) << 6))
+#if MAX_PATH_LENGTH > 0x3F
+#error "MAX_PATH_LENGTH must be <= 63 (tree_connection count of piggy_len)"
+#endif
+
+/* Aggregated UL frame: this header, then 'count' records. Each record is an
+ * upward_aggregate_record followed by 'len' bytes of an upward data packet
+ * without its packet type (upward_data_packet_header, TLVs, payload, then the
+ * tree_connection trailer). */
+struct upward_aggregate_header
+{
+        uint8_t count;
+} __attribute__((packed));
+typedef struct upward_aggregate_header upward_aggregate_header;
+
+struct upward_aggregate_record
+{
+        uint8_t len;
+        uint16_t held; // clock ticks already spent waiting in aggregates
+} __attribute__((packed));
+typedef struct upward_aggregate_record upward_aggregate_record;
+
 struct downward_data_packet_header
 {
         uint8_t hops;
-        uint8_t path_len;
+        uint8_t path_len; // route encoding (2 MSBs) + hops left, see source_route.h
 } __attribute__((packed));
 typedef struct downward_data_packet_header downward_data_packet_header;
 
@@ -0,0 +1,116 @@
+#include <string.h>
+#include "node_index.h"
+
+/* Cooja/Sky ids are mostly contiguous, so the id itself is a collision-free
+ * hash as long as the table is larger than the highest id. */
+#define NODE_INDEX_HASH(key, buckets) ((uint16_t)((key) & ((buckets) - 1)))
+
+/**
+ * @brief Empties an index.
+ * @param tab     The bucket array.
+ * @param buckets Number of buckets (power of two).
+ */
+void node_index_clear(node_index_entry *tab, uint16_t buckets)
+{
+        memset(tab, 0, buckets * sizeof(node_index_entry));
+}
+
+/**
+ * @brief Looks up the slot of a node.
+ * @param tab     The bucket array.
+ * @param buckets Number of buckets (power of two).
+ * @param addr    The node address.
+ * @return The slot stored for this node, or -1 if not indexed.
+ */
+int node_index_find(const node_index_entry *tab, uint16_t buckets, const linkaddr_t *addr)
+{
+        uint8_t key = addr->u8[0];
+        uint16_t i = NODE_INDEX_HASH(key, buckets);
+        uint16_t probes;
+
+        if (key == 0)
+                return -1;
+        for (probes = 0; probes < buckets; probes++)
+        {
+                if (tab[i].key == 0)
+                        return -1;
+                if (tab[i].key == key)
+                        return tab[i].slot;
+                i = (uint16_t)((i + 1) & (buckets - 1));
+        }
+        return -1;
+}
+
+/**
+ * @brief Adds or updates the slot of a node.
+ * @param tab     The bucket array.
+ * @param buckets Number of buckets (power of two).
+ * @param addr    The node address.
+ * @param slot    The slot in the owning table.
+ * @return 0 on success, -1 if the id is invalid or the index is full.
+ */
+int node_index_insert(node_index_entry *tab, uint16_t buckets, const linkaddr_t *addr, uint8_t slot)
+{
+        uint8_t key = addr->u8[0];
+        uint16_t i = NODE_INDEX_HASH(key, buckets);
+        uint16_t probes;
+
+        if (key == 0)
+                return -1;
+        for (probes = 0; probes < buckets; probes++)
+        {
+                if (tab[i].key == 0 || tab[i].key == key)
+                {
+                        tab[i].key = key;
+                        tab[i].slot = slot;
+                        return 0;
+                }
+                i = (uint16_t)((i + 1) & (buckets - 1));
+        }
+        return -1;
+}
+
+/**
+ * @brief Removes a node from the index.
+ * @param tab     The bucket array.
+ * @param buckets Number of buckets (power of two).
+ * @param addr    The node address.
+ * @details Uses backward-shift deletion so no tombstones are needed.
+ */
+void node_index_remove(node_index_entry *tab, uint16_t buckets, const linkaddr_t *addr)
+{
+        uint8_t key = addr->u8[0];
+        uint16_t mask = (uint16_t)(buckets - 1);
+        uint16_t i = NODE_INDEX_HASH(key, buckets);
+        uint16_t probes;
+
+        if (key == 0)
+                return;
+        for (probes = 0; probes < buckets; probes++)
+        {
+                if (tab[i].key == 0)
+                        return;
+                if (tab[i].key == key)
+                        break;
+                i = (uint16_t)((i + 1) & mask);
+        }
+        if (probes == buckets)
+                return;
+
+        /* Shift back followers whose home bucket is not in (i, j] */
+        uint16_t j = i;
+        while (1)
+        {
+                j = (uint16_t)((j + 1) & mask);
+                if (tab[j].key == 0)
+                        break;
+                uint16_t home = NODE_INDEX_HASH(tab[j].key, buckets);
+                if (((j - home) & mask) >= ((j - i) & mask))
+                {
+                        tab[i] = tab[j];
+                        i = j;
+                }
+        }
+        tab[i].key = 0;
+        tab[i].slot = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef NODE_INDEX_H
+#define NODE_INDEX_H
+
+#include <stdint.h>
+#include "core/net/linkaddr.h"
+#include "lib/assert.h"
+
+// ------------------------------------------------------------
+//                COMPACT NODE INDEX (OPEN ADDRESSING)
+// ------------------------------------------------------------
+/*
+ * Maps a node id to a slot of an owning table (TreeDict, srdcp_graph_state,
+ * PRR table). The key is the low address byte: SRDCP normalises the high
+ * byte to 0, so ids are 1..255 and id 0 marks an empty bucket. A zeroed
+ * bucket array is therefore a valid empty index.
+ *
+ * The bucket count must be a power of two, at least twice the capacity of
+ * the owning table (load factor <= 0.5 keeps linear probing short).
+ */
+
+typedef struct
+{
+        uint8_t key;  /* node id (0 = empty) */
+        uint8_t slot; /* index in the owning table */
+} node_index_entry;
+
+#define NODE_INDEX_ENTRY_BYTES 2
+CTASSERT(sizeof(node_index_entry) == NODE_INDEX_ENTRY_BYTES);
+
+void node_index_clear(node_index_entry *tab, uint16_t buckets);
+int node_index_find(const node_index_entry *tab, uint16_t buckets, const linkaddr_t *addr);
+int node_index_insert(node_index_entry *tab, uint16_t buckets, const linkaddr_t *addr, uint8_t slot);
+void node_index_remove(node_index_entry *tab, uint16_t buckets, const linkaddr_t *addr);
+
+#define NODE_INDEX_COUNT(tab) ((uint16_t)(sizeof(tab) / sizeof((tab)[0])))
+
+#endif // NODE_INDEX_H
@@ -0,0 +1,254 @@
+#include <string.h>
+#include "piggy_codec.h"
+
+/* RSSI nibble: 5 dB steps from -100 dBm (0) to -25 dBm (15) */
+#define PIGGY_RSSI_MIN -100
+#define PIGGY_RSSI_STEP 5
+
+/**
+ * @brief Quantizes an RSSI (dBm) to 4 bits.
+ */
+uint8_t piggy_rssi_quantize(int8_t rssi)
+{
+        if (rssi <= PIGGY_RSSI_MIN)
+                return 0;
+        int16_t q = (int16_t)((rssi - PIGGY_RSSI_MIN + PIGGY_RSSI_STEP / 2) / PIGGY_RSSI_STEP);
+        return (uint8_t)((q > 15) ? 15 : q);
+}
+
+/**
+ * @brief Returns the RSSI (dBm) a nibble stands for.
+ */
+int8_t piggy_rssi_dequantize(uint8_t q)
+{
+        return (int8_t)(PIGGY_RSSI_MIN + (q & 0x0F) * PIGGY_RSSI_STEP);
+}
+
+/**
+ * @brief Quantizes a PRR percentage (0..100) to 4 bits, rounding to nearest.
+ */
+uint8_t piggy_prr_quantize(uint8_t prr)
+{
+        if (prr > 100)
+                prr = 100;
+        return (uint8_t)(((uint16_t)prr * 15 + 50) / 100);
+}
+
+/**
+ * @brief Returns the PRR percentage a nibble stands for.
+ */
+uint8_t piggy_prr_dequantize(uint8_t q)
+{
+        return (uint8_t)(((uint16_t)(q & 0x0F) * 100 + 7) / 15);
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+        memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+}
+
+static uint16_t get16(const uint8_t **p)
+{
+        uint16_t v;
+        memcpy(&v, *p, sizeof(v));
+        *p += sizeof(v);
+        return v;
+}
+
+/**
+ * @brief Size of the status fields selected by a mask.
+ */
+static uint8_t status_fields_size(uint8_t mask)
+{
+        uint8_t size = 0;
+        if (mask & PIGGY_STATUS_F_BATTERY)
+                size += 2;
+        if (mask & PIGGY_STATUS_F_LOAD)
+                size += 1;
+        if (mask & PIGGY_STATUS_F_METRIC)
+                size += 1;
+        if (mask & PIGGY_STATUS_F_UL_DELAY)
+                size += 2;
+        if (mask & PIGGY_STATUS_F_DL_DELAY)
+                size += 2;
+        if (mask & PIGGY_STATUS_F_FLAGS)
+                size += 1;
+        return size;
+}
+
+/**
+ * @brief Encodes a node status as a STATUS_V2 TLV.
+ * @param tx     Delta state of this node (updated only if the TLV is written).
+ * @param status The current status.
+ * @param out    Output buffer.
+ * @param max    Room in the output buffer.
+ * @return TLV size; 0 if nothing changed or it does not fit.
+ * @details Only the fields that differ from the previous report are written, except
+ *          for keyframes (first report, then every SRDCP_PIGGY_KEYFRAME_PERIOD reports).
+ *          No TLV is written when nothing changed: the sink keeps what it has.
+ */
+uint8_t piggy_status_encode(piggy_status_tx *tx, const srdcp_node_status *status,
+                            uint8_t *out, uint8_t max)
+{
+        uint8_t mask = 0;
+        uint8_t flags;
+        uint8_t size;
+        uint8_t *p;
+
+        if (!tx->valid || tx->since_keyframe + 1 >= SRDCP_PIGGY_KEYFRAME_PERIOD)
+        {
+                mask = PIGGY_STATUS_F_ALL;
+        }
+        else
+        {
+                if (status->battery_mv != tx->last.battery_mv)
+                        mask |= PIGGY_STATUS_F_BATTERY;
+                if (status->queue_load != tx->last.queue_load)
+                        mask |= PIGGY_STATUS_F_LOAD;
+                if (status->metric != tx->last.metric)
+                        mask |= PIGGY_STATUS_F_METRIC;
+                if (status->ul_delay != tx->last.ul_delay)
+                        mask |= PIGGY_STATUS_F_UL_DELAY;
+                if (status->dl_delay != tx->last.dl_delay)
+                        mask |= PIGGY_STATUS_F_DL_DELAY;
+                if (status->flags != tx->last.flags)
+                        mask |= PIGGY_STATUS_F_FLAGS;
+        }
+        if (mask == 0)
+        {
+                tx->since_keyframe++;
+                return 0;
+        }
+        flags = (mask == PIGGY_STATUS_F_ALL) ? (uint8_t)(mask | PIGGY_STATUS_KEYFRAME) : mask;
+
+        size = (uint8_t)(sizeof(srdcp_piggy_tlv) + 2 + status_fields_size(mask));
+        if (size > max)
+                return 0;
+
+        srdcp_piggy_tlv tlv = {.type = SRDCP_PIGGY_TLV_STATUS_V2, .length = (uint8_t)(size - sizeof(srdcp_piggy_tlv))};
+        memcpy(out, &tlv, sizeof(tlv));
+        p = out + sizeof(tlv);
+        *p++ = flags;
+        *p++ = ++tx->seq;
+        if (mask & PIGGY_STATUS_F_BATTERY)
+                p = put16(p, status->battery_mv);
+        if (mask & PIGGY_STATUS_F_LOAD)
+                *p++ = status->queue_load;
+        if (mask & PIGGY_STATUS_F_METRIC)
+                *p++ = status->metric;
+        if (mask & PIGGY_STATUS_F_UL_DELAY)
+                p = put16(p, status->ul_delay);
+        if (mask & PIGGY_STATUS_F_DL_DELAY)
+                p = put16(p, status->dl_delay);
+        if (mask & PIGGY_STATUS_F_FLAGS)
+                *p++ = status->flags;
+
+        tx->last = *status;
+        tx->valid = 1;
+        tx->since_keyframe = (flags & PIGGY_STATUS_KEYFRAME) ? 0 : (uint8_t)(tx->since_keyframe + 1);
+        return size;
+}
+
+/**
+ * @brief Applies a STATUS_V2 payload on top of the last known status of its node.
+ * @param payload TLV payload.
+ * @param len     Payload length.
+ * @param status  In: last known status; out: updated status ('node' is left untouched).
+ * @param sync    In/out: PIGGY_SYNC_VALID | seq of the last applied report.
+ * @return The flags byte of the report, -1 if the payload is malformed.
+ */
+int piggy_status_decode(const uint8_t *payload, uint8_t len, srdcp_node_status *status, uint8_t *sync)
+{
+        const uint8_t *p = payload;
+        uint8_t flags, mask, seq;
+
+        if (len < 2)
+                return -1;
+        flags = *p++;
+        seq = *p++;
+        mask = flags & PIGGY_STATUS_F_ALL;
+        if (len != 2 + status_fields_size(mask))
+                return -1;
+
+        if (mask & PIGGY_STATUS_F_BATTERY)
+                status->battery_mv = get16(&p);
+        if (mask & PIGGY_STATUS_F_LOAD)
+                status->queue_load = *p++;
+        if (mask & PIGGY_STATUS_F_METRIC)
+                status->metric = *p++;
+        if (mask & PIGGY_STATUS_F_UL_DELAY)
+                status->ul_delay = get16(&p);
+        if (mask & PIGGY_STATUS_F_DL_DELAY)
+                status->dl_delay = get16(&p);
+        if (mask & PIGGY_STATUS_F_FLAGS)
+                status->flags = *p++;
+
+        if ((flags & PIGGY_STATUS_KEYFRAME) ||
+            ((*sync & PIGGY_SYNC_VALID) && ((*sync + 1) & PIGGY_SYNC_SEQ_MASK) == (seq & PIGGY_SYNC_SEQ_MASK)))
+                *sync = (uint8_t)(PIGGY_SYNC_VALID | (seq & PIGGY_SYNC_SEQ_MASK));
+        else
+                *sync = (uint8_t)(seq & PIGGY_SYNC_SEQ_MASK);
+        return flags;
+}
+
+/**
+ * @brief Encodes neighbor samples as a NEIGHBORS_V2 TLV (the load is sent in the status).
+ * @return TLV size, 0 if it does not fit.
+ */
+uint8_t piggy_neighbors_encode(const srdcp_piggy_neighbor_item *items, uint8_t count,
+                               uint8_t *out, uint8_t max)
+{
+        uint8_t size = (uint8_t)PIGGY_NEIGHBORS_V2_MAX(count);
+        uint8_t *p;
+        uint8_t i;
+
+        if (size > max)
+                return 0;
+        srdcp_piggy_tlv tlv = {.type = SRDCP_PIGGY_TLV_NEIGHBORS_V2, .length = (uint8_t)(size - sizeof(srdcp_piggy_tlv))};
+        memcpy(out, &tlv, sizeof(tlv));
+        p = out + sizeof(tlv);
+        *p++ = count;
+        for (i = 0; i < count; i++)
+        {
+                *p++ = items[i].neighbor.u8[0];
+                *p++ = (uint8_t)((piggy_rssi_quantize(items[i].rssi) << 4) | piggy_prr_quantize(items[i].prr));
+                *p++ = items[i].metric;
+        }
+        return size;
+}
+
+/**
+ * @brief Decodes a NEIGHBORS_V2 payload.
+ * @param payload TLV payload.
+ * @param len     Payload length.
+ * @param load    Queue load of the owner, copied into every item.
+ * @param items   Output items.
+ * @param max     Capacity of 'items'; extra neighbors are skipped.
+ * @return Number of items written, -1 if the payload is malformed.
+ */
+int piggy_neighbors_decode(const uint8_t *payload, uint8_t len, uint8_t load,
+                           srdcp_piggy_neighbor_item *items, uint8_t max)
+{
+        const uint8_t *p = payload;
+        uint8_t count, i;
+
+        if (len < 1)
+                return -1;
+        count = *p++;
+        if (len != 1 + 3 * count)
+                return -1;
+        if (count > max)
+                count = max;
+        for (i = 0; i < count; i++)
+        {
+                items[i].neighbor.u8[0] = *p++;
+                items[i].neighbor.u8[1] = 0;
+                items[i].rssi = piggy_rssi_dequantize((uint8_t)(*p >> 4));
+                items[i].prr = piggy_prr_dequantize((uint8_t)(*p & 0x0F));
+                p++;
+                items[i].metric = *p++;
+                items[i].load = load;
+        }
+        return count;
+}
@@ -0,0 +1,86 @@
+#ifndef PIGGY_CODEC_H
+#define PIGGY_CODEC_H
+
+#include <stdint.h>
+#include "my_collect.h"
+
+// ------------------------------------------------------------
+//                 COMPACT PIGGYBACK TLVs (VERSION 2)
+// ------------------------------------------------------------
+/*
+ * Version 1 is the original pair of TLVs (SRDCP_PIGGY_TLV_NEIGHBORS and
+ * SRDCP_PIGGY_TLV_STATUS, the raw structs of my_collect.h). Version 2
+ * uses its own TLV types, so the sink tells them apart and accepts both.
+ * The owner of both TLVs is the source of the UL packet, so v2 does not
+ * repeat its address.
+ *
+ *   STATUS_V2     flags byte: field mask (bits 0..5) | KEYFRAME (bit 7)
+ *                 seq byte: incremented on every status report
+ *                 then the fields set in the mask, in mask-bit order:
+ *                 battery_mv (2), queue_load (1), metric (1),
+ *                 ul_delay (2), dl_delay (2), flags (1)
+ *   NEIGHBORS_V2  count byte, then per neighbor:
+ *                 id (1), RSSI nibble << 4 | PRR nibble (1), metric (1)
+ *
+ * A status report only carries the fields that changed since the previous
+ * one, and is left out when none did. A keyframe carries them all; one is
+ * sent every SRDCP_PIGGY_KEYFRAME_PERIOD reports. The sink checks that seq
+ * follows the last report it applied. After a gap, the fields it has are marked
+ * unsynced until the next keyframe. The queue load is only sent in the
+ * status, and the sink applies it to every neighbor of the report.
+ */
+
+#define SRDCP_PIGGY_TLV_STATUS_V2 3
+#define SRDCP_PIGGY_TLV_NEIGHBORS_V2 4
+
+/* Piggyback format sent by the nodes (the sink parses both) */
+#ifndef SRDCP_PIGGY_VERSION
+#define SRDCP_PIGGY_VERSION 2
+#endif
+#ifndef SRDCP_PIGGY_KEYFRAME_PERIOD
+#define SRDCP_PIGGY_KEYFRAME_PERIOD 8
+#endif
+
+#define PIGGY_STATUS_F_BATTERY 0x01
+#define PIGGY_STATUS_F_LOAD 0x02
+#define PIGGY_STATUS_F_METRIC 0x04
+#define PIGGY_STATUS_F_UL_DELAY 0x08
+#define PIGGY_STATUS_F_DL_DELAY 0x10
+#define PIGGY_STATUS_F_FLAGS 0x20
+#define PIGGY_STATUS_F_ALL 0x3F
+#define PIGGY_STATUS_KEYFRAME 0x80
+
+/* Largest TLVs, header included */
+#define PIGGY_STATUS_V2_MAX (sizeof(srdcp_piggy_tlv) + 2 + 9)
+#define PIGGY_NEIGHBORS_V2_MAX(n) (sizeof(srdcp_piggy_tlv) + 1 + 3 * (n))
+
+/* Sink-side sync state of a node: seq of the last applied report */
+#define PIGGY_SYNC_VALID 0x80
+#define PIGGY_SYNC_SEQ_MASK 0x7F
+
+/* Node-side delta state: the last report that was sent */
+typedef struct
+{
+        srdcp_node_status last;
+        uint8_t seq;
+        uint8_t since_keyframe;
+        uint8_t valid;
+} piggy_status_tx;
+
+uint8_t piggy_rssi_quantize(int8_t rssi);
+int8_t piggy_rssi_dequantize(uint8_t q);
+uint8_t piggy_prr_quantize(uint8_t prr);
+uint8_t piggy_prr_dequantize(uint8_t q);
+
+/* Encoders write a full TLV (header included) and return its size, 0 if none was written */
+uint8_t piggy_status_encode(piggy_status_tx *tx, const srdcp_node_status *status,
+                            uint8_t *out, uint8_t max);
+uint8_t piggy_neighbors_encode(const srdcp_piggy_neighbor_item *items, uint8_t count,
+                               uint8_t *out, uint8_t max);
+
+/* Decoders read a TLV payload (after srdcp_piggy_tlv) and return -1 if it is malformed */
+int piggy_status_decode(const uint8_t *payload, uint8_t len, srdcp_node_status *status, uint8_t *sync);
+int piggy_neighbors_decode(const uint8_t *payload, uint8_t len, uint8_t load,
+                           srdcp_piggy_neighbor_item *items, uint8_t max);
+
+#endif /* PIGGY_CODEC_H */
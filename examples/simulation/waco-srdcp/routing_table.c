@@ -1,6 +1,8 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include "my_collect.h"
+#include "piggy_codec.h"
+#include "sys/prof.h"
 #include <string.h>
 #include <stdint.h>
 
@@ -39,24 +41,29 @@ void print_dict_state(TreeDict *dict)
         }
 }
 
+/**
+ * @brief Empties the dictionary and its node index.
+ * @param dict The parent table.
+ */
+void dict_init(TreeDict *dict)
+{
+        dict->len = 0;
+        node_index_clear(dict->index, NODE_INDEX_COUNT(dict->index));
+}
+
 /**
  * @brief Finds the index of an entry by its key (node address) in the dictionary.
  * @param dict The parent table.
  * @param key  The node address.
  * @return The index of the entry, or -1 if not found.
+ * @details O(1) lookup through the shared node index.
  */
 int dict_find_index(TreeDict *dict, const linkaddr_t key)
 {
-        int i;
-        for (i = 0; i < dict->len; i++)
-        {
-                DictEntry tmp = dict->entries[i];
-                if (linkaddr_cmp(&(tmp.key), &key) != 0)
-                {
-                        return i;
-                }
-        }
-        return -1;
+        int idx = node_index_find(dict->index, NODE_INDEX_COUNT(dict->index), &key);
+        if (idx < 0 || idx >= dict->len || !linkaddr_cmp(&dict->entries[idx].key, &key))
+                return -1;
+        return idx;
 }
 
 /**
@@ -120,6 +127,7 @@ int dict_add(TreeDict *dict, const linkaddr_t key, linkaddr_t value)
         }
         linkaddr_copy(&dict->entries[dict->len].key, &k);
         linkaddr_copy(&dict->entries[dict->len].value, &v);
+        node_index_insert(dict->index, NODE_INDEX_COUNT(dict->index), &k, (uint8_t)dict->len);
         dict->len++;
         return 0;
 }
@@ -131,12 +139,12 @@ int dict_add(TreeDict *dict, const linkaddr_t key, linkaddr_t value)
 
 /**
  * @brief Initializes the routing path array (tree_path) with linkaddr_null.
- * @param conn The collect connection structure (which contains routing_table.tree_path).
+ * @param conn The collect connection structure (its sink store holds tree_path).
  */
 void init_routing_path(my_collect_conn *conn)
 {
         int i = 0;
-        linkaddr_t *path_ptr = conn->routing_table.tree_path;
+        linkaddr_t *path_ptr = conn->sink->routing_table.tree_path;
         while (i < MAX_PATH_LENGTH)
         {
                 linkaddr_copy(path_ptr, &linkaddr_null);
@@ -157,7 +165,7 @@ int already_in_route(my_collect_conn *conn, uint8_t len, linkaddr_t *target)
         int i;
         for (i = 0; i < len; i++)
         {
-                if (linkaddr_cmp(&conn->routing_table.tree_path[i], target))
+                if (linkaddr_cmp(&conn->sink->routing_table.tree_path[i], target))
                 {
                         return true;
                 }
@@ -165,26 +173,35 @@ int already_in_route(my_collect_conn *conn, uint8_t len, linkaddr_t *target)
         return false;
 }
 
-static int node_index_of(const linkaddr_t nodes[], int count, const linkaddr_t *addr)
+/**
+ * @brief Returns the graph node stored in a slot.
+ * @param graph The sink graph state.
+ * @param slot  The graph slot.
+ * @return A pointer to the node, or NULL if the page of the slot is not allocated.
+ */
+srdcp_graph_node *graph_node_at(srdcp_graph_state *graph, uint8_t slot)
 {
-        int i;
-        for (i = 0; i < count; i++)
-        {
-                if (linkaddr_cmp(&nodes[i], addr))
-                        return i;
-        }
-        return -1;
+        if (slot >= MAX_NODES)
+                return NULL;
+        srdcp_graph_page *page = graph->pages[slot / SRDCP_GRAPH_PAGE_NODES];
+        return page ? &page->nodes[slot % SRDCP_GRAPH_PAGE_NODES] : NULL;
 }
 
-static srdcp_graph_node *graph_get_node(srdcp_graph_state *graph, const linkaddr_t *addr)
+/**
+ * @brief Looks up a node of the sink graph in O(1) through the node index.
+ * @param graph The sink graph state.
+ * @param addr  The node address.
+ * @return A pointer to the graph node, or NULL if unknown.
+ */
+srdcp_graph_node *graph_get_node(srdcp_graph_state *graph, const linkaddr_t *addr)
 {
-        int i;
-        for (i = 0; i < MAX_NODES; i++)
-        {
-                if (graph->nodes[i].used && linkaddr_cmp(&graph->nodes[i].node, addr))
-                        return &graph->nodes[i];
-        }
-        return NULL;
+        int i = node_index_find(graph->index, NODE_INDEX_COUNT(graph->index), addr);
+        if (i < 0)
+                return NULL;
+        srdcp_graph_node *node = graph_node_at(graph, (uint8_t)i);
+        if (!node || !node->used || !linkaddr_cmp(&node->node, addr))
+                return NULL;
+        return node;
 }
 
 static bool edge_is_fresh(const srdcp_graph_edge *edge)
@@ -203,213 +220,447 @@ static uint16_t edge_cost(const srdcp_graph_edge *edge)
         return (uint16_t)(hop_penalty + prr_penalty + load_penalty);
 }
 
-static int ensure_node(linkaddr_t nodes[], srdcp_graph_node *ptrs[], int *count, int max,
-                       srdcp_graph_state *graph, const linkaddr_t *addr)
+static bool edge_is_usable(const srdcp_graph_edge *edge)
 {
-        int idx = node_index_of(nodes, *count, addr);
-        if (idx >= 0)
-                return idx;
-        if (*count >= max)
-                return -1;
-        linkaddr_copy(&nodes[*count], addr);
-        ptrs[*count] = graph_get_node(graph, addr);
-        idx = *count;
-        (*count)++;
-        return idx;
+        return edge->slot != SRDCP_SLOT_NONE && edge_is_fresh(edge) &&
+               edge->prr >= SRDCP_GRAPH_MIN_PRR;
+}
+
+static srdcp_graph_edge *graph_edge_at(srdcp_graph_state *graph, uint16_t id)
+{
+        return &graph_node_at(graph, SRDCP_EDGE_OWNER(id))->neighbors[SRDCP_EDGE_INDEX(id)];
 }
 
 /**
- * @brief Finds a route from the SINK to a destination by backtracking through parents.
- * @param conn The collect connection structure (at the SINK).
- * @param dest The destination address.
- * @return The path length, or 0 on error (no route, loop detected, or path too long).
- * @details The path is constructed by traversing the parent dictionary backwards from the destination.
+ * @brief Adds the edges of a slot to the reverse adjacency lists of their
+ *        targets.
+ * @param graph The sink graph state.
+ * @param slot  The slot whose neighbor list was just written.
  */
-static int find_route_tree(my_collect_conn *conn, const linkaddr_t *dest)
+void graph_edges_link(srdcp_graph_state *graph, uint8_t slot)
 {
-        init_routing_path(conn);
-
-        uint8_t path_len = 0;
-        linkaddr_t parent;
-        linkaddr_copy(&parent, dest);
-        do
+        srdcp_graph_node *node = graph_node_at(graph, slot);
+        uint8_t e;
+        for (e = 0; e < node->neighbor_count; e++)
         {
-                /* Copy the current node into the path */
-                memcpy(&conn->routing_table.tree_path[path_len], &parent, sizeof(linkaddr_t));
-                parent = dict_find(&conn->routing_table, &parent);
-                /* Abort if a node has no parent or if a loop is detected */
-                if (linkaddr_cmp(&parent, &linkaddr_null) ||
-                    already_in_route(conn, path_len, &parent))
-                {
-                        printf("PATH ERROR: cannot build path for destination node: %02u:%02u. Loop detected.\n",
-                               (*dest).u8[0], (*dest).u8[1]);
-                        return 0;
-                }
-                path_len++;
-        } while (!linkaddr_cmp(&parent, &sink_addr) && path_len < MAX_PATH_LENGTH);
+                srdcp_graph_edge *edge = &node->neighbors[e];
+                srdcp_graph_node *target = graph_node_at(graph, edge->slot);
+                if (!target || edge->slot == slot)
+                        continue;
+                edge->in_next = target->in_head;
+                target->in_head = SRDCP_EDGE_ID(slot, e);
+        }
+}
 
-        if (path_len > MAX_PATH_LENGTH)
+/**
+ * @brief Removes the edges of a slot from the reverse adjacency lists of
+ *        their targets.
+ * @param graph The sink graph state.
+ * @param slot  The slot whose neighbor list is about to be replaced.
+ * @details O(in-degree) per edge: the lists are singly linked.
+ */
+void graph_edges_unlink(srdcp_graph_state *graph, uint8_t slot)
+{
+        srdcp_graph_node *node = graph_node_at(graph, slot);
+        uint8_t e;
+        for (e = 0; e < node->neighbor_count; e++)
         {
-                /* Path is too long */
-                printf("PATH ERROR: Path too long for destination node: %02u:%02u\n",
-                       (*dest).u8[0], (*dest).u8[1]);
-                return 0;
+                srdcp_graph_node *target = graph_node_at(graph, node->neighbors[e].slot);
+                if (!target || node->neighbors[e].slot == slot)
+                        continue;
+                uint16_t id = SRDCP_EDGE_ID(slot, e);
+                uint16_t *link = &target->in_head;
+                while (*link != SRDCP_EDGE_NONE && *link != id)
+                        link = &graph_edge_at(graph, *link)->in_next;
+                if (*link == id)
+                        *link = node->neighbors[e].in_next;
         }
-        return path_len;
 }
 
-static int find_route_graph(my_collect_conn *conn, const linkaddr_t *dest)
+#if SRDCP_PIGGY_ADAPTIVE
+/**
+ * @brief Builds the stale bitmap the sink sends in its beacons.
+ * @param conn   The collect connection (SINK).
+ * @param bitmap Output, SRDCP_PIGGY_STALE_BYTES bytes; bit i is node id i.
+ * @return Number of nodes flagged.
+ * @details Every node of the parent table is checked: it is flagged if the
+ *          graph has no report from it, if its last report (status or
+ *          neighbors) is older than SRDCP_PIGGY_STALE_AGE, or if its v2 status
+ *          lost sync. A flagged node attaches a full report to its next UL.
+ */
+uint8_t graph_stale_bitmap(my_collect_conn *conn, uint8_t *bitmap)
 {
-        if (!conn->is_sink)
-                return 0;
-        if (linkaddr_cmp(dest, &sink_addr))
+        memset(bitmap, 0, SRDCP_PIGGY_STALE_BYTES);
+        if (!conn->sink)
                 return 0;
+        TreeDict *dict = &conn->sink->routing_table;
+        clock_time_t now = clock_time();
+        uint8_t flagged = 0;
+        int i;
+        for (i = 0; i < dict->len; i++)
+        {
+                const linkaddr_t *addr = &dict->entries[i].key;
+                if (addr->u8[0] >= SRDCP_PIGGY_STALE_BYTES * 8 || linkaddr_cmp(addr, &sink_addr))
+                        continue;
 
-        linkaddr_t nodes[MAX_NODES];
-        srdcp_graph_node *ptrs[MAX_NODES];
-        int count = 0;
+                srdcp_graph_node *node = graph_get_node(&conn->sink->graph, addr);
+                bool stale = true;
+                if (node)
+                {
+                        /* Age of the newest report, status or neighbors */
+                        uint8_t k;
+                        for (k = 0; k <= node->neighbor_count && k <= SRDCP_GRAPH_MAX_NEIGHBORS; k++)
+                        {
+                                clock_time_t t = (k == 0) ? node->status_last_update : node->neighbors[k - 1].last_update;
+                                if (t != 0 && (clock_time_t)(now - t) <= SRDCP_PIGGY_STALE_AGE)
+                                        stale = false;
+                        }
+#if SRDCP_PIGGY_VERSION >= 2
+                        if (node->status_last_update != 0 && !(node->status_sync & PIGGY_SYNC_VALID))
+                                stale = true;
+#endif
+                }
+                if (stale)
+                {
+                        bitmap[addr->u8[0] / 8] |= (uint8_t)(1 << (addr->u8[0] % 8));
+                        flagged++;
+                }
+        }
+        return flagged;
+}
+#endif
 
-        memset(nodes, 0, sizeof(nodes));
-        memset(ptrs, 0, sizeof(ptrs));
+// -------------------------------------------------------------------------------------------------
+//                                      SHORTEST-PATH TREE CACHE
+// -------------------------------------------------------------------------------------------------
 
-        if (ensure_node(nodes, ptrs, &count, MAX_NODES, &conn->graph, &sink_addr) < 0)
-                return 0;
+/**
+ * @brief Tries to improve dist[v] through the edge (u, v).
+ * @return true if dist[v] decreased.
+ */
+static bool spt_relax(srdcp_spt_cache *spt, uint8_t u, uint8_t v,
+                      uint8_t owner, uint8_t eidx, uint16_t cost)
+{
+        if (spt->dist[u] == SRDCP_SPT_DIST_INF || u == v)
+                return false;
+        uint32_t alt = (uint32_t)spt->dist[u] + cost;
+        if (alt >= spt->dist[v])
+                return false;
+        spt->dist[v] = (srdcp_spt_dist_t)alt;
+        spt->prev[v] = u;
+        spt->via_owner[v] = owner;
+        spt->via_edge[v] = eidx;
+        return true;
+}
 
-        /* Ensure destination exists in the index even if we have little data */
-        if (ensure_node(nodes, ptrs, &count, MAX_NODES, &conn->graph, dest) < 0)
-                return 0;
+/* Slots whose distance decreased and whose edges still have to be relaxed */
+typedef struct
+{
+        uint8_t queued[MAX_NODES];
+        uint8_t slot[MAX_NODES];
+        uint8_t head;
+        uint8_t count;
+} spt_worklist;
 
-        int i;
-        for (i = 0; i < MAX_NODES && count < MAX_NODES; i++)
+static void spt_worklist_push(spt_worklist *wl, uint8_t v)
+{
+        if (wl->queued[v])
+                return;
+        wl->queued[v] = 1;
+        wl->slot[(wl->head + wl->count) % MAX_NODES] = v;
+        wl->count++;
+}
+
+/**
+ * @brief Relaxes every usable edge incident to slot u: its own neighbor list
+ *        and, through its reverse adjacency list, the edges other owners
+ *        reported towards it.
+ * @param wl If not NULL, slots whose distance improved are queued here.
+ */
+static void spt_relax_incident(srdcp_graph_state *graph, uint8_t u, spt_worklist *wl)
+{
+        srdcp_spt_cache *spt = &graph->spt;
+        srdcp_graph_node *node = graph_node_at(graph, u);
+        uint8_t e;
+        uint16_t id;
+
+        for (e = 0; e < node->neighbor_count; e++)
         {
-                if (!conn->graph.nodes[i].used)
+                srdcp_graph_edge *edge = &node->neighbors[e];
+                if (!edge_is_usable(edge))
                         continue;
-                ensure_node(nodes, ptrs, &count, MAX_NODES, &conn->graph, &conn->graph.nodes[i].node);
+                if (spt_relax(spt, u, edge->slot, u, e, edge_cost(edge)) && wl)
+                        spt_worklist_push(wl, edge->slot);
         }
 
-        /* Include neighbor endpoints */
-        int gi;
-        for (gi = 0; gi < MAX_NODES && count < MAX_NODES; gi++)
+        for (id = node->in_head; id != SRDCP_EDGE_NONE; id = graph_edge_at(graph, id)->in_next)
         {
-                if (!conn->graph.nodes[gi].used)
+                uint8_t w = SRDCP_EDGE_OWNER(id);
+                srdcp_graph_edge *edge = graph_edge_at(graph, id);
+                if (!edge_is_usable(edge))
                         continue;
-                srdcp_graph_node *gn = &conn->graph.nodes[gi];
-                uint8_t e;
-                for (e = 0; e < gn->neighbor_count; e++)
-                {
-                        ensure_node(nodes, ptrs, &count, MAX_NODES, &conn->graph, &gn->neighbors[e].neighbor);
-                }
+                if (spt_relax(spt, u, w, w, SRDCP_EDGE_INDEX(id), edge_cost(edge)) && wl)
+                        spt_worklist_push(wl, w);
         }
+}
 
-        int dest_idx = node_index_of(nodes, count, dest);
-        if (dest_idx < 0)
-                return 0;
-
-        if (count <= 1)
-                return 0;
-
-        uint16_t dist[MAX_NODES];
-        int16_t prev[MAX_NODES];
+/**
+ * @brief Rebuilds the whole shortest-path tree from the sink (Dijkstra).
+ */
+static void spt_recompute(srdcp_graph_state *graph)
+{
+        srdcp_spt_cache *spt = &graph->spt;
         uint8_t visited[MAX_NODES];
+        int i;
 
-        for (i = 0; i < count; i++)
+        for (i = 0; i < MAX_NODES; i++)
         {
-                dist[i] = 0xFFFF;
-                prev[i] = -1;
+                spt->dist[i] = SRDCP_SPT_DIST_INF;
+                spt->prev[i] = SRDCP_SLOT_NONE;
+                spt->via_owner[i] = SRDCP_SLOT_NONE;
+                spt->via_edge[i] = 0;
                 visited[i] = 0;
         }
-        dist[0] = 0; /* sink */
+        spt->recomputes++;
+        spt->dirty = 0;
+
+        srdcp_graph_node *root = graph_get_node(graph, &sink_addr);
+        if (!root)
+        {
+                spt->source = SRDCP_SLOT_NONE;
+                return;
+        }
+        spt->source = root->slot;
+        spt->dist[spt->source] = 0;
 
-        int iter;
-        for (iter = 0; iter < count; iter++)
+        while (1)
         {
                 int u = -1;
-                uint16_t best = 0xFFFF;
-                for (i = 0; i < count; i++)
+                srdcp_spt_dist_t best = SRDCP_SPT_DIST_INF;
+                for (i = 0; i < MAX_NODES; i++)
                 {
-                        if (!visited[i] && dist[i] < best)
+                        if (!visited[i] && spt->dist[i] < best)
                         {
-                                best = dist[i];
+                                best = spt->dist[i];
                                 u = i;
                         }
                 }
-                if (u < 0 || best == 0xFFFF)
+                if (u < 0)
                         break;
-
                 visited[u] = 1;
-                if (u == dest_idx)
-                        break;
+                spt_relax_incident(graph, (uint8_t)u, NULL);
+        }
+}
 
-                /* Direct neighbors from this node */
-                srdcp_graph_node *node = ptrs[u];
-                if (node)
+/**
+ * @brief Propagates distance decreases from the queued slots until the
+ *        tree is consistent again (decrease-only dynamic SSSP).
+ * @details Each step only touches the edges incident to the slot taken off
+ *          the worklist.
+ */
+static void spt_propagate(srdcp_graph_state *graph, spt_worklist *wl)
+{
+        while (wl->count > 0)
+        {
+                uint8_t u = wl->slot[wl->head];
+                wl->head = (uint8_t)((wl->head + 1) % MAX_NODES);
+                wl->count--;
+                wl->queued[u] = 0;
+                spt_relax_incident(graph, u, wl);
+        }
+}
+
+/**
+ * @brief Marks the cached shortest-path tree as invalid.
+ * @param graph The sink graph state.
+ */
+void graph_spt_reset(srdcp_graph_state *graph)
+{
+        graph->spt.dirty = 1;
+}
+
+/**
+ * @brief Initializes the cache entry of a newly created graph slot.
+ * @param graph The sink graph state.
+ * @param slot  The slot that was just allocated.
+ */
+void graph_spt_node_added(srdcp_graph_state *graph, uint8_t slot)
+{
+        graph->spt.dist[slot] = SRDCP_SPT_DIST_INF;
+        graph->spt.prev[slot] = SRDCP_SLOT_NONE;
+        graph->spt.via_owner[slot] = SRDCP_SLOT_NONE;
+        if (linkaddr_cmp(&graph_node_at(graph, slot)->node, &sink_addr))
+                graph->spt.dirty = 1; /* the root just appeared */
+}
+
+/**
+ * @brief Updates the cached tree after the neighbor list of a slot was replaced.
+ * @param graph     The sink graph state.
+ * @param slot      The slot whose neighbor list changed.
+ * @param old       Copy of the previous neighbor list.
+ * @details Improvements (new edges, lower costs) are propagated incrementally.
+ *          If an edge used by the tree got worse or disappeared, the tree is
+ *          marked dirty and rebuilt on the next lookup.
+ */
+void graph_spt_edges_changed(srdcp_graph_state *graph, uint8_t slot,
+                             const srdcp_graph_edge *old)
+{
+        srdcp_spt_cache *spt = &graph->spt;
+        srdcp_graph_node *node = graph_node_at(graph, slot);
+        spt_worklist wl;
+        int v;
+        uint8_t e;
+
+        if (spt->dirty)
+                return;
+
+        memset(&wl, 0, sizeof(wl));
+
+        /* Re-point tree edges owned by this slot to the new neighbor list */
+        for (v = 0; v < MAX_NODES; v++)
+        {
+                if (spt->via_owner[v] != slot || spt->prev[v] == SRDCP_SLOT_NONE)
+                        continue;
+                uint8_t other = (v == slot) ? spt->prev[v] : (uint8_t)v;
+                uint16_t old_cost = edge_cost(&old[spt->via_edge[v]]);
+                int found = -1;
+                for (e = 0; e < node->neighbor_count; e++)
                 {
-                        uint8_t eidx;
-                        for (eidx = 0; eidx < node->neighbor_count; eidx++)
+                        if (node->neighbors[e].slot == other && edge_is_usable(&node->neighbors[e]))
                         {
-                                srdcp_graph_edge *edge = &node->neighbors[eidx];
-                                if (!edge_is_fresh(edge) || edge->prr < SRDCP_GRAPH_MIN_PRR)
-                                        continue;
-                                int v = node_index_of(nodes, count, &edge->neighbor);
-                                if (v < 0)
-                                        continue;
-                                uint16_t cost = edge_cost(edge);
-                                uint32_t alt = (uint32_t)dist[u] + cost;
-                                if (alt < dist[v])
-                                {
-                                        dist[v] = (uint16_t)alt;
-                                        prev[v] = u;
-                                }
+                                found = e;
+                                break;
                         }
                 }
-
-                /* Implicit reverse edges: other owners that list this node */
-                for (gi = 0; gi < MAX_NODES; gi++)
+                if (found < 0 || edge_cost(&node->neighbors[found]) > old_cost)
                 {
-                        if (!conn->graph.nodes[gi].used)
-                                continue;
-                        srdcp_graph_node *gn = &conn->graph.nodes[gi];
-                        uint8_t eidx;
-                        for (eidx = 0; eidx < gn->neighbor_count; eidx++)
-                        {
-                                srdcp_graph_edge *edge = &gn->neighbors[eidx];
-                                if (!linkaddr_cmp(&edge->neighbor, &nodes[u]))
-                                        continue;
-                                if (!edge_is_fresh(edge) || edge->prr < SRDCP_GRAPH_MIN_PRR)
-                                        continue;
-                                int v = node_index_of(nodes, count, &gn->node);
-                                if (v < 0)
-                                        continue;
-                                uint16_t cost = edge_cost(edge);
-                                uint32_t alt = (uint32_t)dist[u] + cost;
-                                if (alt < dist[v])
-                                {
-                                        dist[v] = (uint16_t)alt;
-                                        prev[v] = u;
-                                }
-                        }
+                        spt->dirty = 1;
+                        return;
                 }
+                spt->via_edge[v] = (uint8_t)found;
+                if (edge_cost(&node->neighbors[found]) < old_cost)
+                {
+                        spt->dist[v] = (srdcp_spt_dist_t)(spt->dist[spt->prev[v]] + edge_cost(&node->neighbors[found]));
+                        spt_worklist_push(&wl, (uint8_t)v);
+                }
+        }
+
+        /* New or cheaper edges: relax from both endpoints */
+        spt_worklist_push(&wl, slot);
+        for (e = 0; e < node->neighbor_count; e++)
+        {
+                if (node->neighbors[e].slot != SRDCP_SLOT_NONE)
+                        spt_worklist_push(&wl, node->neighbors[e].slot);
         }
+        spt_propagate(graph, &wl);
+        spt->updates++;
+}
+
+/**
+ * @brief Walks the cached tree from dest to the sink into tree_path.
+ * @return The path length, 0 if dest is unreachable, or -1 if an edge along
+ *         the path has aged out (tree must be rebuilt).
+ */
+static int spt_walk(my_collect_conn *conn, uint8_t dest)
+{
+        srdcp_graph_state *graph = &conn->sink->graph;
+        srdcp_spt_cache *spt = &graph->spt;
+        uint8_t path_len = 0;
+        uint8_t v = dest;
 
-        if (dist[dest_idx] == 0xFFFF)
+        if (spt->source == SRDCP_SLOT_NONE || spt->dist[dest] == SRDCP_SPT_DIST_INF)
                 return 0;
 
         init_routing_path(conn);
-        int idx = dest_idx;
+        while (v != spt->source)
+        {
+                if (path_len >= MAX_PATH_LENGTH || spt->prev[v] == SRDCP_SLOT_NONE)
+                        return 0;
+                if (!edge_is_usable(&graph_node_at(graph, spt->via_owner[v])->neighbors[spt->via_edge[v]]))
+                        return -1;
+                linkaddr_copy(&conn->sink->routing_table.tree_path[path_len], &graph_node_at(graph, v)->node);
+                path_len++;
+                v = spt->prev[v];
+        }
+        return path_len;
+}
+
+/**
+ * @brief Finds a route from the SINK to a destination by backtracking through parents.
+ * @param conn The collect connection structure (at the SINK).
+ * @param dest The destination address.
+ * @return The path length, or 0 on error (no route, loop detected, or path too long).
+ * @details The path is constructed by traversing the parent dictionary backwards from the destination.
+ */
+static int find_route_tree(my_collect_conn *conn, const linkaddr_t *dest)
+{
+        init_routing_path(conn);
+
         uint8_t path_len = 0;
-        while (idx > 0 && idx >= 0)
+        linkaddr_t parent;
+        linkaddr_copy(&parent, dest);
+        do
         {
-            if (path_len >= MAX_PATH_LENGTH)
-                    return 0;
-            linkaddr_copy(&conn->routing_table.tree_path[path_len], &nodes[idx]);
-            idx = prev[idx];
-            if (idx < 0)
-                    break;
-            path_len++;
+                /* Copy the current node into the path */
+                memcpy(&conn->sink->routing_table.tree_path[path_len], &parent, sizeof(linkaddr_t));
+                parent = dict_find(&conn->sink->routing_table, &parent);
+                /* Abort if a node has no parent or if a loop is detected */
+                if (linkaddr_cmp(&parent, &linkaddr_null) ||
+                    already_in_route(conn, path_len, &parent))
+                {
+                        printf("PATH ERROR: cannot build path for destination node: %02u:%02u. Loop detected.\n",
+                               (*dest).u8[0], (*dest).u8[1]);
+                        return 0;
+                }
+                path_len++;
+        } while (!linkaddr_cmp(&parent, &sink_addr) && path_len < MAX_PATH_LENGTH);
+
+        if (!linkaddr_cmp(&parent, &sink_addr))
+        {
+                /* Path is too long */
+                printf("PATH ERROR: Path too long for destination node: %02u:%02u\n",
+                       (*dest).u8[0], (*dest).u8[1]);
+                return 0;
         }
         return path_len;
 }
 
+/**
+ * @brief Finds a route from the SINK to a destination using the piggybacked graph.
+ * @param conn The collect connection structure (at the SINK).
+ * @param dest The destination address.
+ * @return The path length, or 0 if the graph has no fresh path to dest.
+ * @details Served from the cached shortest-path tree in O(path length); the
+ *          tree is only rebuilt when it is dirty or a path edge has aged out.
+ */
+static int find_route_graph(my_collect_conn *conn, const linkaddr_t *dest)
+{
+        if (!conn->is_sink)
+                return 0;
+        if (linkaddr_cmp(dest, &sink_addr))
+                return 0;
+
+        srdcp_graph_state *graph = &conn->sink->graph;
+        srdcp_graph_node *target = graph_get_node(graph, dest);
+        if (!target)
+                return 0;
+        uint8_t slot = target->slot;
+
+        int len = -1;
+        if (!graph->spt.dirty)
+        {
+                len = spt_walk(conn, slot);
+                if (len >= 0)
+                        graph->spt.hits++;
+        }
+        if (len < 0)
+        {
+                spt_recompute(graph);
+                len = spt_walk(conn, slot);
+        }
+        return (len > 0) ? len : 0;
+}
+
 /**
  * @brief Prints the route (tree_path) that was just found for a destination.
  * @param conn      The collect connection structure.
@@ -424,20 +675,45 @@ void print_route(my_collect_conn *conn, uint8_t route_len, const linkaddr_t *des
         {
                 printf("\t%d: %02u:%02u\n",
                        i,
-                       conn->routing_table.tree_path[i].u8[0],
-                       conn->routing_table.tree_path[i].u8[1]);
+                       conn->sink->routing_table.tree_path[i].u8[0],
+                       conn->sink->routing_table.tree_path[i].u8[1]);
         }
 }
 
+#if SRDCP_SPT_STATS
+/**
+ * @brief Prints the shortest-path cache counters (STAT,SPT) every
+ *        SRDCP_SPT_STATS_PERIOD graph routes.
+ */
+static void spt_stats_account(const srdcp_spt_cache *spt)
+{
+        static uint16_t routes;
+        if (++routes < SRDCP_SPT_STATS_PERIOD)
+                return;
+        routes = 0;
+        printf("STAT,SPT,time=%lu,hits=%u,recomputes=%u,updates=%u\n",
+               (unsigned long)clock_time(), spt->hits, spt->recomputes, spt->updates);
+}
+#else
+#define spt_stats_account(spt)
+#endif
+
 int find_route(my_collect_conn *conn, const linkaddr_t *dest)
 {
+        if (!conn->sink)
+                return 0;
+        PROF_ENTER(find_route_graph);
         int len = find_route_graph(conn, dest);
+        PROF_EXIT(find_route_graph);
         if (len > 0)
         {
                 printf("Graph route selected len=%d\n", len);
+                spt_stats_account(&conn->sink->graph.spt);
                 return len;
         }
+        PROF_ENTER(find_route_tree);
         len = find_route_tree(conn, dest);
+        PROF_EXIT(find_route_tree);
         if (len > 0)
         {
                 printf("Fallback tree route len=%d\n", len);
@@ -6,6 +6,7 @@
 // ------------------------------------------------------------
 
 
+void dict_init(TreeDict*);
 void print_dict_state(TreeDict*);
 int dict_find_index(TreeDict*, const linkaddr_t);
 int dict_add(TreeDict*, const linkaddr_t, linkaddr_t);
@@ -19,4 +20,19 @@ int already_in_route(my_collect_conn*, uint8_t, linkaddr_t*);
 int find_route(my_collect_conn*, const linkaddr_t*);
 void print_route(my_collect_conn*, uint8_t, const linkaddr_t*);
 
+// ------------------------------------------------------------
+//                GRAPH & SHORTEST-PATH TREE CACHE (SINK)
+// ------------------------------------------------------------
+
+srdcp_graph_node *graph_get_node(srdcp_graph_state*, const linkaddr_t*);
+srdcp_graph_node *graph_node_at(srdcp_graph_state*, uint8_t);
+void graph_edges_link(srdcp_graph_state*, uint8_t);
+void graph_edges_unlink(srdcp_graph_state*, uint8_t);
+void graph_spt_reset(srdcp_graph_state*);
+void graph_spt_node_added(srdcp_graph_state*, uint8_t);
+void graph_spt_edges_changed(srdcp_graph_state*, uint8_t, const srdcp_graph_edge*);
+#if SRDCP_PIGGY_ADAPTIVE
+uint8_t graph_stale_bitmap(my_collect_conn*, uint8_t*);
+#endif
+
 #endif //ROUTING_TABLE_H
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "lib/memb.h"
+#include "sink_store.h"
+#include "routing_table.h"
+
+/* Pools of the sink image, see SINK_STORE_POOLS(); NULL in router images */
+static struct memb *store_pool;
+static struct memb *page_pool;
+
+/**
+ * @brief Hands the sink image's pools over to the store.
+ * @param stores Pool of srdcp_sink_store.
+ * @param pages Pool of srdcp_graph_page.
+ * @details Called through SINK_STORE_USE_POOLS() before my_collect_open().
+ */
+void sink_store_use_pools(struct memb *stores, struct memb *pages)
+{
+        store_pool = stores;
+        page_pool = pages;
+}
+
+/**
+ * @brief Initializes the sink store and graph page pools, if the image has any.
+ */
+void sink_store_init(void)
+{
+        if (store_pool == NULL)
+                return;
+        memb_init(store_pool);
+        memb_init(page_pool);
+}
+
+/**
+ * @brief Allocates an empty routing store for the sink.
+ * @return A pointer to the store, or NULL if the pool is exhausted or the
+ *         image has no pools.
+ * @details The parent dictionary and the graph are cleared; graph pages are
+ *          only allocated when nodes get created.
+ */
+srdcp_sink_store *sink_store_alloc(void)
+{
+        srdcp_sink_store *store;
+
+        if (store_pool == NULL)
+        {
+                printf("Sink store: router-only image, no sink routing state "
+                       "(build the -sink image for the sink)\n");
+                return NULL;
+        }
+        store = memb_alloc(store_pool);
+        if (store == NULL)
+        {
+                printf("Sink store: pool exhausted (SRDCP_SINK_STORE_POOL=%u)\n",
+                       (unsigned)SRDCP_SINK_STORE_POOL);
+                return NULL;
+        }
+        memset(store, 0, sizeof(*store));
+        dict_init(&store->routing_table);
+        graph_spt_reset(&store->graph);
+        return store;
+}
+
+/**
+ * @brief Allocates a zeroed page of graph nodes.
+ * @return A pointer to the page, or NULL if SRDCP_GRAPH_PAGES are in use.
+ */
+srdcp_graph_page *sink_store_page_alloc(void)
+{
+        srdcp_graph_page *page = page_pool ? memb_alloc(page_pool) : NULL;
+        if (page == NULL)
+        {
+                printf("Sink store: graph page pool exhausted (%u pages of %u nodes)\n",
+                       (unsigned)SRDCP_GRAPH_PAGES, (unsigned)SRDCP_GRAPH_PAGE_NODES);
+                return NULL;
+        }
+        memset(page, 0, sizeof(*page));
+        return page;
+}
@@ -0,0 +1,47 @@
+#ifndef SINK_STORE_H
+#define SINK_STORE_H
+
+#include "lib/memb.h"
+#include "my_collect.h"
+
+// ------------------------------------------------------------
+//                SINK ROUTING STORE
+// ------------------------------------------------------------
+/*
+ * The parent dictionary, the piggyback graph and the shortest-path cache
+ * are only needed at the sink. They live in memb pools here instead of in
+ * every my_collect_conn; regular nodes keep a NULL pointer.
+ *
+ * Graph nodes are grouped in pages of SRDCP_GRAPH_PAGE_NODES that are taken
+ * from the pool when the first node of the page is created.
+ *
+ * The pools are not part of sink_store.c, which every image links: only the
+ * sink image (example-waco-srdcp*-sink.c) declares them, in its own object,
+ * with SINK_STORE_POOLS() and hands them over with SINK_STORE_USE_POOLS()
+ * before my_collect_open(). Router images reserve none of it, and
+ * sink_store_alloc() returns NULL there.
+ */
+
+/* Number of sink stores in the sink image */
+#ifndef SRDCP_SINK_STORE_POOL
+#define SRDCP_SINK_STORE_POOL 1
+#endif
+
+/* Graph pages shared by all sink stores */
+#ifndef SRDCP_GRAPH_PAGES
+#define SRDCP_GRAPH_PAGES (SRDCP_SINK_STORE_POOL * SRDCP_GRAPH_MAX_PAGES)
+#endif
+
+#define SINK_STORE_POOLS()                                              \
+        MEMB(sink_store_memb, srdcp_sink_store, SRDCP_SINK_STORE_POOL); \
+        MEMB(graph_page_memb, srdcp_graph_page, SRDCP_GRAPH_PAGES)
+
+#define SINK_STORE_USE_POOLS() \
+        sink_store_use_pools(&sink_store_memb, &graph_page_memb)
+
+void sink_store_use_pools(struct memb *stores, struct memb *pages);
+void sink_store_init(void);
+srdcp_sink_store *sink_store_alloc(void);
+srdcp_graph_page *sink_store_page_alloc(void);
+
+#endif // SINK_STORE_H
@@ -0,0 +1,220 @@
+#include <string.h>
+#include "source_route.h"
+#include "my_collect.h"
+
+#if MAX_PATH_LENGTH > SRDCP_SR_LEN_MASK
+#error "MAX_PATH_LENGTH does not fit in the 6-bit hop count of path_len"
+#endif
+
+/**
+ * @brief Reads the id stored at a position of a packed route.
+ * @param bits  The packed id stream (after the width byte).
+ * @param width Bits per id.
+ * @param pos   Position of the id in the route.
+ */
+static uint8_t packed_get(const uint8_t *bits, uint8_t width, uint8_t pos)
+{
+        uint16_t bit = (uint16_t)pos * width;
+        uint16_t word = (uint16_t)bits[bit >> 3] << 8;
+        if (((bit & 7) + width) > 8)
+                word |= bits[(bit >> 3) + 1];
+        return (uint8_t)((word >> (16 - (bit & 7) - width)) & ((1U << width) - 1));
+}
+
+/**
+ * @brief Writes an id at a position of a packed route (bits must be zeroed).
+ */
+static void packed_put(uint8_t *bits, uint8_t width, uint8_t pos, uint8_t id)
+{
+        uint16_t bit = (uint16_t)pos * width;
+        uint16_t word = (uint16_t)id << (16 - (bit & 7) - width);
+        bits[bit >> 3] |= (uint8_t)(word >> 8);
+        if (((bit & 7) + width) > 8)
+                bits[(bit >> 3) + 1] |= (uint8_t)word;
+}
+
+/**
+ * @brief Selects the encoding the sink uses for a route.
+ * @param hops The route, next hop first.
+ * @param len  Number of hops.
+ * @return SRDCP_SR_ENCODING, or SRDCP_SR_ENC_ADDR if an id has a high byte.
+ */
+uint8_t source_route_pick(const linkaddr_t *hops, uint8_t len)
+{
+        uint8_t i;
+        if (SRDCP_SR_ENCODING == SRDCP_SR_ENC_ADDR)
+                return SRDCP_SR_ENC_ADDR;
+        for (i = 0; i < len; i++)
+        {
+                if (hops[i].u8[1] != 0 || hops[i].u8[0] == 0)
+                        return SRDCP_SR_ENC_ADDR;
+        }
+        return SRDCP_SR_ENCODING;
+}
+
+/**
+ * @brief Returns the number of bits needed by the highest id of a route.
+ */
+uint8_t source_route_width(const linkaddr_t *hops, uint8_t len)
+{
+        uint8_t max_id = 1;
+        uint8_t width = 0;
+        uint8_t i;
+        for (i = 0; i < len; i++)
+        {
+                if (hops[i].u8[0] > max_id)
+                        max_id = hops[i].u8[0];
+        }
+        while (max_id)
+        {
+                width++;
+                max_id >>= 1;
+        }
+        return width;
+}
+
+/**
+ * @brief Returns the size in bytes of an encoded route.
+ * @param enc   The encoding.
+ * @param width Bits per id (PACKED only).
+ * @param len   Number of hops.
+ */
+uint8_t source_route_size(uint8_t enc, uint8_t width, uint8_t len)
+{
+        switch (enc)
+        {
+        case SRDCP_SR_ENC_ID8:
+                return len;
+        case SRDCP_SR_ENC_PACKED:
+                return (uint8_t)(1 + (((uint16_t)len * width + 7) >> 3));
+        default:
+                return (uint8_t)(len * sizeof(linkaddr_t));
+        }
+}
+
+/**
+ * @brief Encodes a route.
+ * @param route The destination buffer (source_route_size() bytes).
+ * @param enc   The encoding.
+ * @param hops  The route, next hop first.
+ * @param len   Number of hops.
+ * @return The number of bytes written.
+ */
+uint8_t source_route_write(uint8_t *route, uint8_t enc, const linkaddr_t *hops, uint8_t len)
+{
+        uint8_t i;
+        uint8_t width = (enc == SRDCP_SR_ENC_PACKED) ? source_route_width(hops, len) : 0;
+        uint8_t size = source_route_size(enc, width, len);
+
+        switch (enc)
+        {
+        case SRDCP_SR_ENC_ID8:
+                for (i = 0; i < len; i++)
+                        route[i] = hops[i].u8[0];
+                break;
+        case SRDCP_SR_ENC_PACKED:
+                memset(route, 0, size);
+                route[0] = width;
+                for (i = 0; i < len; i++)
+                        packed_put(route + 1, width, i, hops[i].u8[0]);
+                break;
+        default:
+                memcpy(route, hops, len * sizeof(linkaddr_t));
+        }
+        return size;
+}
+
+/**
+ * @brief Decodes the next hop of a route.
+ * @param route    The encoded route.
+ * @param avail    Bytes available in the packet from 'route' on.
+ * @param enc      The encoding.
+ * @param len      Number of hops (1 to MAX_PATH_LENGTH).
+ * @param next_hop Receives the next hop.
+ * @return The size of the encoded route, or -1 if it is malformed, truncated
+ *         or longer than MAX_PATH_LENGTH hops.
+ */
+int source_route_read(const uint8_t *route, uint8_t avail, uint8_t enc, uint8_t len, linkaddr_t *next_hop)
+{
+        uint8_t width = 0;
+        if (len == 0 || len > MAX_PATH_LENGTH || avail == 0)
+                return -1;
+        if (enc == SRDCP_SR_ENC_PACKED)
+        {
+                width = route[0];
+                if (width == 0 || width > 8)
+                        return -1;
+        }
+        uint8_t size = source_route_size(enc, width, len);
+        if (size > avail)
+                return -1;
+
+        switch (enc)
+        {
+        case SRDCP_SR_ENC_ID8:
+                next_hop->u8[0] = route[0];
+                next_hop->u8[1] = 0;
+                break;
+        case SRDCP_SR_ENC_PACKED:
+                next_hop->u8[0] = packed_get(route + 1, width, 0);
+                next_hop->u8[1] = 0;
+                break;
+        case SRDCP_SR_ENC_ADDR:
+                memcpy(next_hop, route, sizeof(linkaddr_t));
+                break;
+        default:
+                return -1;
+        }
+        return size;
+}
+
+/**
+ * @brief Removes the next hop from an encoded route, in place.
+ * @param route The encoded route (validated by source_route_read()).
+ * @param enc   The encoding.
+ * @param len   Number of hops (2 to MAX_PATH_LENGTH).
+ * @return The number of bytes freed at the front of the route; the
+ *         remaining route ends where the original one ended. 0 if 'len'
+ *         is out of range.
+ */
+uint8_t source_route_pop(uint8_t *route, uint8_t enc, uint8_t len)
+{
+        if (len < 2 || len > MAX_PATH_LENGTH)
+                return 0;
+        if (enc != SRDCP_SR_ENC_PACKED)
+                return (enc == SRDCP_SR_ENC_ID8) ? 1 : sizeof(linkaddr_t);
+
+        linkaddr_t hops[MAX_PATH_LENGTH];
+        uint8_t width = route[0];
+        uint8_t i;
+        for (i = 1; i < len; i++)
+        {
+                hops[i - 1].u8[0] = packed_get(route + 1, width, i);
+                hops[i - 1].u8[1] = 0;
+        }
+        uint8_t freed = (uint8_t)(source_route_size(enc, width, len) -
+                                  source_route_size(enc, source_route_width(hops, len - 1), len - 1));
+        source_route_write(route + freed, enc, hops, len - 1);
+        return freed;
+}
+
+/**
+ * @brief Finds the end of a subtree of a branching route.
+ * @param tree  The tree nodes, in pre-order.
+ * @param len   Number of tree nodes.
+ * @param start Index of the subtree root.
+ * @return The index following the subtree, or -1 if the tree is malformed.
+ */
+int source_route_subtree_end(const source_route_tree_node *tree, uint8_t len, uint8_t start)
+{
+        uint16_t open = 1;
+        uint8_t i = start;
+        while (open > 0)
+        {
+                if (i >= len)
+                        return -1;
+                open = (uint16_t)(open - 1 + tree[i].children);
+                i++;
+        }
+        return i;
+}
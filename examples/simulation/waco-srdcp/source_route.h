@@ -0,0 +1,65 @@
+#ifndef SOURCE_ROUTE_H
+#define SOURCE_ROUTE_H
+
+#include <stdint.h>
+#include "core/net/linkaddr.h"
+
+// ------------------------------------------------------------
+//                DOWNLINK SOURCE-ROUTE ENCODING
+// ------------------------------------------------------------
+/*
+ * The route follows downward_data_packet_header, next hop first. The two
+ * top bits of path_len select its encoding, the low six bits hold the
+ * number of hops left, so nodes decode every encoding whatever the sink
+ * was built with:
+ *
+ *   ADDR    linkaddr_t per hop (original format, flag bits 00)
+ *   ID8     1-byte node id per hop (SRDCP ids have a zero high byte)
+ *   PACKED  1 byte holding the id width w (1..8), then the ids packed
+ *           MSB-first on w bits each
+ *   TREE    branching route of a multi-destination downlink: the low six
+ *           bits count tree nodes, stored in pre-order as (id, children);
+ *           the first node is the receiver. A source_route_records block
+ *           and the per-destination payloads follow the tree.
+ */
+
+#define SRDCP_SR_ENC_ADDR 0
+#define SRDCP_SR_ENC_ID8 1
+#define SRDCP_SR_ENC_PACKED 2
+#define SRDCP_SR_ENC_TREE 3
+
+#define SRDCP_SR_ENC_SHIFT 6
+#define SRDCP_SR_LEN_MASK 0x3F
+#define SRDCP_SR_ENC(path_len) ((uint8_t)((path_len) >> SRDCP_SR_ENC_SHIFT))
+#define SRDCP_SR_LEN(path_len) ((uint8_t)((path_len) & SRDCP_SR_LEN_MASK))
+#define SRDCP_SR_PATH_LEN(enc, len) ((uint8_t)(((enc) << SRDCP_SR_ENC_SHIFT) | ((len) & SRDCP_SR_LEN_MASK)))
+
+/* Encoding used by the sink (falls back to ADDR for ids with a high byte) */
+#ifndef SRDCP_SR_ENCODING
+#define SRDCP_SR_ENCODING SRDCP_SR_ENC_ID8
+#endif
+
+struct source_route_tree_node
+{
+        uint8_t id;
+        uint8_t children;
+} __attribute__((packed));
+typedef struct source_route_tree_node source_route_tree_node;
+
+/* Followed by 'count' records of (destination id, payload_len bytes) */
+struct source_route_records
+{
+        uint8_t payload_len;
+        uint8_t count;
+} __attribute__((packed));
+typedef struct source_route_records source_route_records;
+
+uint8_t source_route_pick(const linkaddr_t *hops, uint8_t len);
+uint8_t source_route_width(const linkaddr_t *hops, uint8_t len);
+uint8_t source_route_size(uint8_t enc, uint8_t width, uint8_t len);
+uint8_t source_route_write(uint8_t *route, uint8_t enc, const linkaddr_t *hops, uint8_t len);
+int source_route_read(const uint8_t *route, uint8_t avail, uint8_t enc, uint8_t len, linkaddr_t *next_hop);
+uint8_t source_route_pop(uint8_t *route, uint8_t enc, uint8_t len);
+int source_route_subtree_end(const source_route_tree_node *tree, uint8_t len, uint8_t start);
+
+#endif // SOURCE_ROUTE_H
@@ -0,0 +1,166 @@
+#include "contiki.h"
+#include "telemetry.h"
+#include <stdio.h>
+
+#if SRDCP_TELEMETRY
+
+/* Ring content: length byte, then the record. core/lib/ringbuf.c stops at
+ * 128 bytes, too small for a neighbor dump. ring_get == ring_put: empty */
+static uint8_t ring_data[TELEMETRY_RING_SIZE];
+static uint16_t ring_get, ring_put;
+
+uint16_t telemetry_stalls;
+
+static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+PROCESS(telemetry_process, "Telemetry drain");
+
+static uint16_t ring_elements(void)
+{
+        return (ring_put >= ring_get) ? ring_put - ring_get : TELEMETRY_RING_SIZE - ring_get + ring_put;
+}
+
+static void ring_put_byte(uint8_t c)
+{
+        ring_data[ring_put] = c;
+        if (++ring_put == TELEMETRY_RING_SIZE)
+                ring_put = 0;
+}
+
+static uint8_t ring_get_byte(void)
+{
+        uint8_t c = ring_data[ring_get];
+        if (++ring_get == TELEMETRY_RING_SIZE)
+                ring_get = 0;
+        return c;
+}
+
+/**
+ * @brief Prints the oldest record of the ring as a "TM:" base64 line.
+ * @return 0 if the ring was empty.
+ */
+static int print_record(void)
+{
+        uint8_t rec[TM_REC_MAX];
+        uint8_t len, i;
+        uint32_t acc;
+
+        if (ring_get == ring_put)
+                return 0;
+        len = ring_get_byte();
+        for (i = 0; i < len; i++)
+                rec[i] = ring_get_byte();
+
+        putchar('T');
+        putchar('M');
+        putchar(':');
+        for (i = 0; i < len; i += 3)
+        {
+                acc = (uint32_t)rec[i] << 16;
+                if (i + 1 < len)
+                        acc |= (uint32_t)rec[i + 1] << 8;
+                if (i + 2 < len)
+                        acc |= rec[i + 2];
+                putchar(b64[(acc >> 18) & 0x3F]);
+                putchar(b64[(acc >> 12) & 0x3F]);
+                if (i + 1 < len)
+                        putchar(b64[(acc >> 6) & 0x3F]);
+                if (i + 2 < len)
+                        putchar(b64[acc & 0x3F]);
+        }
+        putchar('\n');
+        return 1;
+}
+
+/**
+ * @brief Sets up the ring buffer and starts the drain process.
+ */
+void telemetry_init(void)
+{
+        ring_get = ring_put = 0;
+        process_start(&telemetry_process, NULL);
+}
+
+/**
+ * @brief Starts a record: type, local address, time in seconds.
+ */
+void tm_begin(tm_rec *r, uint8_t type)
+{
+        r->len = 0;
+        tm_u8(r, type);
+        tm_addr(r, &linkaddr_node_addr);
+        tm_u16(r, (uint16_t)(clock_time() / CLOCK_SECOND));
+}
+
+void tm_u8(tm_rec *r, uint8_t v)
+{
+        if (r->len < TM_REC_MAX)
+                r->buf[r->len++] = v;
+}
+
+void tm_u16(tm_rec *r, uint16_t v)
+{
+        tm_u8(r, v & 0xFF);
+        tm_u8(r, v >> 8);
+}
+
+void tm_u32(tm_rec *r, uint32_t v)
+{
+        tm_u16(r, (uint16_t)v);
+        tm_u16(r, (uint16_t)(v >> 16));
+}
+
+void tm_addr(tm_rec *r, const linkaddr_t *a)
+{
+        tm_u8(r, a->u8[0]);
+        tm_u8(r, a->u8[1]);
+}
+
+/**
+ * @brief Queues a record for the drain process.
+ * @details When the ring is full, the oldest records are printed right away
+ *          instead: records are never lost, the app only pays the UART time
+ *          it would have paid with printf.
+ */
+void tm_end(tm_rec *r)
+{
+        uint8_t i;
+
+        while (TELEMETRY_RING_SIZE - 1 - ring_elements() < r->len + 1u)
+        {
+                if (!print_record())
+                        return; /* larger than the ring, cannot happen with TM_REC_MAX */
+                telemetry_stalls++;
+        }
+        ring_put_byte(r->len);
+        for (i = 0; i < r->len; i++)
+                ring_put_byte(r->buf[i]);
+        process_poll(&telemetry_process);
+}
+
+/**
+ * @brief Prints queued records, TELEMETRY_DRAIN_RECORDS per TELEMETRY_DRAIN_PERIOD.
+ */
+PROCESS_THREAD(telemetry_process, ev, data)
+{
+        static struct etimer et;
+        uint8_t n;
+
+        PROCESS_BEGIN();
+
+        while (1)
+        {
+                PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+                while (ring_get != ring_put)
+                {
+                        for (n = 0; n < TELEMETRY_DRAIN_RECORDS && print_record(); n++)
+                                ;
+                        etimer_set(&et, TELEMETRY_DRAIN_PERIOD);
+                        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+                }
+        }
+
+        PROCESS_END();
+}
+
+#endif /* SRDCP_TELEMETRY */
@@ -0,0 +1,91 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "net/linkaddr.h"
+
+// ------------------------------------------------------------
+//                 BINARY TELEMETRY RECORDS
+// ------------------------------------------------------------
+/*
+ * Replaces the printf CSV/STAT/APP lines of the example app when
+ * SRDCP_TELEMETRY is set. A record is
+ *
+ *   type (1) | local address u8[0], u8[1] (2) | time, seconds (2) | fields
+ *
+ * with multi-byte fields little endian and addresses as u8[0], u8[1]. The
+ * time is clock_time() / CLOCK_SECOND truncated to 16 bits: it wraps every
+ * 65536 s (about 18.2 h), so longer runs have to unwrap it, e.g. against the
+ * COOJA timestamp in front of each line.
+ * Records are queued in a byte ring buffer and a background process prints at most TELEMETRY_DRAIN_RECORDS of them every
+ * TELEMETRY_DRAIN_PERIOD, one per line: "TM:" and the record in base64
+ * (no padding). scripts/telemetry_decode.py turns the lines back into the
+ * text the app printed before; the field lists are kept there as well.
+ *
+ * A record that does not fit in the ring is not dropped: older records are
+ * printed at once to make room (counted in telemetry_stalls).
+ */
+
+#ifndef SRDCP_TELEMETRY
+#define SRDCP_TELEMETRY 0
+#endif
+#ifndef TELEMETRY_DRAIN_PERIOD
+#define TELEMETRY_DRAIN_PERIOD (CLOCK_SECOND / 8)
+#endif
+#ifndef TELEMETRY_DRAIN_RECORDS
+#define TELEMETRY_DRAIN_RECORDS 2
+#endif
+
+/* Record types and their fields after the common header */
+#define TM_PDR_UL_HDR 0x01  /* - */
+#define TM_PDR_UL 0x02      /* peer, first u16, last u16, recv u32, gaps u32, dups u32, parent, metric u16 */
+#define TM_PDR_DL_HDR 0x03  /* - */
+#define TM_PDR_DL 0x04      /* as TM_PDR_UL, peer is the sink */
+#define TM_NEI_HDR 0x05     /* - */
+#define TM_NEI 0x06         /* who u8 (1 SINK), rank u8, neigh, hop u16, rssi s16, lqi u8, prr u8,
+                               last_seen u16 (s), last_seq u16, parent, metric u16 */
+#define TM_UL_DELAY 0x07    /* src, hops u8, delay u32 (ticks) */
+#define TM_DL_DELAY 0x08    /* delay u32 (ticks), parent */
+#define TM_UL_SEND 0x09     /* seq u16, metric u16, parent */
+#define TM_UL_GOT 0x0a      /* seq u16, from, hops u8, metric u16 */
+#define TM_DL_SEND 0x0b     /* seq u16, dst, multi u8 */
+#define TM_DL_GOT 0x0c      /* seq u16, hops u8, metric u16, parent */
+#define TM_UL_ATTEMPT 0x0d  /* attempt u16, route_ok u8, sent u16 */
+#define TM_DL_ATTEMPT 0x0e  /* attempt u16, target, route_ok u8, sent u16 */
+
+/* Header and the largest field list (TM_PDR_UL) */
+#define TM_REC_MAX (5 + 24)
+
+/* Ring bytes of a neighbor record (length byte, header, fields) */
+#define TM_NEI_LEN (1 + 5 + 18)
+/* Neighbor records of one dump: NEI_MAX of the example app */
+#ifndef TELEMETRY_NEI_RECORDS
+#define TELEMETRY_NEI_RECORDS 32
+#endif
+/* Ring size in bytes. The default holds one full neighbor dump (TM_NEI_HDR
+ * and TELEMETRY_NEI_RECORDS TM_NEI records) without printing early; one
+ * byte always stays free */
+#ifndef TELEMETRY_RING_SIZE
+#define TELEMETRY_RING_SIZE (1 + (1 + 5) + TELEMETRY_NEI_RECORDS * TM_NEI_LEN)
+#endif
+
+typedef struct
+{
+        uint8_t len;
+        uint8_t buf[TM_REC_MAX];
+} tm_rec;
+
+/* Records printed early because the ring was full */
+extern uint16_t telemetry_stalls;
+
+void telemetry_init(void);
+
+/* Build a record: begin writes the header, end queues it */
+void tm_begin(tm_rec *r, uint8_t type);
+void tm_u8(tm_rec *r, uint8_t v);
+void tm_u16(tm_rec *r, uint16_t v);
+void tm_u32(tm_rec *r, uint32_t v);
+void tm_addr(tm_rec *r, const linkaddr_t *a);
+void tm_end(tm_rec *r);
+
+#endif /* TELEMETRY_H */
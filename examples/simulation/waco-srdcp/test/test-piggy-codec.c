@@ -0,0 +1,297 @@
+/**
+ * @file test-piggy-codec.c
+ * @brief Native unit tests of the v2 piggyback codec (piggy_codec.c).
+ *
+ * Build and run:
+ *   make TARGET=native test-piggy-codec && ./test-piggy-codec.native
+ * The process exits with the number of failed tests.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "unit-test.h"
+#include "piggy_codec.h"
+
+UNIT_TEST_REGISTER(quantize, "RSSI/PRR nibbles");
+UNIT_TEST_REGISTER(neighbors, "NEIGHBORS_V2 round trip");
+UNIT_TEST_REGISTER(status_keyframe, "STATUS_V2 keyframe round trip");
+UNIT_TEST_REGISTER(status_delta, "STATUS_V2 deltas and resync");
+UNIT_TEST_REGISTER(malformed, "Malformed v2 TLVs");
+UNIT_TEST_REGISTER(size, "v2 smaller than v1");
+
+static srdcp_node_status make_status(uint16_t batt, uint8_t load, uint8_t metric,
+                                     uint16_t ul, uint16_t dl)
+{
+        srdcp_node_status st;
+        memset(&st, 0, sizeof(st));
+        st.node.u8[0] = 7;
+        st.battery_mv = batt;
+        st.queue_load = load;
+        st.metric = metric;
+        st.ul_delay = ul;
+        st.dl_delay = dl;
+        return st;
+}
+
+/* Same fields, 'node' aside (v2 does not carry it) */
+static int status_equal(const srdcp_node_status *a, const srdcp_node_status *b)
+{
+        return a->battery_mv == b->battery_mv && a->queue_load == b->queue_load &&
+               a->metric == b->metric && a->ul_delay == b->ul_delay &&
+               a->dl_delay == b->dl_delay && a->flags == b->flags;
+}
+
+/* Sink side: decode one encoded STATUS_V2 TLV */
+static int sink_apply(const uint8_t *tlv, srdcp_node_status *known, uint8_t *sync)
+{
+        srdcp_piggy_tlv hdr;
+        memcpy(&hdr, tlv, sizeof(hdr));
+        if (hdr.type != SRDCP_PIGGY_TLV_STATUS_V2)
+                return -1;
+        return piggy_status_decode(tlv + sizeof(hdr), hdr.length, known, sync);
+}
+
+UNIT_TEST(quantize)
+{
+        int v;
+
+        UNIT_TEST_BEGIN();
+
+        for (v = 0; v <= 100; v++)
+        {
+                uint8_t q = piggy_prr_quantize((uint8_t)v);
+                int back = piggy_prr_dequantize(q);
+                UNIT_TEST_ASSERT(q <= 15);
+                UNIT_TEST_ASSERT(abs(back - v) <= 4);
+        }
+        UNIT_TEST_ASSERT(piggy_prr_quantize(250) == 15);
+        UNIT_TEST_ASSERT(piggy_prr_dequantize(15) == 100);
+        UNIT_TEST_ASSERT(piggy_prr_dequantize(0) == 0);
+
+        for (v = -100; v <= -25; v++)
+        {
+                uint8_t q = piggy_rssi_quantize((int8_t)v);
+                int back = piggy_rssi_dequantize(q);
+                UNIT_TEST_ASSERT(q <= 15);
+                UNIT_TEST_ASSERT(abs(back - v) <= 3);
+        }
+        UNIT_TEST_ASSERT(piggy_rssi_quantize(-128) == 0);
+        UNIT_TEST_ASSERT(piggy_rssi_quantize(0) == 15);
+
+        UNIT_TEST_END();
+}
+
+UNIT_TEST(neighbors)
+{
+        srdcp_piggy_neighbor_item in[3], out[3];
+        uint8_t buf[PIGGY_NEIGHBORS_V2_MAX(3)];
+        srdcp_piggy_tlv hdr;
+        uint8_t size;
+        int i, n;
+
+        UNIT_TEST_BEGIN();
+
+        memset(in, 0, sizeof(in));
+        for (i = 0; i < 3; i++)
+        {
+                in[i].neighbor.u8[0] = (uint8_t)(10 + i);
+                in[i].rssi = (int8_t)(-60 - 10 * i);
+                in[i].prr = (uint8_t)(100 - 20 * i);
+                in[i].metric = (uint8_t)(i + 1);
+                in[i].load = 42;
+        }
+        size = piggy_neighbors_encode(in, 3, buf, sizeof(buf));
+        UNIT_TEST_ASSERT(size == sizeof(srdcp_piggy_tlv) + 1 + 3 * 3);
+        UNIT_TEST_ASSERT(piggy_neighbors_encode(in, 3, buf, (uint8_t)(size - 1)) == 0);
+
+        memcpy(&hdr, buf, sizeof(hdr));
+        UNIT_TEST_ASSERT(hdr.type == SRDCP_PIGGY_TLV_NEIGHBORS_V2);
+        UNIT_TEST_ASSERT(hdr.length == size - sizeof(hdr));
+
+        n = piggy_neighbors_decode(buf + sizeof(hdr), hdr.length, 55, out, 3);
+        UNIT_TEST_ASSERT(n == 3);
+        for (i = 0; i < 3; i++)
+        {
+                UNIT_TEST_ASSERT(out[i].neighbor.u8[0] == in[i].neighbor.u8[0]);
+                UNIT_TEST_ASSERT(out[i].neighbor.u8[1] == 0);
+                UNIT_TEST_ASSERT(abs(out[i].rssi - in[i].rssi) <= 3);
+                UNIT_TEST_ASSERT(abs(out[i].prr - in[i].prr) <= 4);
+                UNIT_TEST_ASSERT(out[i].metric == in[i].metric);
+                UNIT_TEST_ASSERT(out[i].load == 55);
+        }
+
+        /* Capacity smaller than the report: extra neighbors are skipped */
+        n = piggy_neighbors_decode(buf + sizeof(hdr), hdr.length, 0, out, 2);
+        UNIT_TEST_ASSERT(n == 2);
+
+        UNIT_TEST_END();
+}
+
+UNIT_TEST(status_keyframe)
+{
+        piggy_status_tx tx;
+        srdcp_node_status st = make_status(2950, 30, 4, 120, 340);
+        srdcp_node_status known;
+        uint8_t buf[PIGGY_STATUS_V2_MAX];
+        uint8_t sync = 0;
+        uint8_t size;
+        int flags;
+
+        UNIT_TEST_BEGIN();
+
+        memset(&tx, 0, sizeof(tx));
+        memset(&known, 0, sizeof(known));
+        st.flags = 3;
+        size = piggy_status_encode(&tx, &st, buf, sizeof(buf));
+        UNIT_TEST_ASSERT(size == PIGGY_STATUS_V2_MAX);
+
+        flags = sink_apply(buf, &known, &sync);
+        UNIT_TEST_ASSERT(flags == (PIGGY_STATUS_F_ALL | PIGGY_STATUS_KEYFRAME));
+        UNIT_TEST_ASSERT(status_equal(&known, &st));
+        UNIT_TEST_ASSERT(sync & PIGGY_SYNC_VALID);
+
+        UNIT_TEST_END();
+}
+
+UNIT_TEST(status_delta)
+{
+        piggy_status_tx tx;
+        srdcp_node_status st = make_status(3000, 10, 2, 100, 200);
+        srdcp_node_status known;
+        uint8_t buf[PIGGY_STATUS_V2_MAX];
+        uint8_t lost[PIGGY_STATUS_V2_MAX];
+        uint8_t sync = 0;
+        uint8_t size;
+        int i, flags;
+
+        UNIT_TEST_BEGIN();
+
+        memset(&tx, 0, sizeof(tx));
+        memset(&known, 0, sizeof(known));
+        UNIT_TEST_ASSERT(piggy_status_encode(&tx, &st, buf, sizeof(buf)) > 0);
+        UNIT_TEST_ASSERT(sink_apply(buf, &known, &sync) >= 0);
+
+        /* Only ul_delay changed: flags, seq and 2 bytes */
+        st.ul_delay = 150;
+        size = piggy_status_encode(&tx, &st, buf, sizeof(buf));
+        UNIT_TEST_ASSERT(size == sizeof(srdcp_piggy_tlv) + 2 + 2);
+        flags = sink_apply(buf, &known, &sync);
+        UNIT_TEST_ASSERT(flags == PIGGY_STATUS_F_UL_DELAY);
+        UNIT_TEST_ASSERT(status_equal(&known, &st));
+        UNIT_TEST_ASSERT(sync & PIGGY_SYNC_VALID);
+
+        /* Nothing changed: no TLV, and the next delta still follows */
+        UNIT_TEST_ASSERT(piggy_status_encode(&tx, &st, buf, sizeof(buf)) == 0);
+        st.queue_load = 70;
+        st.metric = 3;
+        size = piggy_status_encode(&tx, &st, buf, sizeof(buf));
+        UNIT_TEST_ASSERT(size == sizeof(srdcp_piggy_tlv) + 2 + 1 + 1);
+        UNIT_TEST_ASSERT(sink_apply(buf, &known, &sync) == (PIGGY_STATUS_F_LOAD | PIGGY_STATUS_F_METRIC));
+        UNIT_TEST_ASSERT(status_equal(&known, &st));
+        UNIT_TEST_ASSERT(sync & PIGGY_SYNC_VALID);
+
+        /* A lost report leaves the sink unsynced... */
+        st.battery_mv = 2900;
+        UNIT_TEST_ASSERT(piggy_status_encode(&tx, &st, lost, sizeof(lost)) > 0);
+        st.dl_delay = 250;
+        UNIT_TEST_ASSERT(piggy_status_encode(&tx, &st, buf, sizeof(buf)) > 0);
+        UNIT_TEST_ASSERT(sink_apply(buf, &known, &sync) == PIGGY_STATUS_F_DL_DELAY);
+        UNIT_TEST_ASSERT(!(sync & PIGGY_SYNC_VALID));
+        UNIT_TEST_ASSERT(known.battery_mv == 3000);
+        UNIT_TEST_ASSERT(known.dl_delay == 250);
+
+        /* ...until the next keyframe, at most SRDCP_PIGGY_KEYFRAME_PERIOD reports later */
+        for (i = 0; i < SRDCP_PIGGY_KEYFRAME_PERIOD; i++)
+        {
+                st.ul_delay = (uint16_t)(st.ul_delay + 1);
+                UNIT_TEST_ASSERT(piggy_status_encode(&tx, &st, buf, sizeof(buf)) > 0);
+                flags = sink_apply(buf, &known, &sync);
+                UNIT_TEST_ASSERT(flags >= 0);
+                if (flags & PIGGY_STATUS_KEYFRAME)
+                        break;
+                UNIT_TEST_ASSERT(!(sync & PIGGY_SYNC_VALID));
+        }
+        UNIT_TEST_ASSERT(i < SRDCP_PIGGY_KEYFRAME_PERIOD);
+        UNIT_TEST_ASSERT(sync & PIGGY_SYNC_VALID);
+        UNIT_TEST_ASSERT(status_equal(&known, &st));
+
+        UNIT_TEST_END();
+}
+
+UNIT_TEST(malformed)
+{
+        srdcp_piggy_neighbor_item out[3];
+        srdcp_node_status known;
+        const uint8_t nei_short[] = {2, 10, 0xFF, 1, 11};
+        const uint8_t status_short[] = {PIGGY_STATUS_F_BATTERY, 1, 0x10};
+        uint8_t sync = PIGGY_SYNC_VALID;
+
+        UNIT_TEST_BEGIN();
+
+        memset(&known, 0, sizeof(known));
+        UNIT_TEST_ASSERT(piggy_neighbors_decode(nei_short, sizeof(nei_short), 0, out, 3) == -1);
+        UNIT_TEST_ASSERT(piggy_neighbors_decode(nei_short, 0, 0, out, 3) == -1);
+        UNIT_TEST_ASSERT(piggy_status_decode(status_short, sizeof(status_short), &known, &sync) == -1);
+        UNIT_TEST_ASSERT(piggy_status_decode(status_short, 1, &known, &sync) == -1);
+        UNIT_TEST_ASSERT(known.battery_mv == 0);
+        UNIT_TEST_ASSERT(sync == PIGGY_SYNC_VALID);
+
+        UNIT_TEST_END();
+}
+
+UNIT_TEST(size)
+{
+        piggy_status_tx tx;
+        srdcp_node_status st = make_status(3000, 10, 2, 100, 200);
+        srdcp_piggy_neighbor_item nei[SRDCP_PIGGY_MAX_NEIGHBORS];
+        uint8_t buf[PIGGY_STATUS_V2_MAX + PIGGY_NEIGHBORS_V2_MAX(SRDCP_PIGGY_MAX_NEIGHBORS)];
+        const unsigned v1 = 2 * sizeof(srdcp_piggy_tlv) + sizeof(srdcp_node_status) + sizeof(linkaddr_t) + 2 +
+                            SRDCP_PIGGY_MAX_NEIGHBORS * sizeof(srdcp_piggy_neighbor_item);
+        unsigned keyframe, delta;
+
+        UNIT_TEST_BEGIN();
+
+        memset(&tx, 0, sizeof(tx));
+        memset(nei, 0, sizeof(nei));
+        keyframe = piggy_status_encode(&tx, &st, buf, sizeof(buf));
+        keyframe += piggy_neighbors_encode(nei, SRDCP_PIGGY_MAX_NEIGHBORS, buf, sizeof(buf));
+        st.ul_delay = 101;
+        st.dl_delay = 201;
+        delta = piggy_status_encode(&tx, &st, buf, sizeof(buf));
+        delta += piggy_neighbors_encode(nei, SRDCP_PIGGY_MAX_NEIGHBORS, buf, sizeof(buf));
+        printf("piggyback bytes with %u neighbors: v1=%u v2 keyframe=%u v2 delta=%u\n",
+               (unsigned)SRDCP_PIGGY_MAX_NEIGHBORS, v1, keyframe, delta);
+        UNIT_TEST_ASSERT(keyframe < v1);
+        UNIT_TEST_ASSERT(delta < keyframe);
+
+        UNIT_TEST_END();
+}
+
+PROCESS(test_process, "Piggyback codec tests");
+AUTOSTART_PROCESSES(&test_process);
+
+PROCESS_THREAD(test_process, ev, data)
+{
+        static int failures;
+
+        PROCESS_BEGIN();
+
+        UNIT_TEST_RUN(quantize);
+        UNIT_TEST_RUN(neighbors);
+        UNIT_TEST_RUN(status_keyframe);
+        UNIT_TEST_RUN(status_delta);
+        UNIT_TEST_RUN(malformed);
+        UNIT_TEST_RUN(size);
+
+        failures = (UNIT_TEST_RESULT(quantize) == unit_test_failure) +
+                   (UNIT_TEST_RESULT(neighbors) == unit_test_failure) +
+                   (UNIT_TEST_RESULT(status_keyframe) == unit_test_failure) +
+                   (UNIT_TEST_RESULT(status_delta) == unit_test_failure) +
+                   (UNIT_TEST_RESULT(malformed) == unit_test_failure) +
+                   (UNIT_TEST_RESULT(size) == unit_test_failure);
+        printf("piggy codec: %d test(s) failed\n", failures);
+        exit(failures);
+
+        PROCESS_END();
+}
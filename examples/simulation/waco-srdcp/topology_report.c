@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include "my_collect.h"
 #include "routing_table.h"
+#include "sys/prof.h"
 #include <string.h>
 #include <stdint.h>
 /* ------------------------------------ LOG Tags / Helper ------------------------------------ */
@@ -170,8 +171,11 @@ void deliver_topology_report_to_sink(my_collect_conn *conn)
         packetbuf_hdrreduce(sizeof(enum packet_type) + sizeof(uint8_t));
 
         LOG(TAG_TOPO, "[SINK]: received %u topology report(s)", (unsigned)len);
+        if (!conn->sink)
+                return;
 
         uint8_t i;
+        PROF_ENTER(topo_report_rx);
         /* ---- PATCH START (topology_report.c) ---- */
         for (i = 0; i < len; i++)
         {
@@ -187,8 +191,9 @@ void deliver_topology_report_to_sink(my_collect_conn *conn)
                 }
                 printf("Sink: received topology report. Updating parent of node %02u:%02u\n",
                        tc.node.u8[0], tc.node.u8[1]);
-                dict_add(&conn->routing_table, tc.node, tc.parent);
+                dict_add(&conn->sink->routing_table, tc.node, tc.parent);
         }
+        PROF_EXIT(topo_report_rx);
 
-        print_dict_state(&conn->routing_table);
+        print_dict_state(&conn->sink->routing_table);
 }
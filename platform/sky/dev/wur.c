@@ -52,9 +52,14 @@ static int configure(int type, int c)
 	       WUR_RX_MAKE_INPUT();
        
 	       WUR_RX_ENABLE_IRQ();
+	       /* The receiver listens from now on. Its time is an rtimer
+	        * difference that wraps every 65536 ticks (2 s); the clock
+	        * interrupt's energest_flush() once a second folds it in */
+	       ENERGEST_ON(ENERGEST_TYPE_WUR_RX);
       }
     } else {
         WUR_RX_DISABLE_IRQ();
+        ENERGEST_OFF(ENERGEST_TYPE_WUR_RX);
     }
     return 1;
   }
@@ -68,11 +73,13 @@ void wur_init() {
 }
 
 void wur_set_tx() {
+	ENERGEST_ON(ENERGEST_TYPE_WUR_TX);
 	WUR_TX_SET();
 }
 
 void wur_clear_tx() {
 	WUR_TX_CLEAR();
+	ENERGEST_OFF(ENERGEST_TYPE_WUR_TX);
 }
 /*---------------------------------------------------------------------------*/
 SENSORS_SENSOR(wur_sensor, "wur_rx_sensor",